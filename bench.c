@@ -0,0 +1,1334 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+
+#include "ds_btree.h"
+#include "ds_bptree.h"
+#include "ds_heap_cache.h"
+#include "ds_fifo.h"
+#include "ds_mpsc.h"
+#include "ds_ring.h"
+#include "ds_mpmc.h"
+#include "ds_lifo_atomic.h"
+#include "ds_pqueue.h"
+#include "ds_timer.h"
+#include "ds_htable.h"
+#include "ds_hmap.h"
+#include "ds_btree_ext.h"
+#include "ds_cache.h"
+#include "ds_dlist.h"
+#include "ds_sort.h"
+#include "ds_fifo_ext.h"
+#include "ds_fifo_unrolled.h"
+
+#define BENCH_COUNT_DEFAULT 1000000
+
+typedef struct element_s element_t;
+struct element_s
+{
+    ds_btree_item_t btree_item;
+    uint64_t key;
+};
+
+static size_t cmp_calls;
+
+static int element_cmp(void *_left, void *_right)
+{
+    element_t *left = (element_t *)_left;
+    element_t *right = (element_t *)_right;
+    cmp_calls++;
+    if (left->key == right->key)
+        return 0;
+    if (left->key < right->key)
+        return -1;
+    return 1;
+}
+
+static inline int element_inline_cmp(element_t *left, element_t *right)
+{
+    cmp_calls++;
+    return (left->key > right->key) - (left->key < right->key);
+}
+
+DS_BTREE_DEFINE(element_btree, element_t, btree_item, element_inline_cmp)
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)random() << 33) ^ ((uint64_t)random() << 11) ^ (uint64_t)random();
+}
+
+static void report(const char *name, size_t n, double start)
+{
+    double ns = now_ns() - start;
+    printf("%-24s %10.1f ns/op %8.2f cmp/op\n", name, ns / n, (double)cmp_calls / n);
+    cmp_calls = 0;
+}
+
+static void bench_btree(element_t *elements, size_t n, const char *stream)
+{
+    ds_btree_t btree;
+    ds_btree_init(&btree, offsetof(element_t, btree_item), element_cmp);
+    double start;
+
+    printf("# %s keys\n", stream);
+
+    cmp_calls = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_btree_insert(&btree, &elements[i]);
+    report("btree insert", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_btree_find(&btree, &elements[i]);
+    report("btree find", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_btree_remove_object(&btree, &elements[i]);
+    report("btree remove", n, start);
+}
+
+static void bench_btree_define(element_t *elements, size_t n)
+{
+    ds_btree_t btree;
+    ds_btree_init(&btree, offsetof(element_t, btree_item), element_cmp);
+    double start;
+
+    cmp_calls = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        element_btree_insert(&btree, &elements[i]);
+    report("btree define insert", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        element_btree_find(&btree, &elements[i]);
+    report("btree define find", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        element_btree_remove(&btree, &elements[i]);
+    report("btree define remove", n, start);
+}
+
+static void bench_btree_u64(element_t *elements, size_t n)
+{
+    ds_btree_t btree;
+    ds_btree_u64_init(&btree, offsetof(element_t, btree_item), offsetof(element_t, key));
+    double start;
+
+    cmp_calls = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_btree_u64_insert(&btree, &elements[i]);
+    report("btree u64 insert", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_btree_u64_find(&btree, elements[i].key);
+    report("btree u64 find", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_btree_u64_remove(&btree, elements[i].key);
+    report("btree u64 remove", n, start);
+}
+
+static void bench_btree_build(element_t *elements, size_t n)
+{
+    ds_btree_t btree;
+    ds_btree_init(&btree, offsetof(element_t, btree_item), element_cmp);
+    void **objects = malloc(n * sizeof(void *));
+    double start;
+
+    for (size_t i = 0; i < n; i++)
+        objects[i] = &elements[i];
+    cmp_calls = 0;
+    start = now_ns();
+    ds_btree_build_sorted(&btree, objects, n, 0);
+    report("btree build sorted", n, start);
+
+    ds_btree_init(&btree, offsetof(element_t, btree_item), element_cmp);
+    start = now_ns();
+    ds_btree_build_sorted(&btree, objects, n, 1);
+    report("btree build verified", n, start);
+
+    ds_btree_cursor_t cursor;
+    start = now_ns();
+    for (void *object = ds_btree_cursor_first(&cursor, &btree); object; object = ds_btree_cursor_next(&cursor))
+        ;
+    report("btree cursor next", n, start);
+
+    start = now_ns();
+    for (void *object = ds_btree_lower_bound(&btree, objects[0]); object; object = ds_btree_upper_bound(&btree, object))
+        ;
+    report("btree upper bound next", n, start);
+
+    free(objects);
+}
+
+// Merge a btree of m objects into a btree of n - m objects, by insertions
+// and by a union
+static void bench_btree_union(element_t *elements, size_t n, size_t m)
+{
+    ds_btree_t btree, other;
+    char name[48];
+    double start;
+
+    for (int with_union = 0; with_union <= 1; with_union++)
+    {
+        ds_btree_init(&btree, offsetof(element_t, btree_item), element_cmp);
+        ds_btree_init(&other, offsetof(element_t, btree_item), element_cmp);
+        for (size_t i = 0; i < n; i++)
+            ds_btree_insert(i % (n / m) == 0 ? &other : &btree, &elements[i]);
+        cmp_calls = 0;
+        start = now_ns();
+        if (with_union)
+            ds_btree_union(&btree, &other, 0);
+        else
+        {
+            for (size_t i = 0; i < n; i += n / m)
+            {
+                ds_btree_remove_object(&other, &elements[i]);
+                ds_btree_insert(&btree, &elements[i]);
+            }
+        }
+        snprintf(name, sizeof(name), "btree %s 1/%zu", with_union ? "union" : "reinsert", n / m);
+        report(name, m, start);
+    }
+}
+
+static void bench_btree_bulk(element_t *elements, size_t n)
+{
+    ds_btree_t btree;
+    void **objects = malloc(n * sizeof(void *));
+    char name[48];
+    double start;
+
+    for (int threads = 1; threads <= 16; threads *= 2)
+    {
+        ds_btree_init(&btree, offsetof(element_t, btree_item), element_cmp);
+        for (size_t i = 0; i < n; i++)
+            objects[i] = &elements[i];
+        start = now_ns();
+        ds_btree_bulk_insert(&btree, objects, n, threads);
+        snprintf(name, sizeof(name), "btree bulk insert x%d", threads);
+        report(name, n, start);
+    }
+
+    free(objects);
+}
+
+// Create a pool of n bptree nodes and take n / 16 of them
+static void bench_heap(size_t n)
+{
+    const char *names[] = {"heap eager", "heap lazy", "heap growable"};
+    ds_heap_t heap;
+    double start;
+
+    for (int mode = 0; mode < 3; mode++)
+    {
+        start = now_ns();
+        void *store = mode == 0 ? calloc(n, sizeof(ds_bptree_node_t)) : mode == 1 ? malloc(n * sizeof(ds_bptree_node_t)) : 0;
+        if (mode == 0)
+            DS_HEAP_INIT(heap, store, n, ds_bptree_node_t);
+        else if (mode == 1)
+            DS_HEAP_INIT_LAZY(heap, store, n, ds_bptree_node_t);
+        else
+            DS_HEAP_INIT_GROWABLE(heap, 1024, ds_bptree_node_t);
+        for (size_t i = 0; i < n / 16; i++)
+            ((ds_bptree_node_t *)ds_heap_alloc(&heap))->count = 0;
+        report(names[mode], n / 16, start);
+        ds_heap_destroy(&heap);
+        free(store);
+    }
+}
+
+// Threads allocating and freeing elements in bursts, through a heap behind a
+// mutex or through a heap cache
+typedef struct heap_thread_s heap_thread_t;
+struct heap_thread_s
+{
+    ds_heap_t *heap;
+    pthread_mutex_t *lock;
+    ds_heap_cache_t *cache;
+    size_t n;
+};
+
+#define HEAP_BURST 32
+
+static void *heap_thread_run(void *_thread)
+{
+    heap_thread_t *thread = _thread;
+    void *burst[HEAP_BURST];
+    for (size_t i = 0; i < thread->n; i += HEAP_BURST)
+    {
+        for (int j = 0; j < HEAP_BURST; j++)
+        {
+            if (thread->cache)
+                burst[j] = ds_heap_cache_alloc(thread->cache);
+            else
+            {
+                pthread_mutex_lock(thread->lock);
+                burst[j] = ds_heap_alloc(thread->heap);
+                pthread_mutex_unlock(thread->lock);
+            }
+        }
+        for (int j = 0; j < HEAP_BURST; j++)
+        {
+            if (thread->cache)
+                ds_heap_cache_free(thread->cache, burst[j]);
+            else
+            {
+                pthread_mutex_lock(thread->lock);
+                ds_heap_free(thread->heap, burst[j]);
+                pthread_mutex_unlock(thread->lock);
+            }
+        }
+    }
+    return 0;
+}
+
+static void bench_heap_cache(size_t n)
+{
+    pthread_t threads[16];
+    heap_thread_t args[16];
+    pthread_mutex_t lock;
+    char name[48];
+    double start;
+
+    pthread_mutex_init(&lock, 0);
+    for (int with_cache = 0; with_cache <= 1; with_cache++)
+    {
+        for (int count = 1; count <= 16; count *= 4)
+        {
+            ds_heap_t heap;
+            ds_heap_cache_t cache;
+            DS_HEAP_INIT_GROWABLE(heap, 4096, element_t);
+            if (with_cache)
+                ds_heap_cache_init(&cache, &heap);
+            start = now_ns();
+            for (int i = 0; i < count; i++)
+            {
+                args[i] = (heap_thread_t){&heap, &lock, with_cache ? &cache : 0, n / count};
+                pthread_create(&threads[i], 0, heap_thread_run, &args[i]);
+            }
+            for (int i = 0; i < count; i++)
+                pthread_join(threads[i], 0);
+            snprintf(name, sizeof(name), "heap %s x%d", with_cache ? "cache" : "mutex", count);
+            report(name, 2 * n, start);
+            if (with_cache)
+                ds_heap_cache_destroy(&cache);
+            ds_heap_destroy(&heap);
+        }
+    }
+    pthread_mutex_destroy(&lock);
+}
+
+// Producer threads sending messages to the main thread, through a fifo
+// behind a mutex or through a mpsc fifo
+typedef struct message_s message_t;
+struct message_s
+{
+    ds_fifo_item_t fifo_item;
+    ds_mpsc_item_t mpsc_item;
+};
+
+typedef struct producer_s producer_t;
+struct producer_s
+{
+    ds_fifo_t *fifo;
+    pthread_mutex_t *lock;
+    ds_mpsc_t *mpsc;
+    message_t *messages;
+    size_t n;
+};
+
+static void *producer_run(void *_producer)
+{
+    producer_t *producer = _producer;
+    for (size_t i = 0; i < producer->n; i++)
+    {
+        if (producer->mpsc)
+            ds_mpsc_enq(producer->mpsc, &producer->messages[i]);
+        else
+        {
+            pthread_mutex_lock(producer->lock);
+            ds_fifo_enq(producer->fifo, &producer->messages[i]);
+            pthread_mutex_unlock(producer->lock);
+        }
+    }
+    return 0;
+}
+
+static void bench_mpsc(size_t n)
+{
+    message_t *messages = calloc(n, sizeof(message_t));
+    pthread_t threads[16];
+    producer_t producers[16];
+    pthread_mutex_t lock;
+    ds_fifo_t fifo;
+    ds_mpsc_t mpsc;
+    char name[48];
+    double start;
+
+    pthread_mutex_init(&lock, 0);
+    for (int with_mpsc = 0; with_mpsc <= 1; with_mpsc++)
+    {
+        for (int count = 1; count <= 16; count *= 4)
+        {
+            ds_fifo_init(&fifo, offsetof(message_t, fifo_item));
+            ds_mpsc_init(&mpsc, offsetof(message_t, mpsc_item));
+            start = now_ns();
+            for (int i = 0; i < count; i++)
+            {
+                producers[i] = (producer_t){&fifo, &lock, with_mpsc ? &mpsc : 0, messages + n / count * i, n / count};
+                pthread_create(&threads[i], 0, producer_run, &producers[i]);
+            }
+            for (size_t received = 0; received < n / count * count;)
+            {
+                void *batch[64];
+                if (with_mpsc)
+                    received += ds_mpsc_deq_batch(&mpsc, batch, 64);
+                else
+                {
+                    pthread_mutex_lock(&lock);
+                    while (received < n && ds_fifo_deq(&fifo))
+                        received++;
+                    pthread_mutex_unlock(&lock);
+                }
+            }
+            for (int i = 0; i < count; i++)
+                pthread_join(threads[i], 0);
+            snprintf(name, sizeof(name), "%s x%d", with_mpsc ? "mpsc" : "fifo mutex", count);
+            report(name, n, start);
+        }
+    }
+    pthread_mutex_destroy(&lock);
+    free(messages);
+}
+
+// A producer thread sending pointers to the main thread through a ring, in
+// batches of a given size
+typedef struct ring_producer_s ring_producer_t;
+struct ring_producer_s
+{
+    ds_ring_t *ring;
+    message_t *messages;
+    size_t n;
+    size_t batch;
+};
+
+static void *ring_producer_run(void *_producer)
+{
+    ring_producer_t *producer = _producer;
+    void *batch[64];
+    for (size_t i = 0; i < producer->n;)
+    {
+        size_t count = producer->batch < producer->n - i ? producer->batch : producer->n - i;
+        for (size_t j = 0; j < count; j++)
+            batch[j] = &producer->messages[i + j];
+        size_t sent = 0;
+        while (sent < count)
+        {
+            size_t enqueued = ds_ring_enq_batch(producer->ring, batch + sent, count - sent);
+            if (enqueued == 0)
+                sched_yield();
+            sent += enqueued;
+        }
+        i += count;
+    }
+    return 0;
+}
+
+static void bench_ring(size_t n)
+{
+    message_t *messages = calloc(n, sizeof(message_t));
+    void **store = malloc(1024 * sizeof(void *));
+    ds_ring_t ring;
+    pthread_t thread;
+    char name[48];
+    double start;
+
+    for (size_t batch = 1; batch <= 64; batch *= 8)
+    {
+        ring_producer_t producer = {&ring, messages, n, batch};
+        ds_ring_init(&ring, store, 1024);
+        start = now_ns();
+        pthread_create(&thread, 0, ring_producer_run, &producer);
+        for (size_t received = 0; received < n;)
+        {
+            void *objects[64];
+            size_t dequeued = ds_ring_deq_batch(&ring, objects, batch);
+            if (dequeued == 0)
+                sched_yield();
+            received += dequeued;
+        }
+        pthread_join(thread, 0);
+        snprintf(name, sizeof(name), "ring batch %zu", batch);
+        report(name, n, start);
+    }
+    free(store);
+    free(messages);
+}
+
+// Producers and consumers sharing a fifo behind a mutex or a mpmc fifo
+typedef struct worker_s worker_t;
+struct worker_s
+{
+    ds_fifo_t *fifo;
+    pthread_mutex_t *lock;
+    ds_mpmc_t *mpmc;
+    message_t *messages;
+    size_t n;
+};
+
+static void *worker_produce(void *_worker)
+{
+    worker_t *worker = _worker;
+    for (size_t i = 0; i < worker->n; i++)
+    {
+        if (worker->mpmc)
+            ds_mpmc_enq(worker->mpmc, &worker->messages[i]);
+        else
+        {
+            pthread_mutex_lock(worker->lock);
+            ds_fifo_enq(worker->fifo, &worker->messages[i]);
+            pthread_mutex_unlock(worker->lock);
+        }
+    }
+    return 0;
+}
+
+static void *worker_consume(void *_worker)
+{
+    worker_t *worker = _worker;
+    for (size_t i = 0; i < worker->n; i++)
+    {
+        if (worker->mpmc)
+            ds_mpmc_deq(worker->mpmc);
+        else
+        {
+            void *message;
+            pthread_mutex_lock(worker->lock);
+            while ((message = ds_fifo_deq(worker->fifo)) == 0)
+            {
+                pthread_mutex_unlock(worker->lock);
+                sched_yield();
+                pthread_mutex_lock(worker->lock);
+            }
+            pthread_mutex_unlock(worker->lock);
+        }
+    }
+    return 0;
+}
+
+static void bench_mpmc(size_t n)
+{
+    message_t *messages = calloc(n, sizeof(message_t));
+    ds_mpmc_slot_t *slots = malloc(1024 * sizeof(ds_mpmc_slot_t));
+    pthread_t threads[32];
+    worker_t workers[32];
+    pthread_mutex_t lock;
+    ds_fifo_t fifo;
+    ds_mpmc_t mpmc;
+    char name[48];
+    double start;
+
+    pthread_mutex_init(&lock, 0);
+    for (int with_mpmc = 0; with_mpmc <= 1; with_mpmc++)
+    {
+        for (int count = 2; count <= 32; count *= 4)
+        {
+            size_t per_thread = n / (count / 2);
+            ds_fifo_init(&fifo, offsetof(message_t, fifo_item));
+            ds_mpmc_init(&mpmc, slots, 1024);
+            start = now_ns();
+            for (int i = 0; i < count; i++)
+            {
+                workers[i] = (worker_t){&fifo, &lock, with_mpmc ? &mpmc : 0, messages + per_thread * (i / 2), per_thread};
+                pthread_create(&threads[i], 0, i % 2 ? worker_consume : worker_produce, &workers[i]);
+            }
+            for (int i = 0; i < count; i++)
+                pthread_join(threads[i], 0);
+            snprintf(name, sizeof(name), "%s x%d", with_mpmc ? "mpmc" : "fifo mutex", count);
+            report(name, per_thread * (count / 2), start);
+        }
+    }
+    pthread_mutex_destroy(&lock);
+    free(slots);
+    free(messages);
+}
+
+// Threads popping and pushing back objects of a shared lifo, behind a mutex
+// or lock-free
+typedef struct lifo_thread_s lifo_thread_t;
+struct lifo_thread_s
+{
+    ds_lifo_t *lifo;
+    pthread_mutex_t *lock;
+    ds_lifo_atomic_t *lifo_atomic;
+    size_t n;
+};
+
+static void *lifo_thread_run(void *_thread)
+{
+    lifo_thread_t *thread = _thread;
+    for (size_t i = 0; i < thread->n; i++)
+    {
+        if (thread->lifo_atomic)
+            ds_lifo_atomic_push(thread->lifo_atomic, ds_lifo_atomic_pop(thread->lifo_atomic));
+        else
+        {
+            pthread_mutex_lock(thread->lock);
+            ds_lifo_push(thread->lifo, ds_lifo_pop(thread->lifo));
+            pthread_mutex_unlock(thread->lock);
+        }
+    }
+    return 0;
+}
+
+static void bench_lifo_atomic(size_t n)
+{
+    ds_lifo_item_t items[64];
+    pthread_t threads[16];
+    lifo_thread_t args[16];
+    pthread_mutex_t lock;
+    ds_lifo_t lifo;
+    ds_lifo_atomic_t lifo_atomic;
+    char name[48];
+    double start;
+
+    pthread_mutex_init(&lock, 0);
+    for (int atomic = 0; atomic <= 1; atomic++)
+    {
+        for (int count = 1; count <= 16; count *= 4)
+        {
+            ds_lifo_init(&lifo, 0);
+            ds_lifo_atomic_init(&lifo_atomic, 0);
+            for (int i = 0; i < 64; i++)
+            {
+                ds_lifo_push(&lifo, &items[i]);
+                ds_lifo_atomic_push(&lifo_atomic, &items[i]);
+            }
+            start = now_ns();
+            for (int i = 0; i < count; i++)
+            {
+                args[i] = (lifo_thread_t){&lifo, &lock, atomic ? &lifo_atomic : 0, n / count};
+                pthread_create(&threads[i], 0, lifo_thread_run, &args[i]);
+            }
+            for (int i = 0; i < count; i++)
+                pthread_join(threads[i], 0);
+            snprintf(name, sizeof(name), "lifo %s x%d", atomic ? "atomic" : "mutex", count);
+            report(name, n, start);
+        }
+    }
+    pthread_mutex_destroy(&lock);
+}
+
+typedef struct task_s task_t;
+struct task_s
+{
+    ds_btree_item_t btree_item;
+    ds_pqueue_item_t pqueue_item;
+    uint64_t key;
+};
+
+static int task_cmp(void *_left, void *_right)
+{
+    task_t *left = (task_t *)_left;
+    task_t *right = (task_t *)_right;
+    cmp_calls++;
+    if (left->key != right->key)
+        return left->key < right->key ? -1 : 1;
+    // A btree does not accept equal objects, ties are broken by address
+    return (left > right) - (left < right);
+}
+
+// A Dijkstra-like workload: each step pops the minimum, decreases the keys of
+// two other tasks and reinserts the popped task with a greater key.
+static void bench_pqueue(size_t n)
+{
+    task_t *tasks = calloc(n, sizeof(task_t));
+    ds_pqueue_t pqueue;
+    ds_btree_t btree;
+    ds_btree_cursor_t cursor;
+    double start;
+
+    for (int use_btree = 0; use_btree <= 1; use_btree++)
+    {
+        srandom(1);
+        ds_pqueue_init(&pqueue, offsetof(task_t, pqueue_item), task_cmp);
+        ds_btree_init(&btree, offsetof(task_t, btree_item), task_cmp);
+        for (size_t i = 0; i < n; i++)
+        {
+            tasks[i].key = rand64() >> 1;
+            if (use_btree)
+                ds_btree_insert(&btree, &tasks[i]);
+            else
+                ds_pqueue_insert(&pqueue, &tasks[i]);
+        }
+        cmp_calls = 0;
+        start = now_ns();
+        for (size_t i = 0; i < n; i++)
+        {
+            task_t *task = use_btree ? ds_btree_cursor_first(&cursor, &btree) : ds_pqueue_pop_min(&pqueue);
+            uint64_t min = task->key;
+            if (use_btree)
+                ds_btree_cursor_remove(&cursor);
+            for (int j = 0; j < 2; j++)
+            {
+                task_t *other = &tasks[random() % n];
+                if (other == task || other->key <= min)
+                    continue;
+                if (use_btree)
+                {
+                    ds_btree_remove_object(&btree, other);
+                    other->key = min + (other->key - min) / 2;
+                    ds_btree_insert(&btree, other);
+                }
+                else
+                {
+                    other->key = min + (other->key - min) / 2;
+                    ds_pqueue_decrease_key(&pqueue, other);
+                }
+            }
+            task->key = min + (rand64() >> 2);
+            if (use_btree)
+                ds_btree_insert(&btree, task);
+            else
+                ds_pqueue_insert(&pqueue, task);
+        }
+        report(use_btree ? "btree as pqueue" : "pqueue", n, start);
+    }
+    free(tasks);
+}
+
+typedef struct connection_s connection_t;
+struct connection_s
+{
+    ds_timer_item_t timer_item;
+    ds_btree_item_t btree_item;
+    uint64_t expires;
+};
+
+static int connection_cmp(void *_left, void *_right)
+{
+    connection_t *left = (connection_t *)_left;
+    connection_t *right = (connection_t *)_right;
+    cmp_calls++;
+    if (left->expires != right->expires)
+        return left->expires < right->expires ? -1 : 1;
+    return (left > right) - (left < right);
+}
+
+// Connection timeouts: n connections with a timeout of up to 30000 ticks. Each
+// operation is some traffic on a random connection, which restarts its
+// timeout. Every 16 operations the clock advances by one tick and the expired
+// connections are scheduled again. Most timeouts are cancelled before they
+// fire.
+static void bench_timer(size_t n)
+{
+    connection_t *connections = calloc(n, sizeof(connection_t));
+    ds_timer_t *timer = malloc(sizeof(ds_timer_t));
+    ds_btree_t btree;
+    ds_btree_cursor_t cursor;
+    ds_dlist_t expired;
+    size_t fired;
+    double start;
+
+    for (int use_btree = 0; use_btree <= 1; use_btree++)
+    {
+        uint64_t now = 0;
+        srandom(1);
+        memset(connections, 0, n * sizeof(connection_t));
+        ds_timer_init(timer, offsetof(connection_t, timer_item), now);
+        ds_btree_init(&btree, offsetof(connection_t, btree_item), connection_cmp);
+        ds_dlist_init(&expired, offsetof(connection_t, timer_item));
+        for (size_t i = 0; i < n; i++)
+        {
+            connections[i].expires = now + 1 + random() % 30000;
+            if (use_btree)
+                ds_btree_insert(&btree, &connections[i]);
+            else
+                ds_timer_schedule(timer, &connections[i], connections[i].expires);
+        }
+        fired = 0;
+        start = now_ns();
+        for (size_t i = 0; i < n; i++)
+        {
+            connection_t *connection = &connections[random() % n];
+            if (use_btree)
+            {
+                ds_btree_remove_object(&btree, connection);
+                connection->expires = now + 1 + random() % 30000;
+                ds_btree_insert(&btree, connection);
+            }
+            else
+                ds_timer_schedule(timer, connection, now + 1 + random() % 30000);
+            if (i % 16)
+                continue;
+            now++;
+            if (use_btree)
+            {
+                while ((connection = ds_btree_cursor_first(&cursor, &btree)) && connection->expires <= now)
+                {
+                    ds_btree_cursor_remove(&cursor);
+                    connection->expires = now + 1 + random() % 30000;
+                    ds_btree_insert(&btree, connection);
+                    fired++;
+                }
+            }
+            else
+            {
+                fired += ds_timer_advance(timer, now, &expired);
+                while (expired.root)
+                {
+                    connection = ds_dlist_remove_item(&expired, expired.root);
+                    ds_timer_schedule(timer, connection, now + 1 + random() % 30000);
+                }
+            }
+        }
+        report(use_btree ? "btree as timer" : "timer wheel", n, start);
+        printf("# %zu timers fired\n", fired);
+    }
+    free(timer);
+    free(connections);
+}
+
+typedef struct session_s session_t;
+struct session_s
+{
+    ds_htable_item_t htable_item;
+    ds_btree_item_t btree_item;
+    uint64_t key;
+};
+
+static uint64_t session_hash(void *_session)
+{
+    return ((session_t *)_session)->key * 0x9e3779b97f4a7c15ULL >> 20;
+}
+
+static int session_eq(void *_left, void *_right)
+{
+    cmp_calls++;
+    return ((session_t *)_left)->key == ((session_t *)_right)->key;
+}
+
+static int session_cmp(void *_left, void *_right)
+{
+    session_t *left = (session_t *)_left;
+    session_t *right = (session_t *)_right;
+    cmp_calls++;
+    return (left->key > right->key) - (left->key < right->key);
+}
+
+// Exact match lookups of random keys, in a hash table grown from empty and in
+// a btree. The slowest insertion shows the cost of the incremental growth.
+static void bench_htable(size_t n)
+{
+    session_t *sessions = calloc(n, sizeof(session_t));
+    ds_htable_t htable;
+    ds_btree_t btree;
+    double start, max = 0;
+
+    for (size_t i = 0; i < n; i++)
+        sessions[i].key = rand64();
+    ds_htable_init(&htable, offsetof(session_t, htable_item), session_hash, session_eq, 0);
+    ds_btree_init(&btree, offsetof(session_t, btree_item), session_cmp);
+    cmp_calls = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        double insert_start = now_ns();
+        ds_htable_insert(&htable, &sessions[i]);
+        if (now_ns() - insert_start > max)
+            max = now_ns() - insert_start;
+    }
+    report("htable insert", n, start);
+    printf("# slowest htable insert %.0f ns, %zu buckets\n", max, htable._mask + 1);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_htable_find(&htable, &sessions[random() % n]);
+    report("htable find", n, start);
+
+    for (size_t i = 0; i < n; i++)
+        ds_btree_insert(&btree, &sessions[i]);
+    cmp_calls = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_btree_find(&btree, &sessions[random() % n]);
+    report("btree find", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_htable_remove(&htable, &sessions[i]);
+    report("htable remove", n, start);
+    ds_htable_destroy(&htable);
+    free(sessions);
+}
+
+// Dedup lookups of object pointers with no embedded item: a flat hash map
+// against an ext btree, with the memory each one uses per entry
+static void bench_hmap(size_t n)
+{
+    session_t *sessions = calloc(n, sizeof(session_t));
+    session_t *misses = calloc(n, sizeof(session_t));
+    ds_btree_ext_item_t *items = calloc(n, sizeof(ds_btree_ext_item_t));
+    ds_hmap_t hmap;
+    ds_btree_ext_t btree;
+    double start;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        sessions[i].key = rand64();
+        misses[i].key = rand64();
+    }
+    ds_hmap_init(&hmap, session_hash, session_eq, 0);
+    cmp_calls = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_hmap_insert(&hmap, &sessions[i]);
+    report("hmap insert", n, start);
+    printf("# hmap %.1f bytes/entry, ext btree %zu bytes/entry\n",
+           (double)(hmap._group_mask + 1) * DS_HMAP_GROUP_SIZE * (sizeof(void *) + 1) / n, sizeof(ds_btree_ext_item_t));
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_hmap_find(&hmap, &sessions[random() % n]);
+    report("hmap find", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_hmap_find(&hmap, &misses[i]);
+    report("hmap find miss", n, start);
+
+    ds_btree_ext_init(&btree, session_cmp);
+    for (size_t i = 0; i < n; i++)
+        ds_btree_ext_insert(&btree, &items[i], &sessions[i]);
+    cmp_calls = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_btree_ext_find(&btree, &sessions[random() % n]);
+    report("ext btree find", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_hmap_remove(&hmap, &sessions[i]);
+    report("hmap remove", n, start);
+    ds_hmap_destroy(&hmap);
+    free(items);
+    free(misses);
+    free(sessions);
+}
+
+typedef struct page_s page_t;
+struct page_s
+{
+    ds_cache_item_t cache_item;
+    ds_btree_item_t btree_item;
+    ds_dlist_item_t dlist_item;
+    uint64_t key;
+};
+
+static uint64_t page_hash(void *_page)
+{
+    return ((page_t *)_page)->key * 0x9e3779b97f4a7c15ULL;
+}
+
+static int page_eq(void *_left, void *_right)
+{
+    return ((page_t *)_left)->key == ((page_t *)_right)->key;
+}
+
+static int page_cmp(void *_left, void *_right)
+{
+    page_t *left = (page_t *)_left;
+    page_t *right = (page_t *)_right;
+    cmp_calls++;
+    return (left->key > right->key) - (left->key < right->key);
+}
+
+// Skewed accesses: the square of a uniform draw favors the low keys
+static uint64_t page_key(size_t pages)
+{
+    double draw = (double)random() / RAND_MAX;
+    return (uint64_t)(draw * draw * (pages - 1));
+}
+
+typedef struct cache_thread_s cache_thread_t;
+struct cache_thread_s
+{
+    ds_cache_sharded_t *sharded;
+    page_t *pages;
+    size_t page_count;
+    size_t n;
+    size_t hits;
+};
+
+static void *cache_thread_run(void *_thread)
+{
+    cache_thread_t *thread = _thread;
+    for (size_t i = 0; i < thread->n; i++)
+    {
+        page_t *page = &thread->pages[page_key(thread->page_count)];
+        if (ds_cache_sharded_find(thread->sharded, page))
+            thread->hits++;
+        else
+            ds_cache_sharded_insert(thread->sharded, page, 1);
+    }
+    return 0;
+}
+
+// A cache of a tenth of the pages: the usual ds_dlist plus ds_btree LRU
+// against ds_cache, then a sharded ds_cache shared by threads
+static void bench_cache(size_t n)
+{
+    size_t page_count = n;
+    size_t capacity = n / 10;
+    page_t *pages = calloc(page_count, sizeof(page_t));
+    ds_cache_t cache;
+    ds_btree_t btree;
+    ds_dlist_t dlist;
+    size_t hits;
+    char name[48];
+    double start;
+
+    for (size_t i = 0; i < page_count; i++)
+        pages[i].key = i;
+
+    ds_btree_init(&btree, offsetof(page_t, btree_item), page_cmp);
+    ds_dlist_init(&dlist, offsetof(page_t, dlist_item));
+    srandom(1);
+    hits = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        page_t key = {.key = page_key(page_count)};
+        page_t *page = ds_btree_find(&btree, &key);
+        if (page)
+        {
+            hits++;
+            ds_dlist_remove(&dlist, page);
+            ds_dlist_push(&dlist, page);
+            continue;
+        }
+        page = &pages[key.key];
+        ds_btree_insert(&btree, page);
+        ds_dlist_push(&dlist, page);
+        if (dlist.count > capacity)
+        {
+            page_t *last = ds_dlist_remove_item(&dlist, dlist.last);
+            ds_btree_remove_object(&btree, last);
+        }
+    }
+    report("dlist+btree lru", n, start);
+    printf("# %.1f%% hits\n", 100.0 * hits / n);
+
+    for (int mode = DS_CACHE_LRU; mode <= DS_CACHE_CLOCK; mode++)
+    {
+        ds_cache_init(&cache, offsetof(page_t, cache_item), page_hash, page_eq, capacity, 0, mode, 0);
+        srandom(1);
+        hits = 0;
+        start = now_ns();
+        for (size_t i = 0; i < n; i++)
+        {
+            page_t key = {.key = page_key(page_count)};
+            if (ds_cache_find(&cache, &key))
+                hits++;
+            else
+                ds_cache_insert(&cache, &pages[key.key], 1);
+        }
+        report(mode == DS_CACHE_LRU ? "cache lru" : "cache clock", n, start);
+        printf("# %.1f%% hits\n", 100.0 * hits / n);
+        ds_cache_destroy(&cache);
+    }
+
+    for (int mode = DS_CACHE_LRU; mode <= DS_CACHE_CLOCK; mode++)
+    {
+        for (size_t shards = 1; shards <= 16; shards *= 16)
+        {
+            ds_cache_sharded_t sharded;
+            pthread_t threads[4];
+            cache_thread_t args[4];
+            ds_cache_sharded_init(&sharded, shards, offsetof(page_t, cache_item), page_hash, page_eq, capacity, 0, mode, 0);
+            start = now_ns();
+            for (int i = 0; i < 4; i++)
+            {
+                args[i] = (cache_thread_t){&sharded, pages, page_count, n / 4, 0};
+                pthread_create(&threads[i], 0, cache_thread_run, &args[i]);
+            }
+            for (int i = 0; i < 4; i++)
+                pthread_join(threads[i], 0);
+            snprintf(name, sizeof(name), "cache %s %zu shards x4", mode == DS_CACHE_LRU ? "lru" : "clock", shards);
+            report(name, n, start);
+            ds_cache_sharded_destroy(&sharded);
+        }
+    }
+    free(pages);
+}
+
+// Hand batches of 64 messages from one pipeline stage to the next, one by one
+// or with a single concat
+static void bench_concat(size_t n)
+{
+    size_t count = 1024;
+    message_t *messages = calloc(count, sizeof(message_t));
+    ds_fifo_t stage, next, batch;
+    double start;
+
+    for (int concat = 0; concat <= 1; concat++)
+    {
+        ds_fifo_init(&stage, offsetof(message_t, fifo_item));
+        ds_fifo_init(&next, offsetof(message_t, fifo_item));
+        ds_fifo_init(&batch, offsetof(message_t, fifo_item));
+        for (size_t i = 0; i < count; i++)
+            ds_fifo_enq(&stage, &messages[i]);
+        start = now_ns();
+        for (size_t i = 0; i < n; i += 64)
+        {
+            for (int j = 0; j < 64; j++)
+                ds_fifo_enq(&batch, ds_fifo_deq(&stage));
+            if (concat)
+                ds_fifo_concat(&next, &batch);
+            else
+                while (batch.root)
+                    ds_fifo_enq(&next, ds_fifo_deq(&batch));
+            if (next.count == count)
+            {
+                ds_fifo_t swap = stage;
+                stage = next;
+                next = swap;
+            }
+        }
+        report(concat ? "fifo handoff concat" : "fifo handoff by item", n, start);
+    }
+    free(messages);
+}
+
+typedef struct record_s record_t;
+struct record_s
+{
+    ds_fifo_item_t fifo_item;
+    ds_btree_item_t btree_item;
+    uint64_t key;
+};
+
+static int record_cmp(void *_left, void *_right)
+{
+    record_t *left = (record_t *)_left;
+    record_t *right = (record_t *)_right;
+    cmp_calls++;
+    return (left->key > right->key) - (left->key < right->key);
+}
+
+static int record_qsort_cmp(const void *left, const void *right)
+{
+    return record_cmp(*(void **)left, *(void **)right);
+}
+
+// Sort a fifo of random records: through a btree, through an array and
+// qsort, by the merge sort of the links and by the radix sort
+static void bench_sort(size_t n)
+{
+    record_t *records = calloc(n, sizeof(record_t));
+    void **objects = calloc(n, sizeof(void *));
+    ds_fifo_t fifo;
+    ds_btree_t btree;
+    ds_btree_cursor_t cursor;
+    double start;
+
+    for (size_t i = 0; i < n; i++)
+        records[i].key = rand64();
+    for (int method = 0; method < 4; method++)
+    {
+        ds_fifo_init(&fifo, offsetof(record_t, fifo_item));
+        for (size_t i = 0; i < n; i++)
+            ds_fifo_enq(&fifo, &records[i]);
+        cmp_calls = 0;
+        start = now_ns();
+        switch (method)
+        {
+        case 0:
+            ds_btree_init(&btree, offsetof(record_t, btree_item), record_cmp);
+            for (record_t *record; (record = ds_fifo_deq(&fifo));)
+                ds_btree_insert(&btree, record);
+            for (void *record = ds_btree_cursor_first(&cursor, &btree); record; record = ds_btree_cursor_next(&cursor))
+                ds_fifo_enq(&fifo, record);
+            break;
+        case 1:
+            ds_fifo_deq_batch(&fifo, objects, n);
+            qsort(objects, n, sizeof(void *), record_qsort_cmp);
+            for (size_t i = 0; i < n; i++)
+                ds_fifo_enq(&fifo, objects[i]);
+            break;
+        case 2:
+            ds_fifo_sort(&fifo, record_cmp);
+            break;
+        default:
+            ds_fifo_radix_sort(&fifo, offsetof(record_t, key));
+            break;
+        }
+        report((char *[]){"sort by btree", "sort by qsort", "fifo merge sort", "fifo radix sort"}[method], n, start);
+    }
+    free(objects);
+    free(records);
+}
+
+// Enqueue, scan and dequeue objects in random order with a fifo of ext items,
+// each item belonging to its object, then with an unrolled fifo
+static void bench_unrolled(size_t n)
+{
+    record_t *records = calloc(n, sizeof(record_t));
+    ds_fifo_ext_item_t *items = calloc(n, sizeof(ds_fifo_ext_item_t));
+    size_t *order = calloc(n, sizeof(size_t));
+    ds_fifo_ext_t fifo_ext;
+    ds_fifo_unrolled_t fifo;
+    ds_heap_t chunk_heap;
+    ds_chunk_iter_t iter;
+    uint64_t sum = 0;
+    double start;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        records[i].key = i;
+        order[i] = i;
+    }
+    for (size_t i = n - 1; i > 0; i--)
+    {
+        size_t j = random() % (i + 1);
+        size_t swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    ds_fifo_ext_init(&fifo_ext);
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_fifo_ext_enq(&fifo_ext, &items[order[i]], &records[order[i]]);
+    report("fifo ext enq", n, start);
+    start = now_ns();
+    for (ds_fifo_ext_item_t *item = fifo_ext.root; item; item = item->next)
+        sum += (uintptr_t)item->object;
+    report("fifo ext scan", n, start);
+    start = now_ns();
+    while (ds_fifo_ext_deq(&fifo_ext))
+        ;
+    report("fifo ext deq", n, start);
+
+    DS_HEAP_INIT_GROWABLE(chunk_heap, 1024, ds_chunk_t);
+    ds_fifo_unrolled_init(&fifo, &chunk_heap);
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_fifo_unrolled_enq(&fifo, &records[order[i]]);
+    report("fifo unrolled enq", n, start);
+    start = now_ns();
+    for (void *object = ds_fifo_unrolled_first(&fifo, &iter); object; object = ds_fifo_unrolled_next(&iter))
+        sum -= (uintptr_t)object;
+    report("fifo unrolled scan", n, start);
+    printf("%-24s %10.1f bytes/object (ext %zu)\n", "fifo unrolled chunks",
+           (double)chunk_heap.slab_count * (DS_HEAP_SLAB_HEADER_SIZE + 1024 * sizeof(ds_chunk_t)) / n, sizeof(ds_fifo_ext_item_t));
+    start = now_ns();
+    while (ds_fifo_unrolled_deq(&fifo))
+        ;
+    report("fifo unrolled deq", n, start);
+    if (sum)
+        printf("Scan mismatch\n");
+
+    ds_heap_destroy(&chunk_heap);
+    free(order);
+    free(items);
+    free(records);
+}
+
+static uint64_t element_prefix(void *_element)
+{
+    return ((element_t *)_element)->key;
+}
+
+static void bench_bptree(element_t *elements, size_t n, int with_prefix)
+{
+    size_t node_max = n / DS_BPTREE_ORDER_MIN * 9 / 8 + 64;
+    ds_bptree_node_t *nodes = calloc(node_max, sizeof(ds_bptree_node_t));
+    ds_heap_t node_heap;
+    DS_HEAP_INIT(node_heap, nodes, node_max, ds_bptree_node_t);
+    ds_bptree_t bptree;
+    ds_bptree_init(&bptree, &node_heap, element_cmp, with_prefix ? element_prefix : 0);
+    double start;
+
+    cmp_calls = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_bptree_insert(&bptree, &elements[i]);
+    report(with_prefix ? "bptree+prefix insert" : "bptree insert", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_bptree_find(&bptree, &elements[i]);
+    report(with_prefix ? "bptree+prefix find" : "bptree find", n, start);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        ds_bptree_remove(&bptree, &elements[i]);
+    report(with_prefix ? "bptree+prefix remove" : "bptree remove", n, start);
+
+    free(nodes);
+}
+
+static void bench_all(element_t *elements, size_t n, const char *stream)
+{
+    bench_btree(elements, n, stream);
+    bench_btree_define(elements, n);
+    bench_btree_u64(elements, n);
+    bench_bptree(elements, n, 0);
+    bench_bptree(elements, n, 1);
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoul(argv[1], 0, 0) : BENCH_COUNT_DEFAULT;
+    element_t *elements = calloc(n, sizeof(element_t));
+
+    printf("# %zu elements\n", n);
+    for (size_t i = 0; i < n; i++)
+        elements[i].key = rand64();
+    bench_all(elements, n, "random");
+    for (size_t i = 0; i < n; i++)
+        elements[i].key = i;
+    bench_all(elements, n, "sequential");
+    bench_btree_build(elements, n);
+    for (size_t i = 0; i < n; i++)
+        elements[i].key = rand64();
+    bench_btree_union(elements, n, n / 2);
+    bench_btree_union(elements, n, n / 1000);
+    bench_btree_bulk(elements, n);
+    bench_heap(n);
+    bench_heap_cache(n);
+    bench_mpsc(n);
+    bench_ring(n);
+    bench_mpmc(n);
+    bench_lifo_atomic(n);
+    bench_pqueue(n);
+    bench_timer(n);
+    bench_htable(n);
+    bench_hmap(n);
+    bench_cache(n);
+    bench_concat(n);
+    bench_sort(n);
+    bench_unrolled(n);
+
+    free(elements);
+}
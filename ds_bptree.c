@@ -0,0 +1,526 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "ds_bptree.h"
+
+static inline uint64_t ds_bptree_prefix_of(ds_bptree_t *bptree, void *object)
+{
+    return bptree->prefix ? bptree->prefix(object) : 0;
+}
+
+// Compare a key to the object i of a node. The comparison function is only
+// called when the prefixes are equal.
+static inline int ds_bptree_cmp_slot(ds_bptree_t *bptree, void *key, uint64_t prefix, ds_bptree_node_t *node, int i)
+{
+    if (prefix != node->prefix[i])
+        return prefix < node->prefix[i] ? -1 : 1;
+    return bptree->cmp(key, node->object[i]);
+}
+
+// Binary search of a key in a node. It returns the index of the smallest
+// object greater than or equal to key and sets `equal` if this object is equal
+// to key.
+static inline int ds_bptree_node_search(ds_bptree_t *bptree, ds_bptree_node_t *node, void *key, uint64_t prefix, int *equal)
+{
+    int low = 0;
+    int high = node->count;
+    *equal = 0;
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        int cmp = ds_bptree_cmp_slot(bptree, key, prefix, node, mid);
+        if (cmp == 0)
+        {
+            *equal = 1;
+            return mid;
+        }
+        if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return low;
+}
+
+// Index of the child of an inner node where key is to be found
+static inline int ds_bptree_child_index(ds_bptree_t *bptree, ds_bptree_node_t *node, void *key, uint64_t prefix)
+{
+    int equal;
+    int i = ds_bptree_node_search(bptree, node, key, prefix, &equal);
+    return equal ? i + 1 : i;
+}
+
+// Move n objects and their prefixes inside or between nodes
+static inline void ds_bptree_slots_move(ds_bptree_node_t *dst, int dst_index, ds_bptree_node_t *src, int src_index, int n)
+{
+    memmove(&dst->prefix[dst_index], &src->prefix[src_index], n * sizeof(uint64_t));
+    memmove(&dst->object[dst_index], &src->object[src_index], n * sizeof(void *));
+}
+
+// Move n children inside or between inner nodes
+static inline void ds_bptree_children_move(ds_bptree_node_t *dst, int dst_index, ds_bptree_node_t *src, int src_index, int n)
+{
+    memmove(&dst->child[dst_index], &src->child[src_index], n * sizeof(ds_bptree_node_t *));
+}
+
+static inline void ds_bptree_slot_set(ds_bptree_node_t *node, int i, void *object, uint64_t prefix)
+{
+    node->object[i] = object;
+    node->prefix[i] = prefix;
+}
+
+static inline void ds_bptree_slot_copy(ds_bptree_node_t *dst, int dst_index, ds_bptree_node_t *src, int src_index)
+{
+    ds_bptree_slot_set(dst, dst_index, src->object[src_index], src->prefix[src_index]);
+}
+
+// Leftmost leaf of a subtree
+static inline ds_bptree_node_t *ds_bptree_leftmost(ds_bptree_node_t *node)
+{
+    while (!node->leaf)
+        node = node->child[0];
+    return node;
+}
+
+void ds_bptree_init(ds_bptree_t *bptree, ds_heap_t *node_heap, bs_btree_cmp_f cmp, ds_bptree_prefix_f prefix)
+{
+    bptree->count = 0;
+    bptree->root = 0;
+    bptree->first = 0;
+    bptree->last = 0;
+    bptree->height = 0;
+    bptree->cmp = cmp;
+    bptree->prefix = prefix;
+    bptree->node_heap = node_heap;
+}
+
+// Split a full leaf while inserting an object at index i. The upper half goes
+// to the `right` leaf.
+static void ds_bptree_leaf_split(ds_bptree_t *bptree, ds_bptree_node_t *leaf, ds_bptree_node_t *right, int i, void *object, uint64_t prefix)
+{
+    int left_count = (DS_BPTREE_ORDER + 1) / 2;
+
+    right->leaf = 1;
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next)
+        leaf->next->prev = right;
+    else
+        bptree->last = right;
+    leaf->next = right;
+
+    if (i < left_count)
+    {
+        // The new object goes to the left leaf
+        right->count = DS_BPTREE_ORDER - (left_count - 1);
+        ds_bptree_slots_move(right, 0, leaf, left_count - 1, right->count);
+        ds_bptree_slots_move(leaf, i + 1, leaf, i, left_count - 1 - i);
+        ds_bptree_slot_set(leaf, i, object, prefix);
+    }
+    else
+    {
+        // The new object goes to the right leaf
+        right->count = DS_BPTREE_ORDER + 1 - left_count;
+        int before = i - left_count;
+        ds_bptree_slots_move(right, 0, leaf, left_count, before);
+        ds_bptree_slot_set(right, before, object, prefix);
+        ds_bptree_slots_move(right, before + 1, leaf, i, DS_BPTREE_ORDER - i);
+    }
+    leaf->count = left_count;
+}
+
+// Split a full inner node while inserting the separator (object, prefix) at
+// index i with its right child. The upper half goes to the `right` node and
+// the middle separator is returned through (object, prefix) to be inserted in
+// the father.
+static void ds_bptree_inner_split(ds_bptree_node_t *node, ds_bptree_node_t *right, int i, void **object, uint64_t *prefix, ds_bptree_node_t *child)
+{
+    void *objects[DS_BPTREE_ORDER + 1];
+    uint64_t prefixes[DS_BPTREE_ORDER + 1];
+    ds_bptree_node_t *children[DS_BPTREE_ORDER + 2];
+    int left_count = DS_BPTREE_ORDER / 2;
+
+    // Gather all separators and children in order
+    memcpy(objects, node->object, i * sizeof(void *));
+    memcpy(prefixes, node->prefix, i * sizeof(uint64_t));
+    objects[i] = *object;
+    prefixes[i] = *prefix;
+    memcpy(&objects[i + 1], &node->object[i], (DS_BPTREE_ORDER - i) * sizeof(void *));
+    memcpy(&prefixes[i + 1], &node->prefix[i], (DS_BPTREE_ORDER - i) * sizeof(uint64_t));
+    memcpy(children, node->child, (i + 1) * sizeof(ds_bptree_node_t *));
+    children[i + 1] = child;
+    memcpy(&children[i + 2], &node->child[i + 1], (DS_BPTREE_ORDER - i) * sizeof(ds_bptree_node_t *));
+
+    // Distribute them
+    node->count = left_count;
+    memcpy(node->object, objects, left_count * sizeof(void *));
+    memcpy(node->prefix, prefixes, left_count * sizeof(uint64_t));
+    memcpy(node->child, children, (left_count + 1) * sizeof(ds_bptree_node_t *));
+
+    right->leaf = 0;
+    right->count = DS_BPTREE_ORDER - left_count;
+    memcpy(right->object, &objects[left_count + 1], right->count * sizeof(void *));
+    memcpy(right->prefix, &prefixes[left_count + 1], right->count * sizeof(uint64_t));
+    memcpy(right->child, &children[left_count + 1], (right->count + 1) * sizeof(ds_bptree_node_t *));
+
+    *object = objects[left_count];
+    *prefix = prefixes[left_count];
+}
+
+void *ds_bptree_insert(ds_bptree_t *bptree, void *object)
+{
+    ds_bptree_node_t *path[DS_BPTREE_HEIGHT_MAX];
+    int index[DS_BPTREE_HEIGHT_MAX];
+    int depth = 0;
+    uint64_t prefix = ds_bptree_prefix_of(bptree, object);
+
+    if (!bptree->root)
+    {
+        ds_bptree_node_t *root = ds_heap_alloc(bptree->node_heap);
+        if (!root)
+            return 0;
+        root->leaf = 1;
+        root->count = 0;
+        root->prev = 0;
+        root->next = 0;
+        bptree->root = root;
+        bptree->first = root;
+        bptree->last = root;
+        bptree->height = 1;
+    }
+
+    // 1. Descend to the leaf, keeping the path
+    ds_bptree_node_t *node = bptree->root;
+    while (!node->leaf)
+    {
+        int i = ds_bptree_child_index(bptree, node, object, prefix);
+        path[depth] = node;
+        index[depth++] = i;
+        node = node->child[i];
+    }
+    int equal;
+    int i = ds_bptree_node_search(bptree, node, object, prefix, &equal);
+    // Equal keys not allowed
+    if (equal)
+        return node->object[i];
+
+    // 2. Simple case: the leaf is not full
+    if (node->count < DS_BPTREE_ORDER)
+    {
+        ds_bptree_slots_move(node, i + 1, node, i, node->count - i);
+        ds_bptree_slot_set(node, i, object, prefix);
+        node->count++;
+        bptree->count++;
+        return object;
+    }
+
+    // 3. Reserve all the nodes needed by the splits, so that the bptree is
+    // left unchanged if the heap is exhausted
+    ds_bptree_node_t *spare[DS_BPTREE_HEIGHT_MAX + 1];
+    int needed = 1;
+    int d = depth - 1;
+    while (d >= 0 && path[d]->count == DS_BPTREE_ORDER)
+    {
+        needed++;
+        d--;
+    }
+    if (d < 0)
+        needed++;
+    for (int k = 0; k < needed; k++)
+    {
+        spare[k] = ds_heap_alloc(bptree->node_heap);
+        if (!spare[k])
+        {
+            while (k-- > 0)
+                ds_heap_free(bptree->node_heap, spare[k]);
+            return 0;
+        }
+    }
+
+    // 4. Split the leaf and propagate the separators up
+    ds_bptree_node_t *right = spare[--needed];
+    ds_bptree_leaf_split(bptree, node, right, i, object, prefix);
+    void *separator = right->object[0];
+    uint64_t separator_prefix = right->prefix[0];
+    while (depth-- > 0)
+    {
+        node = path[depth];
+        i = index[depth];
+        if (node->count < DS_BPTREE_ORDER)
+        {
+            ds_bptree_slots_move(node, i + 1, node, i, node->count - i);
+            ds_bptree_children_move(node, i + 2, node, i + 1, node->count - i);
+            ds_bptree_slot_set(node, i, separator, separator_prefix);
+            node->child[i + 1] = right;
+            node->count++;
+            right = 0;
+            break;
+        }
+        ds_bptree_node_t *child = right;
+        right = spare[--needed];
+        ds_bptree_inner_split(node, right, i, &separator, &separator_prefix, child);
+    }
+
+    // 5. The root was split: grow the bptree
+    if (right)
+    {
+        ds_bptree_node_t *root = spare[--needed];
+        root->leaf = 0;
+        root->count = 1;
+        ds_bptree_slot_set(root, 0, separator, separator_prefix);
+        root->child[0] = bptree->root;
+        root->child[1] = right;
+        bptree->root = root;
+        bptree->height++;
+    }
+
+    bptree->count++;
+    return object;
+}
+
+// Remove the separator i and the child i + 1 of an inner node
+static inline void ds_bptree_inner_remove_at(ds_bptree_node_t *node, int i)
+{
+    ds_bptree_slots_move(node, i, node, i + 1, node->count - i - 1);
+    ds_bptree_children_move(node, i + 1, node, i + 2, node->count - i - 1);
+    node->count--;
+}
+
+// Fix an underflowing leaf, child i of father, by borrowing an object from a
+// sibling or by merging with a sibling. It returns 1 if a merge removed a
+// separator from father.
+static int ds_bptree_leaf_rebalance(ds_bptree_t *bptree, ds_bptree_node_t *father, int i)
+{
+    ds_bptree_node_t *node = father->child[i];
+    ds_bptree_node_t *left = i > 0 ? father->child[i - 1] : 0;
+    ds_bptree_node_t *right = i < father->count ? father->child[i + 1] : 0;
+
+    if (left && left->count > DS_BPTREE_ORDER_MIN)
+    {
+        ds_bptree_slots_move(node, 1, node, 0, node->count);
+        ds_bptree_slot_copy(node, 0, left, left->count - 1);
+        node->count++;
+        left->count--;
+        ds_bptree_slot_copy(father, i - 1, node, 0);
+        return 0;
+    }
+    if (right && right->count > DS_BPTREE_ORDER_MIN)
+    {
+        ds_bptree_slot_copy(node, node->count, right, 0);
+        node->count++;
+        ds_bptree_slots_move(right, 0, right, 1, right->count - 1);
+        right->count--;
+        ds_bptree_slot_copy(father, i, right, 0);
+        return 0;
+    }
+
+    // Merge the right one of the two leaves into the left one
+    if (left)
+    {
+        right = node;
+        node = left;
+        i--;
+    }
+    ds_bptree_slots_move(node, node->count, right, 0, right->count);
+    node->count += right->count;
+    node->next = right->next;
+    if (right->next)
+        right->next->prev = node;
+    else
+        bptree->last = node;
+    ds_bptree_inner_remove_at(father, i);
+    ds_heap_free(bptree->node_heap, right);
+    return 1;
+}
+
+// Fix an underflowing inner node, child i of father, by rotating a separator
+// through the father or by merging with a sibling. It returns 1 if a merge
+// removed a separator from father.
+static int ds_bptree_inner_rebalance(ds_bptree_t *bptree, ds_bptree_node_t *father, int i)
+{
+    ds_bptree_node_t *node = father->child[i];
+    ds_bptree_node_t *left = i > 0 ? father->child[i - 1] : 0;
+    ds_bptree_node_t *right = i < father->count ? father->child[i + 1] : 0;
+
+    if (left && left->count > DS_BPTREE_ORDER_MIN)
+    {
+        ds_bptree_slots_move(node, 1, node, 0, node->count);
+        ds_bptree_children_move(node, 1, node, 0, node->count + 1);
+        ds_bptree_slot_copy(node, 0, father, i - 1);
+        node->child[0] = left->child[left->count];
+        node->count++;
+        ds_bptree_slot_copy(father, i - 1, left, left->count - 1);
+        left->count--;
+        return 0;
+    }
+    if (right && right->count > DS_BPTREE_ORDER_MIN)
+    {
+        ds_bptree_slot_copy(node, node->count, father, i);
+        node->child[node->count + 1] = right->child[0];
+        node->count++;
+        ds_bptree_slot_copy(father, i, right, 0);
+        ds_bptree_slots_move(right, 0, right, 1, right->count - 1);
+        ds_bptree_children_move(right, 0, right, 1, right->count);
+        right->count--;
+        return 0;
+    }
+
+    // Merge the right one of the two nodes and their separator into the left
+    // one
+    if (left)
+    {
+        right = node;
+        node = left;
+        i--;
+    }
+    ds_bptree_slot_copy(node, node->count, father, i);
+    ds_bptree_slots_move(node, node->count + 1, right, 0, right->count);
+    ds_bptree_children_move(node, node->count + 1, right, 0, right->count + 1);
+    node->count += 1 + right->count;
+    ds_bptree_inner_remove_at(father, i);
+    ds_heap_free(bptree->node_heap, right);
+    return 1;
+}
+
+// Replace the separator equal to a removed object by the new smallest object
+// of the subtree at its right
+static void ds_bptree_separator_fix(ds_bptree_t *bptree, void *removed, uint64_t prefix)
+{
+    ds_bptree_node_t *node = bptree->root;
+    while (!node->leaf)
+    {
+        int equal;
+        int i = ds_bptree_node_search(bptree, node, removed, prefix, &equal);
+        if (equal)
+        {
+            ds_bptree_slot_copy(node, i, ds_bptree_leftmost(node->child[i + 1]), 0);
+            return;
+        }
+        node = node->child[i];
+    }
+}
+
+void *ds_bptree_remove(ds_bptree_t *bptree, void *object)
+{
+    ds_bptree_node_t *path[DS_BPTREE_HEIGHT_MAX];
+    int index[DS_BPTREE_HEIGHT_MAX];
+    int depth = 0;
+    uint64_t prefix = ds_bptree_prefix_of(bptree, object);
+
+    if (!bptree->root)
+        return 0;
+
+    // 1. Descend to the leaf, keeping the path
+    ds_bptree_node_t *node = bptree->root;
+    while (!node->leaf)
+    {
+        int i = ds_bptree_child_index(bptree, node, object, prefix);
+        path[depth] = node;
+        index[depth++] = i;
+        node = node->child[i];
+    }
+    int equal;
+    int i = ds_bptree_node_search(bptree, node, object, prefix, &equal);
+    if (!equal)
+        return 0;
+
+    // 2. Remove the object from the leaf
+    void *removed = node->object[i];
+    ds_bptree_slots_move(node, i, node, i + 1, node->count - i - 1);
+    node->count--;
+    bptree->count--;
+
+    // 3. Fix underflowing nodes up the path
+    while (depth > 0 && node->count < DS_BPTREE_ORDER_MIN)
+    {
+        ds_bptree_node_t *father = path[--depth];
+        int merged = node->leaf ? ds_bptree_leaf_rebalance(bptree, father, index[depth])
+                                : ds_bptree_inner_rebalance(bptree, father, index[depth]);
+        if (!merged)
+            break;
+        node = father;
+    }
+
+    // 4. Shrink the bptree when the root is empty
+    node = bptree->root;
+    if (node->count == 0)
+    {
+        if (node->leaf)
+        {
+            bptree->root = 0;
+            bptree->first = 0;
+            bptree->last = 0;
+        }
+        else
+            bptree->root = node->child[0];
+        bptree->height--;
+        ds_heap_free(bptree->node_heap, node);
+    }
+
+    // 5. The smallest object of a leaf may be used as a separator above
+    if (i == 0 && bptree->root)
+        ds_bptree_separator_fix(bptree, removed, prefix);
+
+    return removed;
+}
+
+void *ds_bptree_find(ds_bptree_t *bptree, void *key)
+{
+    ds_bptree_node_t *node = bptree->root;
+    uint64_t prefix = ds_bptree_prefix_of(bptree, key);
+    if (!node)
+        return 0;
+    while (!node->leaf)
+        node = node->child[ds_bptree_child_index(bptree, node, key, prefix)];
+    int equal;
+    int i = ds_bptree_node_search(bptree, node, key, prefix, &equal);
+    return equal ? node->object[i] : 0;
+}
+
+void *ds_bptree_seek(ds_bptree_t *bptree, ds_bptree_iter_t *iter, void *key)
+{
+    ds_bptree_node_t *node = bptree->root;
+    uint64_t prefix = ds_bptree_prefix_of(bptree, key);
+    iter->leaf = 0;
+    iter->index = 0;
+    if (!node)
+        return 0;
+    while (!node->leaf)
+        node = node->child[ds_bptree_child_index(bptree, node, key, prefix)];
+    int equal;
+    iter->leaf = node;
+    iter->index = ds_bptree_node_search(bptree, node, key, prefix, &equal);
+    if (iter->index == node->count)
+    {
+        // All objects of the leaf are smaller than key
+        iter->leaf = node->next;
+        iter->index = 0;
+        if (!iter->leaf)
+            return 0;
+    }
+    return iter->leaf->object[iter->index];
+}
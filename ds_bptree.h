@@ -0,0 +1,220 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_BPTREE_H__
+#define __DS_BPTREE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ds_common.h"
+#include "ds_heap.h"
+#include "ds_btree.h"
+
+/**
+ * @brief Maximum number of objects in a node. The default order makes a node
+ * exactly 7 cache lines of 64 bytes on 64 bits targets: the size of a node is
+ * 16 + 24 * DS_BPTREE_ORDER bytes.
+ */
+#ifndef DS_BPTREE_ORDER
+#define DS_BPTREE_ORDER 18
+#endif
+
+/**
+ * @brief Minimum number of objects in a node other than the root
+ */
+#define DS_BPTREE_ORDER_MIN (DS_BPTREE_ORDER / 2)
+
+/**
+ * @brief Upper bound of the height of a bptree
+ */
+#define DS_BPTREE_HEIGHT_MAX 32
+
+/**
+ * @brief Key prefix function prototype. The prefix of an object is an unsigned
+ * integer that must preserve the order: if prefix(a) < prefix(b) then a is
+ * before b for the comparison function. Objects with equal prefixes are
+ * compared with the comparison function.
+ */
+typedef uint64_t (*ds_bptree_prefix_f)(void *);
+
+typedef struct ds_bptree_node_s ds_bptree_node_t;
+struct ds_bptree_node_s
+{
+    int count;
+    int leaf;
+    // Prefixes are first so that a node search mostly reads contiguous
+    // integers. In inner nodes, object[i] is the smallest object of child[i +
+    // 1].
+    uint64_t prefix[DS_BPTREE_ORDER];
+    void *object[DS_BPTREE_ORDER];
+    union
+    {
+        ds_bptree_node_t *child[DS_BPTREE_ORDER + 1];
+        struct
+        {
+            ds_bptree_node_t *prev;
+            ds_bptree_node_t *next;
+        };
+    };
+};
+
+typedef struct ds_bptree_s ds_bptree_t;
+struct ds_bptree_s
+{
+    size_t count;
+    ds_bptree_node_t *root;
+    ds_bptree_node_t *first;
+    ds_bptree_node_t *last;
+    int height;
+    bs_btree_cmp_f cmp;
+    ds_bptree_prefix_f prefix;
+    ds_heap_t *node_heap;
+};
+
+/**
+ * @brief Position of an object in the leaves of a bptree
+ */
+typedef struct ds_bptree_iter_s ds_bptree_iter_t;
+struct ds_bptree_iter_s
+{
+    ds_bptree_node_t *leaf;
+    int index;
+};
+
+/**
+ * @brief Initialize a B+tree. Like the ext btree, the bptree does not need
+ * any item in the objects.
+ *
+ * @param bptree The bptree
+ * @param node_heap A heap of ds_bptree_node_t where nodes are taken from
+ * @param cmp Comparison function between objects
+ * @param prefix Key prefix function of the objects, or 0
+ */
+void ds_bptree_init(ds_bptree_t *bptree, ds_heap_t *node_heap, bs_btree_cmp_f cmp, ds_bptree_prefix_f prefix);
+
+/**
+ * @brief Insert an object into a bptree
+ *
+ * @param bptree The bptree
+ * @param object The object to insert
+ *
+ * @return If `object` has no equal object in the bptree, the object is
+ * inserted and the function returns `object`. If `object` has an equal object
+ * in the bptree, it is not inserted and the function returns the equal
+ * object. If the node heap has not enough nodes, the object is not inserted
+ * and the function returns 0.
+ */
+void *ds_bptree_insert(ds_bptree_t *bptree, void *object);
+
+/**
+ * @brief Remove the object equal to `object` from a bptree. Freed nodes are
+ * given back to the node heap.
+ *
+ * @param bptree The bptree
+ * @param object The object to remove
+ * @return The removed object or 0 if there is none
+ */
+void *ds_bptree_remove(ds_bptree_t *bptree, void *object);
+
+/**
+ * @brief Find the object equal to a key. See ds_btree_find().
+ */
+void *ds_bptree_find(ds_bptree_t *bptree, void *key);
+
+/**
+ * @brief Position an iterator on the smallest object greater than or equal to
+ * a key
+ *
+ * @param bptree The bptree
+ * @param iter The iterator
+ * @param key The key to look for
+ * @return The object or 0 if there is none
+ */
+void *ds_bptree_seek(ds_bptree_t *bptree, ds_bptree_iter_t *iter, void *key);
+
+/**
+ * @brief Position an iterator on the smallest object of a bptree
+ *
+ * @return The object or 0 if the bptree is empty
+ */
+static inline void *ds_bptree_first(ds_bptree_t *bptree, ds_bptree_iter_t *iter)
+{
+    iter->leaf = bptree->first;
+    iter->index = 0;
+    return iter->leaf ? iter->leaf->object[0] : 0;
+}
+
+/**
+ * @brief Position an iterator on the greatest object of a bptree
+ *
+ * @return The object or 0 if the bptree is empty
+ */
+static inline void *ds_bptree_last(ds_bptree_t *bptree, ds_bptree_iter_t *iter)
+{
+    iter->leaf = bptree->last;
+    iter->index = iter->leaf ? iter->leaf->count - 1 : 0;
+    return iter->leaf ? iter->leaf->object[iter->index] : 0;
+}
+
+/**
+ * @brief Move an iterator to the next object, following the leaf links
+ *
+ * @return The object or 0 at the end of the bptree
+ */
+static inline void *ds_bptree_next(ds_bptree_iter_t *iter)
+{
+    if (!iter->leaf)
+        return 0;
+    if (++iter->index == iter->leaf->count)
+    {
+        iter->leaf = iter->leaf->next;
+        iter->index = 0;
+        if (!iter->leaf)
+            return 0;
+    }
+    return iter->leaf->object[iter->index];
+}
+
+/**
+ * @brief Move an iterator to the previous object, following the leaf links
+ *
+ * @return The object or 0 at the beginning of the bptree
+ */
+static inline void *ds_bptree_prev(ds_bptree_iter_t *iter)
+{
+    if (!iter->leaf)
+        return 0;
+    if (iter->index-- == 0)
+    {
+        iter->leaf = iter->leaf->prev;
+        if (!iter->leaf)
+            return 0;
+        iter->index = iter->leaf->count - 1;
+    }
+    return iter->leaf->object[iter->index];
+}
+
+#endif // __DS_BPTREE_H__
@@ -23,7 +23,10 @@
  * SOFTWARE.
  */
 
+#include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "ds_btree.h"
 #include "ds_btree_ext.h"
@@ -36,6 +39,14 @@ static inline int height(ds_btree_item_t *node)
     return node->height;
 }
 
+// A utility function to get the number of nodes of the tree
+static inline unsigned int size(ds_btree_item_t *node)
+{
+    if (node == 0)
+        return 0;
+    return node->size;
+}
+
 // A utility function to get maximum of two integers
 static inline int max(int a, int b)
 {
@@ -60,9 +71,11 @@ static ds_btree_item_t *ds_btree_right_rotate(ds_btree_item_t *y)
     x->right = y;
     y->left = tmp;
 
-    // Update heights
+    // Update heights and sizes
     y->height = max(height(y->left), height(y->right)) + 1;
     x->height = max(height(x->left), height(x->right)) + 1;
+    y->size = size(y->left) + size(y->right) + 1;
+    x->size = size(x->left) + size(x->right) + 1;
 
     // Return new root
     return x;
@@ -78,252 +91,340 @@ static ds_btree_item_t *ds_btree_left_rotate(ds_btree_item_t *x)
     y->left = x;
     x->right = tmp;
 
-    // Update heights
+    // Update heights and sizes
     x->height = max(height(x->left), height(x->right)) + 1;
     y->height = max(height(y->left), height(y->right)) + 1;
+    x->size = size(x->left) + size(x->right) + 1;
+    y->size = size(y->left) + size(y->right) + 1;
 
     // Return new root
     return y;
 }
 
-// Given a non-empty binary search tree, return the father son of the node with
-// minimum key value found in that tree. Note that the entire tree does not need
-// to be searched
-static ds_btree_item_t **ds_btree_min_value_node_father_son(ds_btree_item_t **father_son)
+static inline void *ds_btree_object_of(ds_btree_t *btree, ds_btree_item_t *node)
 {
-    ds_btree_item_t *current = *father_son;
-
-    /* loop down to find the leftmost leaf */
-    while (current->left != 0)
-    {
-        father_son = &current->left;
-        current = current->left;
-    }
-    return father_son;
+    return btree->_offset_in_object == -1 ? ((ds_btree_ext_item_t *)node)->object : DS_OBJECT_OF(btree, node);
 }
 
-// Get the allocated node
-static inline ds_btree_item_t *ds_btree_node_alloc(ds_btree_t *btree)
+static inline uint64_t ds_btree_u64_key_of(ds_btree_t *btree, void *object)
 {
-    ds_btree_item_t *node = btree->_cmp_node;
-    btree->count++;
-    // new node is initially added at leaf
-    node->left = 0;
-    node->right = 0;
-    node->height = 1;
-    return node;
+    return *(uint64_t *)((char *)object + btree->_key_offset_in_object);
 }
 
-static inline void *ds_btree_object_of(ds_btree_t *btree, ds_btree_item_t *node)
+static inline int ds_btree_u64_cmp(uint64_t left, uint64_t right)
 {
-    return btree->_offset_in_object == -1 ? ((ds_btree_ext_item_t *)node)->object : DS_OBJECT_OF(btree, node);
+    return (left > right) - (left < right);
 }
 
-static inline int ds_btree_cmp_object_to(ds_btree_t *btree, ds_btree_item_t *node)
+static inline int ds_btree_cmp_objects(ds_btree_t *btree, void *left, void *right)
 {
-    return btree->cmp(btree->_cmp_object, ds_btree_object_of(btree, node));
+    if (!btree->cmp)
+        return ds_btree_u64_cmp(ds_btree_u64_key_of(btree, left), ds_btree_u64_key_of(btree, right));
+    return btree->cmp(left, right);
 }
 
-// Recursive function to insert a node with given key into subtree with given
-// root. It returns root of the modified subtree.
-static ds_btree_item_t *ds_btree_node_insert(ds_btree_t *btree, ds_btree_item_t *node)
+static inline int ds_btree_cmp_key_to(ds_btree_t *btree, void *key, ds_btree_item_t *node)
 {
-    // 1. Perform the normal BST rotation
-    if (node == 0)
-        return ds_btree_node_alloc(btree);
+    return ds_btree_cmp_objects(btree, key, ds_btree_object_of(btree, node));
+}
 
-    int cmp = ds_btree_cmp_object_to(btree, node);
-    if (cmp <= -1)
-        node->left = ds_btree_node_insert(btree, node->left);
-    else if (cmp >= 1)
-        node->right = ds_btree_node_insert(btree, node->right);
-    else
+// Walk up a path of father sons, from the deepest one to the root, updating
+// heights and rotating unbalanced nodes. No comparison is needed: the rotation
+// cases are given by the balance factors of the sons. The walk stops as soon
+// as the height of a subtree is unchanged, as nothing above it can change,
+// except the sizes of a ranked btree.
+static void ds_btree_path_rebalance(ds_btree_t *btree, ds_btree_item_t ***path, int depth)
+{
+    while (depth-- > 0)
     {
-        // Equal keys not allowed
-        btree->_equal_node = node;
-        return node;
-    }
+        ds_btree_item_t **father_son = path[depth];
+        ds_btree_item_t *node = *father_son;
+        int old_height = node->height;
+        int balance = BF(node);
 
-    // 2. Update height of this ancestor node
-    node->height = 1 + max(height(node->left), height(node->right));
-
-    // 3. Get the balance factor of this ancestor node to check whether this
-    // node became unbalanced
-    int balance = BF(node);
-
-    // If this node becomes unbalanced, then there are 4 cases
-    if (balance > 1)
-    {
-        int cmp_left = ds_btree_cmp_object_to(btree, node->left);
-        // Left Left Case
-        if (cmp_left <= -1)
-            return ds_btree_right_rotate(node);
-        // Left Right Case
-        if (cmp_left >= 1)
+        if (balance > 1)
+        {
+            // Left Right Case
+            if (BF(node->left) < 0)
+                node->left = ds_btree_left_rotate(node->left);
+            // Left Left Case
+            node = ds_btree_right_rotate(node);
+            *father_son = node;
+        }
+        else if (balance < -1)
+        {
+            // Right Left Case
+            if (BF(node->right) > 0)
+                node->right = ds_btree_right_rotate(node->right);
+            // Right Right Case
+            node = ds_btree_left_rotate(node);
+            *father_son = node;
+        }
+        else
         {
-            node->left = ds_btree_left_rotate(node->left);
-            return ds_btree_right_rotate(node);
+            node->height = 1 + max(height(node->left), height(node->right));
+            node->size = 1 + size(node->left) + size(node->right);
         }
+
+        if (node->height == old_height)
+            break;
     }
-    else if (balance < -1)
+
+    if (btree->_ranked)
     {
-        int cmp_right = ds_btree_cmp_object_to(btree, node->right);
-        // Right Right Case
-        if (cmp_right >= 1)
-            return ds_btree_left_rotate(node);
-        // Right Left Case
-        if (cmp_right <= -1)
+        while (depth-- > 0)
         {
-            node->right = ds_btree_right_rotate(node->right);
-            return ds_btree_left_rotate(node);
+            ds_btree_item_t *node = *path[depth];
+            node->size = 1 + size(node->left) + size(node->right);
         }
     }
-
-    // return the (unchanged) node
-    return node;
 }
 
-// Recursive function to delete a node with given key from subtree with given
-// root. It returns root of the modified subtree.
-static ds_btree_item_t *ds_btree_node_remove(ds_btree_t *btree, ds_btree_item_t **father_son)
+void ds_btree_path_insert(ds_btree_t *btree, ds_btree_item_t ***path, int depth, ds_btree_item_t **father_son, ds_btree_item_t *item)
 {
-    ds_btree_item_t *node = *father_son;
-    // 1. Perform standard BST delete
-    if (node == 0)
-        return node;
+    // New node is added at leaf
+    item->left = 0;
+    item->right = 0;
+    item->height = 1;
+    item->size = 1;
+    *father_son = item;
+    btree->count++;
 
-    int cmp = ds_btree_cmp_object_to(btree, node);
-    // If the key to be deleted is smaller than the root's key, then it lies in
-    // left subtree
-    if (cmp <= -1)
-        node->left = ds_btree_node_remove(btree, &node->left);
+    // Update heights of the ancestors and rebalance
+    ds_btree_path_rebalance(btree, path, depth);
+}
 
-    // If the key to be deleted is greater than the root's key, then it lies in
-    // right subtree
-    else if (cmp >= 1)
-        node->right = ds_btree_node_remove(btree, &node->right);
+void ds_btree_path_remove(ds_btree_t *btree, ds_btree_item_t ***path, int depth, ds_btree_item_t **father_son)
+{
+    ds_btree_item_t *node = *father_son;
 
-    // If key is same as root's key, then This is the node to be deleted
-    else
+    if ((node->left == 0) || (node->right == 0))
     {
         // Case 1: node with only one child or no child
-        if ((node->left == 0) || (node->right == 0))
-        {
-            ds_btree_item_t *son = node->left ? node->left : node->right;
-            *father_son = son;
-            node->left = 0;
-            node->right = 0;
-            btree->_equal_node = node;
-            btree->count--;
-            node = son;
-        }
-        else
+        *father_son = node->left ? node->left : node->right;
+    }
+    else
+    {
+        // Case 2: node with two children: Get the inorder successor (smallest
+        // in the right subtree). This successor has no left son. We unlink
+        // the successor from its place and put it in place of the node.
+        int node_depth = depth;
+        path[depth++] = father_son;
+        ds_btree_item_t **successor_father_son = &node->right;
+        while ((*successor_father_son)->left != 0)
         {
-            // Case 2: node with two children: Get the inorder successor
-            // (smallest in the right subtree). This successor has no left son.
-            // We exchange the successor and the node in the global tree. The
-            // node will then become a node with no left son in the successor
-            // right subtree. Then we delete the node in the right subtree : we
-            // will fall in case 1.
-
-            // Get successor
-            ds_btree_item_t **successor_father_son = ds_btree_min_value_node_father_son(&node->right);
-            ds_btree_item_t *successor = *successor_father_son;
-
-            // node <-> successor
-            // Exchanging node and successor sons (the successor has no left son)
-            successor->left = node->left;
-            node->left = 0;
-            ds_btree_item_t *successor_right_copy = successor->right;
-            if (node->right == successor)
-            {
-                // node is father of successor
-                successor->right = node;
-            }
-            else
-            {
-                successor->right = node->right;
-                *successor_father_son = node;
-            }
-            node->right = successor_right_copy;
-
-            // Exchanging height
-            int successor_height_copy = successor->height;
-            successor->height = node->height;
-            node->height = successor_height_copy;
-
-            // Update node father
-            *father_son = successor;
-
-            // Delete the node in its new subtree
-            successor->right = ds_btree_node_remove(btree, &successor->right);
-            node = successor;
+            path[depth++] = successor_father_son;
+            successor_father_son = &(*successor_father_son)->left;
         }
+        ds_btree_item_t *successor = *successor_father_son;
+        *successor_father_son = successor->right;
+
+        successor->left = node->left;
+        successor->right = node->right;
+        successor->height = node->height;
+        successor->size = node->size;
+        *father_son = successor;
+
+        // The right son of the node is now the right son of the successor
+        if (depth > node_depth + 1)
+            path[node_depth + 1] = &successor->right;
     }
 
-    // If the tree had only one node then return
-    if (node == 0)
-        return node;
+    node->left = 0;
+    node->right = 0;
+    btree->count--;
 
-    // 2. Update height of the current node
-    node->height = 1 + max(height(node->left), height(node->right));
+    // Update heights of the ancestors and rebalance
+    ds_btree_path_rebalance(btree, path, depth);
+}
 
-    // 3. Get the balance factor of this node (to check whether this node
-    // became unbalanced)
-    int balance = BF(node);
+// Iterative function to insert an item into the btree. The object of the item
+// is compared once per level on the way down and the visited father sons are
+// kept on a stack for the rebalancing. It returns the inserted item or the
+// item of the equal object.
+static ds_btree_item_t *ds_btree_node_insert(ds_btree_t *btree, ds_btree_item_t *item, void *object)
+{
+    ds_btree_item_t **path[DS_BTREE_HEIGHT_MAX];
+    ds_btree_item_t **father_son = &btree->root;
+    int depth = 0;
 
-    // If this node becomes unbalanced, then there are 4 cases
+    while (*father_son != 0)
+    {
+        ds_btree_item_t *node = *father_son;
+        int cmp = ds_btree_cmp_key_to(btree, object, node);
+        // Equal keys not allowed
+        if (cmp == 0)
+            return node;
+        path[depth++] = father_son;
+        father_son = cmp < 0 ? &node->left : &node->right;
+    }
+    ds_btree_path_insert(btree, path, depth, father_son, item);
+    return item;
+}
 
-    // Left Left Case
-    if (balance > 1 && BF(node->left) >= 0)
-        return ds_btree_right_rotate(node);
+// Iterative function to remove the item equal to object from the btree. It
+// returns the removed item or 0 if no item is equal to object.
+static ds_btree_item_t *ds_btree_node_remove(ds_btree_t *btree, void *object)
+{
+    ds_btree_item_t **path[DS_BTREE_HEIGHT_MAX];
+    ds_btree_item_t **father_son = &btree->root;
+    int depth = 0;
 
-    // Left Right Case
-    if (balance > 1 && BF(node->left) < 0)
+    while (*father_son != 0)
     {
-        node->left = ds_btree_left_rotate(node->left);
-        return ds_btree_right_rotate(node);
+        ds_btree_item_t *node = *father_son;
+        int cmp = ds_btree_cmp_key_to(btree, object, node);
+        if (cmp == 0)
+        {
+            ds_btree_path_remove(btree, path, depth, father_son);
+            return node;
+        }
+        path[depth++] = father_son;
+        father_son = cmp < 0 ? &node->left : &node->right;
     }
+    return 0;
+}
 
-    // Right Right Case
-    if (balance < -1 && BF(node->right) <= 0)
-        return ds_btree_left_rotate(node);
+// Iterative function to find the node equal to key
+static ds_btree_item_t *ds_btree_node_find(ds_btree_t *btree, void *key)
+{
+    ds_btree_item_t *node = btree->root;
+    while (node != 0)
+    {
+        int cmp = ds_btree_cmp_key_to(btree, key, node);
+        if (cmp == 0)
+            return node;
+        node = cmp < 0 ? node->left : node->right;
+    }
+    return 0;
+}
 
-    // Right Left Case
-    if (balance < -1 && BF(node->right) > 0)
+// Iterative function to find the smallest node greater than key (or equal to
+// key if `or_equal` is set)
+static ds_btree_item_t *ds_btree_node_after(ds_btree_t *btree, void *key, int or_equal)
+{
+    ds_btree_item_t *node = btree->root;
+    ds_btree_item_t *found = 0;
+    while (node != 0)
     {
-        node->right = ds_btree_right_rotate(node->right);
-        return ds_btree_left_rotate(node);
+        int cmp = ds_btree_cmp_key_to(btree, key, node);
+        if (cmp == 0 && or_equal)
+            return node;
+        if (cmp < 0)
+        {
+            found = node;
+            node = node->left;
+        }
+        else
+            node = node->right;
     }
+    return found;
+}
 
+// Iterative function to find the greatest node less than key (or equal to key
+// if `or_equal` is set)
+static ds_btree_item_t *ds_btree_node_before(ds_btree_t *btree, void *key, int or_equal)
+{
+    ds_btree_item_t *node = btree->root;
+    ds_btree_item_t *found = 0;
+    while (node != 0)
+    {
+        int cmp = ds_btree_cmp_key_to(btree, key, node);
+        if (cmp == 0 && or_equal)
+            return node;
+        if (cmp > 0)
+        {
+            found = node;
+            node = node->right;
+        }
+        else
+            node = node->left;
+    }
+    return found;
+}
+
+static inline void *ds_btree_object_or_null(ds_btree_t *btree, ds_btree_item_t *node)
+{
+    return node ? ds_btree_object_of(btree, node) : 0;
+}
+
+// Recursive function to build a balanced subtree from the first `count` items
+// of a vine, a list of items linked by their right sons. The vine is advanced
+// past the consumed items. It returns root of the subtree.
+static ds_btree_item_t *ds_btree_vine_build(ds_btree_item_t **vine, size_t count)
+{
+    if (count == 0)
+        return 0;
+    ds_btree_item_t *left = ds_btree_vine_build(vine, count / 2);
+    ds_btree_item_t *node = *vine;
+    *vine = node->right;
+    node->left = left;
+    node->right = ds_btree_vine_build(vine, count - count / 2 - 1);
+    node->height = 1 + max(height(node->left), height(node->right));
+    node->size = 1 + size(node->left) + size(node->right);
     return node;
 }
 
+// A vine being built, with the object of its last item
+typedef struct ds_btree_vine_s ds_btree_vine_t;
+struct ds_btree_vine_s
+{
+    ds_btree_item_t *root;
+    ds_btree_item_t **tail;
+    void *last;
+    size_t count;
+};
+
+static inline void ds_btree_vine_init(ds_btree_vine_t *vine)
+{
+    vine->root = 0;
+    vine->tail = &vine->root;
+    vine->last = 0;
+    vine->count = 0;
+}
+
+// Append an item to a vine. If `verify` is set, check that its object is
+// greater than the object of the previous item.
+static inline int ds_btree_vine_append(ds_btree_t *btree, ds_btree_vine_t *vine, ds_btree_item_t *item, void *object, int verify)
+{
+    if (verify && vine->count > 0 && ds_btree_cmp_objects(btree, vine->last, object) >= 0)
+        return -1;
+    *vine->tail = item;
+    vine->tail = &item->right;
+    vine->last = object;
+    vine->count++;
+    return 0;
+}
+
+// Turn a complete vine into the btree
+static void ds_btree_vine_to_tree(ds_btree_t *btree, ds_btree_vine_t *vine)
+{
+    ds_btree_item_t *root = vine->root;
+    btree->root = ds_btree_vine_build(&root, vine->count);
+    btree->count = vine->count;
+}
+
 void ds_btree_init(ds_btree_t *btree, size_t offset_in_object, bs_btree_cmp_f cmp)
 {
     btree->count = 0;
     btree->root = 0;
     btree->_offset_in_object = offset_in_object;
     btree->cmp = cmp;
+    btree->_key_offset_in_object = 0;
+    btree->_ranked = 0;
 }
 
 void *ds_btree_insert(ds_btree_t *btree, void *object)
 {
     ds_btree_item_t *item = DS_ITEM_OF(btree, object);
-    btree->_cmp_node = item;
-    btree->_cmp_object = object;
-    btree->_equal_node = 0;
-    btree->root = ds_btree_node_insert(btree, btree->root);
-    return btree->_equal_node ? DS_OBJECT_OF(btree, btree->_equal_node) : object;
+    ds_btree_item_t *node = ds_btree_node_insert(btree, item, object);
+    return node == item ? object : DS_OBJECT_OF(btree, node);
 }
 
 void *ds_btree_remove(ds_btree_t *btree, ds_btree_item_t *item)
 {
-    btree->_cmp_node = item;
-    btree->_cmp_object = DS_OBJECT_OF(btree, item);
-    btree->_equal_node = 0;
-    btree->root = ds_btree_node_remove(btree, &btree->root);
-    return btree->_equal_node ? DS_OBJECT_OF(btree, btree->_equal_node) : 0;
+    ds_btree_item_t *node = ds_btree_node_remove(btree, DS_OBJECT_OF(btree, item));
+    return node ? DS_OBJECT_OF(btree, node) : 0;
 }
 
 void ds_btree_ext_init(ds_btree_ext_t *btree, bs_btree_cmp_f cmp)
@@ -332,23 +433,847 @@ void ds_btree_ext_init(ds_btree_ext_t *btree, bs_btree_cmp_f cmp)
     btree->root = 0;
     btree->_offset_in_object = -1;
     btree->cmp = cmp;
+    btree->_key_offset_in_object = 0;
+    btree->_ranked = 0;
 }
 
 void *ds_btree_ext_insert(ds_btree_ext_t *btree, ds_btree_ext_item_t *item, void *object)
 {
     item->object = object;
-    btree->_cmp_node = (ds_btree_item_t *)item;
-    btree->_cmp_object = object;
-    btree->_equal_node = 0;
-    btree->root = ds_btree_node_insert(btree, btree->root);
-    return btree->_equal_node ? ((ds_btree_ext_item_t *)btree->_equal_node)->object : object;
+    ds_btree_item_t *node = ds_btree_node_insert(btree, (ds_btree_item_t *)item, object);
+    return ((ds_btree_ext_item_t *)node)->object;
 }
 
 void *ds_btree_ext_remove(ds_btree_ext_t *btree, ds_btree_ext_item_t *item)
 {
-    btree->_cmp_node = (ds_btree_item_t *)item;
-    btree->_cmp_object = item->object;
-    btree->_equal_node = 0;
-    btree->root = ds_btree_node_remove(btree, &btree->root);
-    return btree->_equal_node ? ((ds_btree_ext_item_t *)btree->_equal_node)->object : 0;
+    ds_btree_item_t *node = ds_btree_node_remove(btree, item->object);
+    return node ? ((ds_btree_ext_item_t *)node)->object : 0;
+}
+
+void *ds_btree_find(ds_btree_t *btree, void *key)
+{
+    return ds_btree_object_or_null(btree, ds_btree_node_find(btree, key));
+}
+
+void *ds_btree_lower_bound(ds_btree_t *btree, void *key)
+{
+    return ds_btree_object_or_null(btree, ds_btree_node_after(btree, key, 1));
+}
+
+void *ds_btree_upper_bound(ds_btree_t *btree, void *key)
+{
+    return ds_btree_object_or_null(btree, ds_btree_node_after(btree, key, 0));
+}
+
+void *ds_btree_floor(ds_btree_t *btree, void *key)
+{
+    return ds_btree_object_or_null(btree, ds_btree_node_before(btree, key, 1));
+}
+
+void ds_btree_u64_init(ds_btree_t *btree, size_t offset_in_object, size_t key_offset_in_object)
+{
+    ds_btree_init(btree, offset_in_object, 0);
+    btree->_key_offset_in_object = key_offset_in_object;
+}
+
+// Key of a node of an uint64_t keyed btree. The key is at a constant distance
+// from the item.
+static inline uint64_t ds_btree_u64_node_key(ds_btree_item_t *node, ptrdiff_t key_offset_in_item)
+{
+    return *(uint64_t *)((char *)node + key_offset_in_item);
+}
+
+static inline ptrdiff_t ds_btree_u64_key_offset_in_item(ds_btree_t *btree)
+{
+    return (ptrdiff_t)btree->_key_offset_in_object - (ptrdiff_t)btree->_offset_in_object;
+}
+
+void *ds_btree_u64_insert(ds_btree_t *btree, void *object)
+{
+    ds_btree_item_t **path[DS_BTREE_HEIGHT_MAX];
+    ds_btree_item_t **father_son = &btree->root;
+    ptrdiff_t key_offset = ds_btree_u64_key_offset_in_item(btree);
+    uint64_t key = ds_btree_u64_key_of(btree, object);
+    int depth = 0;
+
+    while (*father_son != 0)
+    {
+        ds_btree_item_t *node = *father_son;
+        uint64_t node_key = ds_btree_u64_node_key(node, key_offset);
+        // Equal keys not allowed
+        if (key == node_key)
+            return DS_OBJECT_OF(btree, node);
+        path[depth++] = father_son;
+        father_son = key < node_key ? &node->left : &node->right;
+    }
+    ds_btree_path_insert(btree, path, depth, father_son, DS_ITEM_OF(btree, object));
+    return object;
+}
+
+void *ds_btree_u64_remove(ds_btree_t *btree, uint64_t key)
+{
+    ds_btree_item_t **path[DS_BTREE_HEIGHT_MAX];
+    ds_btree_item_t **father_son = &btree->root;
+    ptrdiff_t key_offset = ds_btree_u64_key_offset_in_item(btree);
+    int depth = 0;
+
+    while (*father_son != 0)
+    {
+        ds_btree_item_t *node = *father_son;
+        uint64_t node_key = ds_btree_u64_node_key(node, key_offset);
+        if (key == node_key)
+        {
+            ds_btree_path_remove(btree, path, depth, father_son);
+            return DS_OBJECT_OF(btree, node);
+        }
+        path[depth++] = father_son;
+        father_son = key < node_key ? &node->left : &node->right;
+    }
+    return 0;
+}
+
+void *ds_btree_u64_find(ds_btree_t *btree, uint64_t key)
+{
+    ds_btree_item_t *node = btree->root;
+    ptrdiff_t key_offset = ds_btree_u64_key_offset_in_item(btree);
+    while (node != 0)
+    {
+        uint64_t node_key = ds_btree_u64_node_key(node, key_offset);
+        if (key == node_key)
+            return DS_OBJECT_OF(btree, node);
+        node = key < node_key ? node->left : node->right;
+    }
+    return 0;
+}
+
+// Find the node with the smallest key after key (or the greatest key before
+// key if `before` is set), possibly equal to key if `or_equal` is set
+static inline void *ds_btree_u64_bound(ds_btree_t *btree, uint64_t key, int before, int or_equal)
+{
+    ds_btree_item_t *node = btree->root;
+    ds_btree_item_t *found = 0;
+    ptrdiff_t key_offset = ds_btree_u64_key_offset_in_item(btree);
+    while (node != 0)
+    {
+        uint64_t node_key = ds_btree_u64_node_key(node, key_offset);
+        if (key == node_key && or_equal)
+            return DS_OBJECT_OF(btree, node);
+        if (before ? key > node_key : key < node_key)
+        {
+            found = node;
+            node = before ? node->right : node->left;
+        }
+        else
+            node = before ? node->left : node->right;
+    }
+    return found ? DS_OBJECT_OF(btree, found) : 0;
+}
+
+void *ds_btree_u64_lower_bound(ds_btree_t *btree, uint64_t key)
+{
+    return ds_btree_u64_bound(btree, key, 0, 1);
+}
+
+void *ds_btree_u64_upper_bound(ds_btree_t *btree, uint64_t key)
+{
+    return ds_btree_u64_bound(btree, key, 0, 0);
+}
+
+void *ds_btree_u64_floor(ds_btree_t *btree, uint64_t key)
+{
+    return ds_btree_u64_bound(btree, key, 1, 1);
+}
+
+int ds_btree_build_sorted(ds_btree_t *btree, void **objects, size_t count, int verify)
+{
+    ds_btree_vine_t vine;
+    ds_btree_vine_init(&vine);
+    if (btree->count != 0)
+        return -1;
+    for (size_t i = 0; i < count; i++)
+        if (ds_btree_vine_append(btree, &vine, DS_ITEM_OF(btree, objects[i]), objects[i], verify))
+            return -1;
+    ds_btree_vine_to_tree(btree, &vine);
+    return 0;
+}
+
+int ds_btree_build_sorted_fifo(ds_btree_t *btree, ds_fifo_t *fifo, int verify)
+{
+    ds_btree_vine_t vine;
+    ds_btree_vine_init(&vine);
+    if (btree->count != 0)
+        return -1;
+    for (ds_fifo_item_t *fifo_item = fifo->root; fifo_item != 0; fifo_item = fifo_item->next)
+    {
+        void *object = DS_OBJECT_OF(fifo, fifo_item);
+        if (ds_btree_vine_append(btree, &vine, DS_ITEM_OF(btree, object), object, verify))
+            return -1;
+    }
+    ds_btree_vine_to_tree(btree, &vine);
+    return 0;
+}
+
+int ds_btree_build_sorted_dlist(ds_btree_t *btree, ds_dlist_t *dlist, int verify)
+{
+    ds_btree_vine_t vine;
+    ds_btree_vine_init(&vine);
+    if (btree->count != 0)
+        return -1;
+    for (ds_dlist_item_t *dlist_item = dlist->root; dlist_item != 0; dlist_item = dlist_item->next)
+    {
+        void *object = DS_OBJECT_OF(dlist, dlist_item);
+        if (ds_btree_vine_append(btree, &vine, DS_ITEM_OF(btree, object), object, verify))
+            return -1;
+    }
+    ds_btree_vine_to_tree(btree, &vine);
+    return 0;
+}
+
+int ds_btree_ext_build_sorted(ds_btree_ext_t *btree, ds_btree_ext_item_t *items, void **objects, size_t count, int verify)
+{
+    ds_btree_vine_t vine;
+    ds_btree_vine_init(&vine);
+    if (btree->count != 0)
+        return -1;
+    for (size_t i = 0; i < count; i++)
+    {
+        items[i].object = objects[i];
+        if (ds_btree_vine_append(btree, &vine, (ds_btree_item_t *)&items[i], objects[i], verify))
+            return -1;
+    }
+    ds_btree_vine_to_tree(btree, &vine);
+    return 0;
+}
+
+// Recursive function to compute the sizes of a subtree
+static unsigned int ds_btree_node_size_update(ds_btree_item_t *node)
+{
+    if (node == 0)
+        return 0;
+    node->size = 1 + ds_btree_node_size_update(node->left) + ds_btree_node_size_update(node->right);
+    return node->size;
+}
+
+void ds_btree_rank_enable(ds_btree_t *btree)
+{
+    ds_btree_node_size_update(btree->root);
+    btree->_ranked = 1;
+}
+
+void *ds_btree_select(ds_btree_t *btree, size_t rank)
+{
+    // Without ranking the sizes are stale
+    assert(btree->_ranked);
+    if (!btree->_ranked)
+        return 0;
+    ds_btree_item_t *node = btree->root;
+    while (node != 0)
+    {
+        size_t left_size = size(node->left);
+        if (rank == left_size)
+            return ds_btree_object_of(btree, node);
+        if (rank < left_size)
+            node = node->left;
+        else
+        {
+            rank -= left_size + 1;
+            node = node->right;
+        }
+    }
+    return 0;
+}
+
+size_t ds_btree_rank(ds_btree_t *btree, void *key)
+{
+    assert(btree->_ranked);
+    if (!btree->_ranked)
+        return btree->count;
+    ds_btree_item_t *node = btree->root;
+    size_t rank = 0;
+    while (node != 0)
+    {
+        int cmp = ds_btree_cmp_key_to(btree, key, node);
+        if (cmp <= 0)
+        {
+            if (cmp == 0)
+                return rank + size(node->left);
+            node = node->left;
+        }
+        else
+        {
+            rank += size(node->left) + 1;
+            node = node->right;
+        }
+    }
+    return rank;
+}
+
+// Join two subtrees with an item, all objects of `left` being smaller than
+// the object of the item, itself smaller than all objects of `right`. The item
+// is linked on the inner spine of the higher subtree, in place of the first
+// node not higher than the other subtree plus one, and the spine is then
+// rebalanced as after an insertion. It returns the root of the joined subtree.
+static ds_btree_item_t *ds_btree_node_join(ds_btree_t *btree, ds_btree_item_t *left, ds_btree_item_t *item, ds_btree_item_t *right)
+{
+    ds_btree_item_t **path[DS_BTREE_HEIGHT_MAX];
+    ds_btree_item_t *root = 0;
+    ds_btree_item_t **father_son = &root;
+    int depth = 0;
+
+    if (height(left) > height(right) + 1)
+    {
+        root = left;
+        while (height(*father_son) > height(right) + 1)
+        {
+            path[depth++] = father_son;
+            father_son = &(*father_son)->right;
+        }
+        left = *father_son;
+    }
+    else if (height(right) > height(left) + 1)
+    {
+        root = right;
+        while (height(*father_son) > height(left) + 1)
+        {
+            path[depth++] = father_son;
+            father_son = &(*father_son)->left;
+        }
+        right = *father_son;
+    }
+    item->left = left;
+    item->right = right;
+    item->height = 1 + max(height(left), height(right));
+    item->size = 1 + size(left) + size(right);
+    *father_son = item;
+    ds_btree_path_rebalance(btree, path, depth);
+    return root;
+}
+
+// Join two subtrees, all objects of `left` being smaller than all objects of
+// `right`. The smallest item of `right` is unlinked to join them.
+static ds_btree_item_t *ds_btree_node_join2(ds_btree_t *btree, ds_btree_item_t *left, ds_btree_item_t *right)
+{
+    ds_btree_item_t **path[DS_BTREE_HEIGHT_MAX];
+    ds_btree_item_t **father_son = &right;
+    int depth = 0;
+
+    if (right == 0)
+        return left;
+    while ((*father_son)->left != 0)
+    {
+        path[depth++] = father_son;
+        father_son = &(*father_son)->left;
+    }
+    ds_btree_item_t *first = *father_son;
+    *father_son = first->right;
+    ds_btree_path_rebalance(btree, path, depth);
+    return ds_btree_node_join(btree, left, first, right);
+}
+
+// Recursive function to split a subtree into the items smaller than key, put
+// in `*left`, and the items greater than key, put in `*right`. It returns the
+// item equal to key, unlinked, or 0.
+static ds_btree_item_t *ds_btree_node_split(ds_btree_t *btree, ds_btree_item_t *node, void *key, ds_btree_item_t **left, ds_btree_item_t **right)
+{
+    ds_btree_item_t *equal;
+    if (node == 0)
+    {
+        *left = 0;
+        *right = 0;
+        return 0;
+    }
+    int cmp = ds_btree_cmp_key_to(btree, key, node);
+    if (cmp == 0)
+    {
+        *left = node->left;
+        *right = node->right;
+        return node;
+    }
+    if (cmp < 0)
+    {
+        equal = ds_btree_node_split(btree, node->left, key, left, right);
+        *right = ds_btree_node_join(btree, *right, node, node->right);
+    }
+    else
+    {
+        equal = ds_btree_node_split(btree, node->right, key, left, right);
+        *left = ds_btree_node_join(btree, node->left, node, *left);
+    }
+    return equal;
+}
+
+// Unlink a dropped item and pass its object to `drop`
+static inline void ds_btree_node_drop(ds_btree_t *btree, ds_btree_item_t *node, ds_btree_drop_f drop)
+{
+    node->left = 0;
+    node->right = 0;
+    if (drop)
+        drop(ds_btree_object_of(btree, node));
+}
+
+// Recursive function to drop all items of a subtree. Nothing is done if there
+// is no `drop` function.
+static void ds_btree_node_drop_all(ds_btree_t *btree, ds_btree_item_t *node, ds_btree_drop_f drop)
+{
+    if (node == 0 || drop == 0)
+        return;
+    ds_btree_item_t *left = node->left;
+    ds_btree_item_t *right = node->right;
+    ds_btree_node_drop(btree, node, drop);
+    ds_btree_node_drop_all(btree, left, drop);
+    ds_btree_node_drop_all(btree, right, drop);
+}
+
+// Recursive function to move the items of subtree `other` into subtree
+// `node`. The items of `other` equal to an item of `node` are dropped and
+// counted in `*dropped`. It returns the root of the union.
+static ds_btree_item_t *ds_btree_node_union(ds_btree_t *btree, ds_btree_item_t *node, ds_btree_item_t *other, ds_btree_drop_f drop, size_t *dropped)
+{
+    ds_btree_item_t *other_left, *other_right;
+    if (node == 0)
+        return other;
+    if (other == 0)
+        return node;
+    ds_btree_item_t *equal = ds_btree_node_split(btree, other, ds_btree_object_of(btree, node), &other_left, &other_right);
+    ds_btree_item_t *left = ds_btree_node_union(btree, node->left, other_left, drop, dropped);
+    ds_btree_item_t *right = ds_btree_node_union(btree, node->right, other_right, drop, dropped);
+    if (equal)
+    {
+        ds_btree_node_drop(btree, equal, drop);
+        (*dropped)++;
+    }
+    return ds_btree_node_join(btree, left, node, right);
+}
+
+// Recursive function to keep in subtree `node` the items equal to an item of
+// subtree `*other_node`, counted in `*kept`. The subtree of `other` is split
+// on the way down and joined back on the way up. It returns the root of the
+// intersection.
+static ds_btree_item_t *ds_btree_node_intersection(ds_btree_t *btree, ds_btree_item_t *node, ds_btree_t *other, ds_btree_item_t **other_node, ds_btree_drop_f drop, size_t *kept)
+{
+    ds_btree_item_t *other_left, *other_right;
+    if (node == 0)
+        return 0;
+    if (*other_node == 0)
+    {
+        ds_btree_node_drop_all(btree, node, drop);
+        return 0;
+    }
+    ds_btree_item_t *equal = ds_btree_node_split(other, *other_node, ds_btree_object_of(btree, node), &other_left, &other_right);
+    ds_btree_item_t *left = ds_btree_node_intersection(btree, node->left, other, &other_left, drop, kept);
+    ds_btree_item_t *right = ds_btree_node_intersection(btree, node->right, other, &other_right, drop, kept);
+    if (equal)
+    {
+        *other_node = ds_btree_node_join(other, other_left, equal, other_right);
+        (*kept)++;
+        return ds_btree_node_join(btree, left, node, right);
+    }
+    *other_node = ds_btree_node_join2(other, other_left, other_right);
+    ds_btree_node_drop(btree, node, drop);
+    return ds_btree_node_join2(btree, left, right);
+}
+
+// Recursive function to remove from subtree `node` the items equal to an item
+// of subtree `*other_node`, counted in `*dropped`. The subtree of `other` is
+// split on the way down and joined back on the way up. It returns the root of
+// the difference.
+static ds_btree_item_t *ds_btree_node_difference(ds_btree_t *btree, ds_btree_item_t *node, ds_btree_t *other, ds_btree_item_t **other_node, ds_btree_drop_f drop, size_t *dropped)
+{
+    ds_btree_item_t *other_left, *other_right;
+    if (node == 0 || *other_node == 0)
+        return node;
+    ds_btree_item_t *equal = ds_btree_node_split(other, *other_node, ds_btree_object_of(btree, node), &other_left, &other_right);
+    ds_btree_item_t *left = ds_btree_node_difference(btree, node->left, other, &other_left, drop, dropped);
+    ds_btree_item_t *right = ds_btree_node_difference(btree, node->right, other, &other_right, drop, dropped);
+    if (equal)
+    {
+        *other_node = ds_btree_node_join(other, other_left, equal, other_right);
+        ds_btree_node_drop(btree, node, drop);
+        (*dropped)++;
+        return ds_btree_node_join2(btree, left, right);
+    }
+    *other_node = ds_btree_node_join2(other, other_left, other_right);
+    return ds_btree_node_join(btree, left, node, right);
+}
+
+// Two btrees can exchange nodes if they hold the same kind of items and
+// compare objects the same way
+static inline int ds_btree_compatible(ds_btree_t *btree, ds_btree_t *other)
+{
+    return btree->_offset_in_object == other->_offset_in_object && btree->cmp == other->cmp && btree->_key_offset_in_object == other->_key_offset_in_object;
+}
+
+int ds_btree_join(ds_btree_t *btree, ds_btree_t *right)
+{
+    if (!ds_btree_compatible(btree, right))
+        return -1;
+    if (btree->root != 0 && right->root != 0)
+    {
+        ds_btree_item_t *last = btree->root;
+        ds_btree_item_t *first = right->root;
+        while (last->right != 0)
+            last = last->right;
+        while (first->left != 0)
+            first = first->left;
+        if (ds_btree_cmp_objects(btree, ds_btree_object_of(btree, last), ds_btree_object_of(btree, first)) >= 0)
+            return -1;
+    }
+    if (btree->_ranked && !right->_ranked)
+        ds_btree_rank_enable(right);
+    btree->root = ds_btree_node_join2(btree, btree->root, right->root);
+    btree->count += right->count;
+    right->root = 0;
+    right->count = 0;
+    return 0;
+}
+
+void ds_btree_split(ds_btree_t *btree, void *key, ds_btree_t *right)
+{
+    ds_btree_item_t *left_root, *right_root;
+    // The moved objects are counted with the subtree sizes
+    if (!btree->_ranked)
+        ds_btree_rank_enable(btree);
+    ds_btree_item_t *equal = ds_btree_node_split(btree, btree->root, key, &left_root, &right_root);
+    if (equal)
+        right_root = ds_btree_node_join(btree, 0, equal, right_root);
+    *right = *btree;
+    btree->root = left_root;
+    right->root = right_root;
+    right->count = size(right_root);
+    btree->count -= right->count;
+}
+
+void ds_btree_extract_range(ds_btree_t *btree, void *low, void *high, ds_btree_t *range)
+{
+    ds_btree_item_t *left_root, *range_root, *right_root;
+    if (!btree->_ranked)
+        ds_btree_rank_enable(btree);
+    ds_btree_item_t *equal = ds_btree_node_split(btree, btree->root, low, &left_root, &range_root);
+    if (equal)
+        range_root = ds_btree_node_join(btree, 0, equal, range_root);
+    equal = ds_btree_node_split(btree, range_root, high, &range_root, &right_root);
+    if (equal)
+        right_root = ds_btree_node_join(btree, 0, equal, right_root);
+    *range = *btree;
+    btree->root = ds_btree_node_join2(btree, left_root, right_root);
+    range->root = range_root;
+    range->count = size(range_root);
+    btree->count -= range->count;
+}
+
+int ds_btree_union(ds_btree_t *btree, ds_btree_t *other, ds_btree_drop_f drop)
+{
+    size_t dropped = 0;
+    if (!ds_btree_compatible(btree, other))
+        return -1;
+    if (btree->_ranked && !other->_ranked)
+        ds_btree_rank_enable(other);
+    btree->root = ds_btree_node_union(btree, btree->root, other->root, drop, &dropped);
+    btree->count += other->count - dropped;
+    other->root = 0;
+    other->count = 0;
+    return 0;
+}
+
+int ds_btree_intersection(ds_btree_t *btree, ds_btree_t *other, ds_btree_drop_f drop)
+{
+    size_t kept = 0;
+    if (!ds_btree_compatible(btree, other))
+        return -1;
+    btree->root = ds_btree_node_intersection(btree, btree->root, other, &other->root, drop, &kept);
+    btree->count = kept;
+    return 0;
+}
+
+int ds_btree_difference(ds_btree_t *btree, ds_btree_t *other, ds_btree_drop_f drop)
+{
+    size_t dropped = 0;
+    if (!ds_btree_compatible(btree, other))
+        return -1;
+    btree->root = ds_btree_node_difference(btree, btree->root, other, &other->root, drop, &dropped);
+    btree->count -= dropped;
+    return 0;
+}
+
+// Push a node and its left (or right if `right` is set) descendants on the
+// path of a cursor
+static inline void ds_btree_cursor_descend(ds_btree_cursor_t *cursor, ds_btree_item_t *node, int right)
+{
+    while (node != 0)
+    {
+        cursor->path[cursor->depth++] = node;
+        node = right ? node->right : node->left;
+    }
+}
+
+void *ds_btree_cursor_object(ds_btree_cursor_t *cursor)
+{
+    if (cursor->depth == 0)
+        return 0;
+    return ds_btree_object_of(cursor->btree, cursor->path[cursor->depth - 1]);
+}
+
+void *ds_btree_cursor_first(ds_btree_cursor_t *cursor, ds_btree_t *btree)
+{
+    cursor->btree = btree;
+    cursor->depth = 0;
+    ds_btree_cursor_descend(cursor, btree->root, 0);
+    return ds_btree_cursor_object(cursor);
+}
+
+void *ds_btree_cursor_last(ds_btree_cursor_t *cursor, ds_btree_t *btree)
+{
+    cursor->btree = btree;
+    cursor->depth = 0;
+    ds_btree_cursor_descend(cursor, btree->root, 1);
+    return ds_btree_cursor_object(cursor);
+}
+
+void *ds_btree_cursor_seek(ds_btree_cursor_t *cursor, ds_btree_t *btree, void *key)
+{
+    ds_btree_item_t *node = btree->root;
+    int found_depth = 0;
+    cursor->btree = btree;
+    cursor->depth = 0;
+    while (node != 0)
+    {
+        cursor->path[cursor->depth++] = node;
+        int cmp = ds_btree_cmp_key_to(btree, key, node);
+        if (cmp <= 0)
+        {
+            // Candidate: the path up to this node is kept
+            found_depth = cursor->depth;
+            if (cmp == 0)
+                break;
+            node = node->left;
+        }
+        else
+            node = node->right;
+    }
+    cursor->depth = found_depth;
+    return ds_btree_cursor_object(cursor);
+}
+
+// Move a cursor to the next object (or previous one if `prev` is set)
+static void *ds_btree_cursor_step(ds_btree_cursor_t *cursor, int prev)
+{
+    if (cursor->depth == 0)
+        return 0;
+    ds_btree_item_t *node = cursor->path[cursor->depth - 1];
+    ds_btree_item_t *son = prev ? node->left : node->right;
+    if (son != 0)
+    {
+        // Leftmost (or rightmost) node of the right (or left) subtree
+        cursor->path[cursor->depth++] = son;
+        ds_btree_cursor_descend(cursor, prev ? son->right : son->left, prev);
+    }
+    else
+    {
+        // Go up to the first father reached from its left (or right) son
+        do
+        {
+            son = cursor->path[--cursor->depth];
+        } while (cursor->depth > 0 && son == (prev ? cursor->path[cursor->depth - 1]->left : cursor->path[cursor->depth - 1]->right));
+    }
+    return ds_btree_cursor_object(cursor);
+}
+
+void *ds_btree_cursor_next(ds_btree_cursor_t *cursor)
+{
+    return ds_btree_cursor_step(cursor, 0);
+}
+
+void *ds_btree_cursor_prev(ds_btree_cursor_t *cursor)
+{
+    return ds_btree_cursor_step(cursor, 1);
+}
+
+void *ds_btree_cursor_remove(ds_btree_cursor_t *cursor)
+{
+    void *object = ds_btree_cursor_object(cursor);
+    if (object == 0)
+        return 0;
+    // Rotations may move the next object anywhere: seek it again after the
+    // removal
+    void *next = ds_btree_cursor_next(cursor);
+    ds_btree_node_remove(cursor->btree, object);
+    if (next != 0)
+        ds_btree_cursor_seek(cursor, cursor->btree, next);
+    return object;
+}
+
+// A subtree union run by a thread
+typedef struct ds_btree_union_task_s ds_btree_union_task_t;
+struct ds_btree_union_task_s
+{
+    ds_btree_t *btree;
+    ds_btree_item_t *node;
+    ds_btree_item_t *other;
+    size_t dropped;
+    int threads;
+};
+
+static ds_btree_item_t *ds_btree_node_union_parallel(ds_btree_t *btree, ds_btree_item_t *node, ds_btree_item_t *other, size_t *dropped, int threads);
+
+static void *ds_btree_union_task_run(void *_task)
+{
+    ds_btree_union_task_t *task = _task;
+    task->node = ds_btree_node_union_parallel(task->btree, task->node, task->other, &task->dropped, task->threads);
+    return 0;
+}
+
+// Same as ds_btree_node_union() with no drop function, the union of the left
+// subtrees being run by a new thread while there are threads left. The
+// subtrees are disjoint and only the ranked flag of the btree is shared.
+static ds_btree_item_t *ds_btree_node_union_parallel(ds_btree_t *btree, ds_btree_item_t *node, ds_btree_item_t *other, size_t *dropped, int threads)
+{
+    ds_btree_union_task_t task;
+    ds_btree_item_t *other_right;
+    pthread_t thread;
+
+    if (threads < 2 || node == 0 || other == 0)
+        return ds_btree_node_union(btree, node, other, 0, dropped);
+    ds_btree_item_t *equal = ds_btree_node_split(btree, other, ds_btree_object_of(btree, node), &task.other, &other_right);
+    task.btree = btree;
+    task.node = node->left;
+    task.dropped = 0;
+    task.threads = threads / 2;
+    int started = pthread_create(&thread, 0, ds_btree_union_task_run, &task) == 0;
+    if (!started)
+        ds_btree_union_task_run(&task);
+    ds_btree_item_t *right = ds_btree_node_union_parallel(btree, node->right, other_right, dropped, threads - threads / 2);
+    if (started)
+        pthread_join(thread, 0);
+    *dropped += task.dropped;
+    if (equal)
+    {
+        ds_btree_node_drop(btree, equal, 0);
+        (*dropped)++;
+    }
+    return ds_btree_node_join(btree, task.node, node, right);
+}
+
+// Chunks smaller than this are not worth a thread
+#define DS_BTREE_BULK_CHUNK_MIN 4096
+
+// A chunk of a bulk insertion, sorted and built into its own btree
+typedef struct ds_btree_bulk_s ds_btree_bulk_t;
+struct ds_btree_bulk_s
+{
+    ds_btree_t btree;
+    void **objects;
+    void **scratch;
+    size_t count;
+    int span;
+    pthread_t thread;
+};
+
+// Recursive stable merge sort of objects, with a scratch of count / 2 objects.
+// Sorted runs are detected with one comparison.
+static void ds_btree_sort(ds_btree_t *btree, void **objects, void **scratch, size_t count)
+{
+    size_t half = count / 2;
+    if (count < 2)
+        return;
+    ds_btree_sort(btree, objects, scratch, half);
+    ds_btree_sort(btree, objects + half, scratch, count - half);
+    if (ds_btree_cmp_objects(btree, objects[half - 1], objects[half]) <= 0)
+        return;
+    memcpy(scratch, objects, half * sizeof(void *));
+    size_t i = 0, j = half, k = 0;
+    while (i < half && j < count)
+        objects[k++] = ds_btree_cmp_objects(btree, objects[j], scratch[i]) < 0 ? objects[j++] : scratch[i++];
+    while (i < half)
+        objects[k++] = scratch[i++];
+}
+
+// Sort a chunk and build its btree, skipping the objects equal to the
+// previous one
+static void ds_btree_bulk_build(ds_btree_bulk_t *chunk)
+{
+    ds_btree_t *btree = &chunk->btree;
+    ds_btree_vine_t vine;
+    ds_btree_vine_init(&vine);
+    ds_btree_sort(btree, chunk->objects, chunk->scratch, chunk->count);
+    for (size_t i = 0; i < chunk->count; i++)
+    {
+        void *object = chunk->objects[i];
+        if (vine.count == 0 || ds_btree_cmp_objects(btree, vine.last, object) != 0)
+            ds_btree_vine_append(btree, &vine, DS_ITEM_OF(btree, object), object, 0);
+    }
+    ds_btree_vine_to_tree(btree, &vine);
+}
+
+static void ds_btree_bulk_span(ds_btree_bulk_t *chunks, int span);
+
+static void *ds_btree_bulk_run(void *_chunks)
+{
+    ds_btree_bulk_t *chunks = _chunks;
+    ds_btree_bulk_span(chunks, chunks->span);
+    return 0;
+}
+
+// Recursive function to build the btrees of `span` chunks and merge them into
+// the btree of the first chunk. The upper half of the chunks is run by a new
+// thread.
+static void ds_btree_bulk_span(ds_btree_bulk_t *chunks, int span)
+{
+    if (span == 1)
+    {
+        ds_btree_bulk_build(chunks);
+        return;
+    }
+    ds_btree_bulk_t *upper = chunks + span - span / 2;
+    upper->span = span / 2;
+    int started = pthread_create(&upper->thread, 0, ds_btree_bulk_run, upper) == 0;
+    if (!started)
+        ds_btree_bulk_span(upper, upper->span);
+    ds_btree_bulk_span(chunks, span - span / 2);
+    if (started)
+        pthread_join(upper->thread, 0);
+    // The objects of the lower chunks come first in the batch and are kept
+    size_t dropped = 0;
+    chunks->btree.root = ds_btree_node_union_parallel(&chunks->btree, chunks->btree.root, upper->btree.root, &dropped, span);
+    chunks->btree.count += upper->btree.count - dropped;
+}
+
+int ds_btree_bulk_insert(ds_btree_t *btree, void **objects, size_t count, int threads)
+{
+    // The subtrees are built with the items of the objects, that ext btrees
+    // don't have
+    if (btree->_offset_in_object == -1)
+        return -1;
+    if (count == 0)
+        return 0;
+    if ((size_t)threads > count / DS_BTREE_BULK_CHUNK_MIN)
+        threads = count / DS_BTREE_BULK_CHUNK_MIN;
+    if (threads < 1)
+        threads = 1;
+    void **scratch = malloc(count * sizeof(void *));
+    ds_btree_bulk_t *chunks = malloc(threads * sizeof(ds_btree_bulk_t));
+    if (scratch == 0 || chunks == 0)
+    {
+        free(scratch);
+        free(chunks);
+        return -1;
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        size_t low = count * i / threads;
+        size_t high = count * (i + 1) / threads;
+        chunks[i].btree = *btree;
+        chunks[i].btree.root = 0;
+        chunks[i].btree.count = 0;
+        chunks[i].objects = objects + low;
+        chunks[i].scratch = scratch + low;
+        chunks[i].count = high - low;
+    }
+    ds_btree_bulk_span(chunks, threads);
+    // The objects already in the btree are kept
+    size_t dropped = 0;
+    btree->root = ds_btree_node_union_parallel(btree, btree->root, chunks->btree.root, &dropped, threads);
+    btree->count += chunks->btree.count - dropped;
+    free(scratch);
+    free(chunks);
+    return 0;
 }
@@ -26,7 +26,19 @@
 #ifndef __DS_BTREE_H__
 #define __DS_BTREE_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "ds_common.h"
+#include "ds_fifo.h"
+#include "ds_dlist.h"
+
+/**
+ * @brief Upper bound of the height of a btree. An AVL tree of height h has at
+ * least fib(h + 2) - 1 nodes, so 96 levels are never reached with a 64 bits
+ * count of nodes.
+ */
+#define DS_BTREE_HEIGHT_MAX 96
 
 typedef struct ds_btree_item_s ds_btree_item_t;
 struct ds_btree_item_s
@@ -34,6 +46,7 @@ struct ds_btree_item_s
     ds_btree_item_t *left;
     ds_btree_item_t *right;
     int height;
+    unsigned int size;
 };
 
 /**
@@ -42,6 +55,12 @@ struct ds_btree_item_s
  */
 typedef int (*bs_btree_cmp_f)(void *, void *);
 
+/**
+ * @brief Function called on the objects dropped by the set operations
+ *
+ */
+typedef void (*ds_btree_drop_f)(void *);
+
 typedef struct ds_btree_s ds_btree_t;
 struct ds_btree_s
 {
@@ -49,9 +68,8 @@ struct ds_btree_s
     ds_btree_item_t *root;
     size_t _offset_in_object;
     bs_btree_cmp_f cmp;
-    ds_btree_item_t *_cmp_node;
-    void *_cmp_object;
-    ds_btree_item_t *_equal_node;
+    size_t _key_offset_in_object;
+    int _ranked;
 };
 
 /**
@@ -96,4 +114,479 @@ static inline void *ds_btree_remove_object(ds_btree_t *btree, void *object)
     return ds_btree_remove(btree, item);
 }
 
+/**
+ * @brief Find the object equal to a key. The comparison function is used with
+ * `key` as its first argument, so `key` needs not be linked in any btree.
+ *
+ * @param btree The btree
+ * @param key The key to look for
+ * @return The equal object or 0 if there is none
+ */
+void *ds_btree_find(ds_btree_t *btree, void *key);
+
+/**
+ * @brief Find the smallest object greater than or equal to a key
+ *
+ * @param btree The btree
+ * @param key The key to look for
+ * @return The object or 0 if there is none
+ */
+void *ds_btree_lower_bound(ds_btree_t *btree, void *key);
+
+/**
+ * @brief Find the smallest object strictly greater than a key
+ *
+ * @param btree The btree
+ * @param key The key to look for
+ * @return The object or 0 if there is none
+ */
+void *ds_btree_upper_bound(ds_btree_t *btree, void *key);
+
+/**
+ * @brief Find the greatest object less than or equal to a key
+ *
+ * @param btree The btree
+ * @param key The key to look for
+ * @return The object or 0 if there is none
+ */
+void *ds_btree_floor(ds_btree_t *btree, void *key);
+
+/**
+ * @brief Find the smallest object greater than or equal to a key. Same as
+ * ds_btree_lower_bound().
+ *
+ * @param btree The btree
+ * @param key The key to look for
+ * @return The object or 0 if there is none
+ */
+static inline void *ds_btree_ceil(ds_btree_t *btree, void *key)
+{
+    return ds_btree_lower_bound(btree, key);
+}
+
+/**
+ * @brief Build a perfectly balanced btree from an array of objects sorted in
+ * increasing order, in linear time and without calling the comparison
+ * function unless `verify` is set. The btree must be empty.
+ *
+ * @param btree The btree
+ * @param objects The sorted objects
+ * @param count Number of objects
+ * @param verify If set, check that the objects are strictly increasing
+ * @return 0, or -1 if the btree is not empty or the objects are not strictly
+ * increasing. The btree is left unchanged on error.
+ */
+int ds_btree_build_sorted(ds_btree_t *btree, void **objects, size_t count, int verify);
+
+/**
+ * @brief Build a perfectly balanced btree from the objects of a fifo, sorted
+ * in increasing order. The fifo is left unchanged. See
+ * ds_btree_build_sorted().
+ */
+int ds_btree_build_sorted_fifo(ds_btree_t *btree, ds_fifo_t *fifo, int verify);
+
+/**
+ * @brief Build a perfectly balanced btree from the objects of a dlist, sorted
+ * in increasing order. The dlist is left unchanged. See
+ * ds_btree_build_sorted().
+ */
+int ds_btree_build_sorted_dlist(ds_btree_t *btree, ds_dlist_t *dlist, int verify);
+
+/**
+ * @brief Insert a batch of objects into a btree with several threads. Each
+ * thread sorts a chunk of the batch and builds a subtree from it, then the
+ * subtrees and the btree are merged with parallel unions. As with
+ * ds_btree_insert(), an object equal to an object of the btree, or to a
+ * previous object of the batch, is not inserted. The caller can count the
+ * objects not inserted from the growth of the btree count, but can't learn
+ * which ones they are. The objects must not be in the btree already.
+ *
+ * @param btree The btree, not an ext btree
+ * @param objects The objects, reordered by the function
+ * @param count The number of objects
+ * @param threads The maximum number of threads, including the caller
+ * @return 0 or -1 if the btree is an ext btree or if the scratch memory can't
+ * be allocated
+ */
+int ds_btree_bulk_insert(ds_btree_t *btree, void **objects, size_t count, int threads);
+
+/**
+ * @brief Initialize a binary tree of objects ordered by an uint64_t key. The
+ * key is read at a fixed offset in the objects and compared inline, without
+ * calling any comparison function. The generic functions can be used on the
+ * btree too: their keys are then objects, or at least pointers such that the
+ * uint64_t key is at `key_offset_in_object`.
+ *
+ * @param btree The btree
+ * @param offset_in_object Offset of the ds_btree_item_t in the objects
+ * @param key_offset_in_object Offset of the uint64_t key in the objects
+ */
+void ds_btree_u64_init(ds_btree_t *btree, size_t offset_in_object, size_t key_offset_in_object);
+
+/**
+ * @brief Insert an object into an uint64_t keyed btree. See ds_btree_insert().
+ */
+void *ds_btree_u64_insert(ds_btree_t *btree, void *object);
+
+/**
+ * @brief Remove the object with the given key from an uint64_t keyed btree
+ *
+ * @param btree The btree
+ * @param key The key of the object to remove
+ * @return The removed object or 0 if there is none
+ */
+void *ds_btree_u64_remove(ds_btree_t *btree, uint64_t key);
+
+/**
+ * @brief Find the object with the given key in an uint64_t keyed btree
+ *
+ * @return The object or 0 if there is none
+ */
+void *ds_btree_u64_find(ds_btree_t *btree, uint64_t key);
+
+/**
+ * @brief Find the object with the smallest key greater than or equal to `key`
+ * in an uint64_t keyed btree
+ *
+ * @return The object or 0 if there is none
+ */
+void *ds_btree_u64_lower_bound(ds_btree_t *btree, uint64_t key);
+
+/**
+ * @brief Find the object with the smallest key strictly greater than `key` in
+ * an uint64_t keyed btree
+ *
+ * @return The object or 0 if there is none
+ */
+void *ds_btree_u64_upper_bound(ds_btree_t *btree, uint64_t key);
+
+/**
+ * @brief Find the object with the greatest key less than or equal to `key` in
+ * an uint64_t keyed btree
+ *
+ * @return The object or 0 if there is none
+ */
+void *ds_btree_u64_floor(ds_btree_t *btree, uint64_t key);
+
+/**
+ * @brief Maintain the number of items of each subtree, so that
+ * ds_btree_select() and ds_btree_rank() run in O(log n). The size is stored in
+ * the padding of the items and costs no memory, but insertions and removals
+ * then update it up to the root. A ranked btree holds at most UINT_MAX
+ * objects. If the btree is not empty, the sizes are computed in O(n).
+ *
+ * @param btree The btree
+ */
+void ds_btree_rank_enable(ds_btree_t *btree);
+
+/**
+ * @brief Get the object of a given rank in a ranked btree
+ *
+ * @param btree The btree
+ * @param rank The rank, from 0 for the smallest object to count - 1
+ * @return The object or 0 if rank is not less than the count of objects, or if
+ * the btree is not ranked
+ */
+void *ds_btree_select(ds_btree_t *btree, size_t rank);
+
+/**
+ * @brief Count the objects less than a key in a ranked btree. If an object
+ * equal to key exists, this is its rank.
+ *
+ * @param btree The btree
+ * @param key The key
+ * @return The number of objects strictly less than key, or the count of objects
+ * if the btree is not ranked
+ */
+size_t ds_btree_rank(ds_btree_t *btree, void *key);
+
+/**
+ * @brief Move all objects of `right` at the end of `btree`. Every object of
+ * `btree` must be smaller than every object of `right`. The btrees must be
+ * initialized the same way, and `right` is left empty. O(log n).
+ *
+ * @param btree The btree
+ * @param right The btree of the greater objects
+ * @return 0 or -1 if the btrees are not compatible or not ordered
+ */
+int ds_btree_join(ds_btree_t *btree, ds_btree_t *right);
+
+/**
+ * @brief Move the objects greater than or equal to `key` from `btree` to
+ * `right`. `right` is initialized as `btree`. The moved objects are counted
+ * with the subtree sizes, so the btree is ranked first if it is not (see
+ * ds_btree_rank_enable(), O(n) once). O(log n) on a ranked btree.
+ *
+ * @param btree The btree
+ * @param key The key, first argument of the comparison function
+ * @param right The btree receiving the greater objects
+ */
+void ds_btree_split(ds_btree_t *btree, void *key, ds_btree_t *right);
+
+/**
+ * @brief Move the objects in [low, high) from `btree` to `range`. `range` is
+ * initialized as `btree`. The moved objects are counted with the subtree
+ * sizes, so the btree is ranked first if it is not (see
+ * ds_btree_rank_enable(), O(n) once). O(log n) on a ranked btree.
+ *
+ * @param btree The btree
+ * @param low The lowest key of the range, included
+ * @param high The highest key of the range, excluded
+ * @param range The btree receiving the range
+ */
+void ds_btree_extract_range(ds_btree_t *btree, void *low, void *high, ds_btree_t *range);
+
+/**
+ * @brief Move all objects of `other` into `btree`. The objects of `other`
+ * equal to an object of `btree` are dropped. `other` is left empty. The nodes
+ * are reused and the cost is O(m log(n / m + 1)) for sizes m <= n.
+ *
+ * @param btree The btree
+ * @param other The other btree, initialized as `btree`
+ * @param drop If not 0, called on the dropped objects
+ * @return 0 or -1 if the btrees are not compatible
+ */
+int ds_btree_union(ds_btree_t *btree, ds_btree_t *other, ds_btree_drop_f drop);
+
+/**
+ * @brief Remove from `btree` the objects with no equal object in `other`.
+ * `other` keeps its objects but its shape may change. O(m log(n / m + 1)),
+ * plus a walk of the removed objects if `drop` is set.
+ *
+ * @param btree The btree
+ * @param other The other btree, initialized as `btree`
+ * @param drop If not 0, called on the objects removed from `btree`
+ * @return 0 or -1 if the btrees are not compatible
+ */
+int ds_btree_intersection(ds_btree_t *btree, ds_btree_t *other, ds_btree_drop_f drop);
+
+/**
+ * @brief Remove from `btree` the objects with an equal object in `other`.
+ * `other` keeps its objects but its shape may change. O(m log(n / m + 1)).
+ *
+ * @param btree The btree
+ * @param other The other btree, initialized as `btree`
+ * @param drop If not 0, called on the objects removed from `btree`
+ * @return 0 or -1 if the btrees are not compatible
+ */
+int ds_btree_difference(ds_btree_t *btree, ds_btree_t *other, ds_btree_drop_f drop);
+
+/**
+ * @brief Ordered position in a btree, intrusive or ext. The cursor keeps the
+ * path from the root to the current item, so moving to the next or previous
+ * object costs O(1) amortized and no comparison.
+ *
+ * A cursor is invalidated by any modification of the btree, except by
+ * ds_btree_cursor_remove() on this cursor. To resume a scan after
+ * modifications, seek again to the last object returned.
+ */
+typedef struct ds_btree_cursor_s ds_btree_cursor_t;
+struct ds_btree_cursor_s
+{
+    ds_btree_t *btree;
+    int depth;
+    ds_btree_item_t *path[DS_BTREE_HEIGHT_MAX];
+};
+
+/**
+ * @brief Position a cursor on the smallest object of a btree
+ *
+ * @param cursor The cursor
+ * @param btree The btree
+ * @return The object or 0 if the btree is empty
+ */
+void *ds_btree_cursor_first(ds_btree_cursor_t *cursor, ds_btree_t *btree);
+
+/**
+ * @brief Position a cursor on the greatest object of a btree
+ *
+ * @param cursor The cursor
+ * @param btree The btree
+ * @return The object or 0 if the btree is empty
+ */
+void *ds_btree_cursor_last(ds_btree_cursor_t *cursor, ds_btree_t *btree);
+
+/**
+ * @brief Position a cursor on the smallest object greater than or equal to a
+ * key
+ *
+ * @param cursor The cursor
+ * @param btree The btree
+ * @param key The key, first argument of the comparison function
+ * @return The object or 0 if there is none
+ */
+void *ds_btree_cursor_seek(ds_btree_cursor_t *cursor, ds_btree_t *btree, void *key);
+
+/**
+ * @brief Move a cursor to the next object
+ *
+ * @param cursor The cursor
+ * @return The object or 0 past the greatest object. The cursor is then at the
+ * end and stays there.
+ */
+void *ds_btree_cursor_next(ds_btree_cursor_t *cursor);
+
+/**
+ * @brief Move a cursor to the previous object
+ *
+ * @param cursor The cursor
+ * @return The object or 0 before the smallest object. The cursor is then at
+ * the end and stays there.
+ */
+void *ds_btree_cursor_prev(ds_btree_cursor_t *cursor);
+
+/**
+ * @brief Get the current object of a cursor
+ *
+ * @param cursor The cursor
+ * @return The object or 0 if the cursor is at the end
+ */
+void *ds_btree_cursor_object(ds_btree_cursor_t *cursor);
+
+/**
+ * @brief Remove the current object of a cursor from the btree and move the
+ * cursor to the next object
+ *
+ * @param cursor The cursor
+ * @return The removed object or 0 if the cursor is at the end
+ */
+void *ds_btree_cursor_remove(ds_btree_cursor_t *cursor);
+
+/**
+ * @brief Link an item at the end of a descent and rebalance the btree. No
+ * comparison function is called. This is the second half of an insertion,
+ * used by specialized btrees which perform the descent themselves.
+ *
+ * @param btree The btree
+ * @param path The father sons visited by the descent, from `&btree->root`
+ * @param depth Number of father sons in `path`
+ * @param father_son The null father son where the descent ended
+ * @param item The item to insert
+ */
+void ds_btree_path_insert(ds_btree_t *btree, ds_btree_item_t ***path, int depth, ds_btree_item_t **father_son, ds_btree_item_t *item);
+
+/**
+ * @brief Unlink the item found by a descent and rebalance the btree. No
+ * comparison function is called. This is the second half of a removal, used
+ * by specialized btrees which perform the descent themselves.
+ *
+ * @param btree The btree
+ * @param path The father sons visited by the descent, from `&btree->root`.
+ * The array must have DS_BTREE_HEIGHT_MAX entries as the path is extended to
+ * the successor of the item.
+ * @param depth Number of father sons in `path`
+ * @param father_son The father son of the item to remove
+ */
+void ds_btree_path_remove(ds_btree_t *btree, ds_btree_item_t ***path, int depth, ds_btree_item_t **father_son);
+
+/**
+ * @brief Define functions specialized for a type of object. The offset of the
+ * item in the object is a constant and the comparison function is called
+ * directly, so the compiler can inline both in the descents.
+ *
+ * The btree is initialized with ds_btree_init() as usual and generic and
+ * specialized functions can be mixed. The defined functions are
+ * `_name##_insert`, `_name##_remove`, `_name##_find`, `_name##_lower_bound`,
+ * `_name##_upper_bound`, `_name##_floor` and `_name##_object_of`.
+ *
+ * @param _name Prefix of the defined functions
+ * @param _type_t Type of the objects
+ * @param _member Name of the ds_btree_item_t member of _type_t
+ * @param _cmp Comparison function, preferably static inline, taking two
+ * pointers to _type_t
+ */
+#define DS_BTREE_DEFINE(_name, _type_t, _member, _cmp)                                     \
+    static inline _type_t *_name##_object_of(ds_btree_item_t *item)                        \
+    {                                                                                      \
+        return (_type_t *)((char *)item - offsetof(_type_t, _member));                     \
+    }                                                                                      \
+                                                                                           \
+    static inline _type_t *_name##_insert(ds_btree_t *btree, _type_t *object)              \
+    {                                                                                      \
+        ds_btree_item_t **path[DS_BTREE_HEIGHT_MAX];                                       \
+        ds_btree_item_t **father_son = &btree->root;                                       \
+        int depth = 0;                                                                     \
+        while (*father_son != 0)                                                           \
+        {                                                                                  \
+            ds_btree_item_t *node = *father_son;                                           \
+            int cmp = _cmp(object, _name##_object_of(node));                               \
+            if (cmp == 0)                                                                  \
+                return _name##_object_of(node);                                            \
+            path[depth++] = father_son;                                                    \
+            father_son = cmp < 0 ? &node->left : &node->right;                             \
+        }                                                                                  \
+        ds_btree_path_insert(btree, path, depth, father_son, &object->_member);            \
+        return object;                                                                     \
+    }                                                                                      \
+                                                                                           \
+    static inline _type_t *_name##_remove(ds_btree_t *btree, _type_t *object)              \
+    {                                                                                      \
+        ds_btree_item_t **path[DS_BTREE_HEIGHT_MAX];                                       \
+        ds_btree_item_t **father_son = &btree->root;                                       \
+        int depth = 0;                                                                     \
+        while (*father_son != 0)                                                           \
+        {                                                                                  \
+            ds_btree_item_t *node = *father_son;                                           \
+            int cmp = _cmp(object, _name##_object_of(node));                               \
+            if (cmp == 0)                                                                  \
+            {                                                                              \
+                ds_btree_path_remove(btree, path, depth, father_son);                      \
+                return _name##_object_of(node);                                            \
+            }                                                                              \
+            path[depth++] = father_son;                                                    \
+            father_son = cmp < 0 ? &node->left : &node->right;                             \
+        }                                                                                  \
+        return 0;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    static inline _type_t *_name##_find(ds_btree_t *btree, _type_t *key)                   \
+    {                                                                                      \
+        ds_btree_item_t *node = btree->root;                                               \
+        while (node != 0)                                                                  \
+        {                                                                                  \
+            int cmp = _cmp(key, _name##_object_of(node));                                  \
+            if (cmp == 0)                                                                  \
+                return _name##_object_of(node);                                            \
+            node = cmp < 0 ? node->left : node->right;                                     \
+        }                                                                                  \
+        return 0;                                                                          \
+    }                                                                                      \
+                                                                                           \
+    /* Smallest object after key (`before` = 0) or greatest object before key */          \
+    static inline _type_t *_name##_bound(ds_btree_t *btree, _type_t *key, int before,      \
+                                         int or_equal)                                     \
+    {                                                                                      \
+        ds_btree_item_t *node = btree->root;                                               \
+        ds_btree_item_t *found = 0;                                                        \
+        while (node != 0)                                                                  \
+        {                                                                                  \
+            int cmp = _cmp(key, _name##_object_of(node));                                  \
+            if (cmp == 0 && or_equal)                                                      \
+                return _name##_object_of(node);                                            \
+            if (before ? cmp > 0 : cmp < 0)                                                \
+            {                                                                              \
+                found = node;                                                              \
+                node = before ? node->right : node->left;                                  \
+            }                                                                              \
+            else                                                                           \
+                node = before ? node->left : node->right;                                  \
+        }                                                                                  \
+        return found ? _name##_object_of(found) : 0;                                       \
+    }                                                                                      \
+                                                                                           \
+    static inline _type_t *_name##_lower_bound(ds_btree_t *btree, _type_t *key)            \
+    {                                                                                      \
+        return _name##_bound(btree, key, 0, 1);                                            \
+    }                                                                                      \
+                                                                                           \
+    static inline _type_t *_name##_upper_bound(ds_btree_t *btree, _type_t *key)            \
+    {                                                                                      \
+        return _name##_bound(btree, key, 0, 0);                                            \
+    }                                                                                      \
+                                                                                           \
+    static inline _type_t *_name##_floor(ds_btree_t *btree, _type_t *key)                  \
+    {                                                                                      \
+        return _name##_bound(btree, key, 1, 1);                                            \
+    }
+
 #endif // __DS_BTREE_H__
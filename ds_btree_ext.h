@@ -36,6 +36,7 @@ struct ds_btree_ext_item_s
     ds_btree_ext_item_t *left;
     ds_btree_ext_item_t *right;
     int height;
+    unsigned int size;
     void *object;
 };
 
@@ -71,4 +72,73 @@ void *ds_btree_ext_insert(ds_btree_t *btree, ds_btree_ext_item_t *item, void *ob
  */
 void *ds_btree_ext_remove(ds_btree_t *btree, ds_btree_ext_item_t *item);
 
+/**
+ * @brief Build a perfectly balanced ext btree from an array of objects sorted
+ * in increasing order. `items[i]` is associated with `objects[i]`. See
+ * ds_btree_build_sorted().
+ */
+int ds_btree_ext_build_sorted(ds_btree_ext_t *btree, ds_btree_ext_item_t *items, void **objects, size_t count, int verify);
+
+/**
+ * @brief Find the object equal to a key. See ds_btree_find().
+ */
+static inline void *ds_btree_ext_find(ds_btree_ext_t *btree, void *key)
+{
+    return ds_btree_find(btree, key);
+}
+
+/**
+ * @brief Find the smallest object greater than or equal to a key. See
+ * ds_btree_lower_bound().
+ */
+static inline void *ds_btree_ext_lower_bound(ds_btree_ext_t *btree, void *key)
+{
+    return ds_btree_lower_bound(btree, key);
+}
+
+/**
+ * @brief Find the smallest object strictly greater than a key. See
+ * ds_btree_upper_bound().
+ */
+static inline void *ds_btree_ext_upper_bound(ds_btree_ext_t *btree, void *key)
+{
+    return ds_btree_upper_bound(btree, key);
+}
+
+/**
+ * @brief Find the greatest object less than or equal to a key. See
+ * ds_btree_floor().
+ */
+static inline void *ds_btree_ext_floor(ds_btree_ext_t *btree, void *key)
+{
+    return ds_btree_floor(btree, key);
+}
+
+/**
+ * @brief Find the smallest object greater than or equal to a key. See
+ * ds_btree_ceil().
+ */
+static inline void *ds_btree_ext_ceil(ds_btree_ext_t *btree, void *key)
+{
+    return ds_btree_lower_bound(btree, key);
+}
+
+/**
+ * @brief Get the object of a given rank in a ranked btree. See
+ * ds_btree_select().
+ */
+static inline void *ds_btree_ext_select(ds_btree_ext_t *btree, size_t rank)
+{
+    return ds_btree_select(btree, rank);
+}
+
+/**
+ * @brief Count the objects less than a key in a ranked btree. See
+ * ds_btree_rank().
+ */
+static inline size_t ds_btree_ext_rank(ds_btree_ext_t *btree, void *key)
+{
+    return ds_btree_rank(btree, key);
+}
+
 #endif // __DS_BTREE_EXT_H__
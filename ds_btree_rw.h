@@ -0,0 +1,186 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_BTREE_RW_H__
+#define __DS_BTREE_RW_H__
+
+#include <pthread.h>
+
+#include "ds_btree.h"
+#include "ds_btree_ext.h"
+
+/**
+ * @brief A btree shared between threads. Lookups take a read lock and run in
+ * parallel, insertions and removals take the write lock. Lookups keep no state
+ * in the btree, so the comparison function may itself search the btree.
+ *
+ * An object returned by a lookup is no longer protected once the lock is
+ * released: use ds_btree_rw_rdlock() around the lookup and the use of the
+ * object if a writer may remove and release it meanwhile.
+ */
+typedef struct ds_btree_rw_s ds_btree_rw_t;
+struct ds_btree_rw_s
+{
+    ds_btree_t btree;
+    pthread_rwlock_t lock;
+};
+
+static inline void ds_btree_rw_init(ds_btree_rw_t *rw, size_t offset_in_object, bs_btree_cmp_f cmp)
+{
+    ds_btree_init(&rw->btree, offset_in_object, cmp);
+    pthread_rwlock_init(&rw->lock, 0);
+}
+
+static inline void ds_btree_rw_ext_init(ds_btree_rw_t *rw, bs_btree_cmp_f cmp)
+{
+    ds_btree_ext_init(&rw->btree, cmp);
+    pthread_rwlock_init(&rw->lock, 0);
+}
+
+static inline void ds_btree_rw_destroy(ds_btree_rw_t *rw)
+{
+    pthread_rwlock_destroy(&rw->lock);
+}
+
+/**
+ * @brief Lock the btree for several lookups. The unlocked functions of
+ * ds_btree.h are then used on `&rw->btree`.
+ */
+static inline void ds_btree_rw_rdlock(ds_btree_rw_t *rw)
+{
+    pthread_rwlock_rdlock(&rw->lock);
+}
+
+/**
+ * @brief Lock the btree for several modifications. The unlocked functions of
+ * ds_btree.h are then used on `&rw->btree`.
+ */
+static inline void ds_btree_rw_wrlock(ds_btree_rw_t *rw)
+{
+    pthread_rwlock_wrlock(&rw->lock);
+}
+
+static inline void ds_btree_rw_unlock(ds_btree_rw_t *rw)
+{
+    pthread_rwlock_unlock(&rw->lock);
+}
+
+/**
+ * @brief Insert an object under the write lock. See ds_btree_insert().
+ */
+static inline void *ds_btree_rw_insert(ds_btree_rw_t *rw, void *object)
+{
+    ds_btree_rw_wrlock(rw);
+    void *equal = ds_btree_insert(&rw->btree, object);
+    ds_btree_rw_unlock(rw);
+    return equal;
+}
+
+/**
+ * @brief Remove an object under the write lock. See ds_btree_remove_object().
+ */
+static inline void *ds_btree_rw_remove_object(ds_btree_rw_t *rw, void *object)
+{
+    ds_btree_rw_wrlock(rw);
+    void *removed = ds_btree_remove_object(&rw->btree, object);
+    ds_btree_rw_unlock(rw);
+    return removed;
+}
+
+/**
+ * @brief Insert an object under the write lock. See ds_btree_ext_insert().
+ */
+static inline void *ds_btree_rw_ext_insert(ds_btree_rw_t *rw, ds_btree_ext_item_t *item, void *object)
+{
+    ds_btree_rw_wrlock(rw);
+    void *equal = ds_btree_ext_insert(&rw->btree, item, object);
+    ds_btree_rw_unlock(rw);
+    return equal;
+}
+
+/**
+ * @brief Remove an item under the write lock. See ds_btree_ext_remove().
+ */
+static inline void *ds_btree_rw_ext_remove(ds_btree_rw_t *rw, ds_btree_ext_item_t *item)
+{
+    ds_btree_rw_wrlock(rw);
+    void *removed = ds_btree_ext_remove(&rw->btree, item);
+    ds_btree_rw_unlock(rw);
+    return removed;
+}
+
+/**
+ * @brief Find an object under a read lock. See ds_btree_find().
+ */
+static inline void *ds_btree_rw_find(ds_btree_rw_t *rw, void *key)
+{
+    ds_btree_rw_rdlock(rw);
+    void *found = ds_btree_find(&rw->btree, key);
+    ds_btree_rw_unlock(rw);
+    return found;
+}
+
+/**
+ * @brief Find an object under a read lock. See ds_btree_lower_bound().
+ */
+static inline void *ds_btree_rw_lower_bound(ds_btree_rw_t *rw, void *key)
+{
+    ds_btree_rw_rdlock(rw);
+    void *found = ds_btree_lower_bound(&rw->btree, key);
+    ds_btree_rw_unlock(rw);
+    return found;
+}
+
+/**
+ * @brief Find an object under a read lock. See ds_btree_upper_bound().
+ */
+static inline void *ds_btree_rw_upper_bound(ds_btree_rw_t *rw, void *key)
+{
+    ds_btree_rw_rdlock(rw);
+    void *found = ds_btree_upper_bound(&rw->btree, key);
+    ds_btree_rw_unlock(rw);
+    return found;
+}
+
+/**
+ * @brief Find an object under a read lock. See ds_btree_floor().
+ */
+static inline void *ds_btree_rw_floor(ds_btree_rw_t *rw, void *key)
+{
+    ds_btree_rw_rdlock(rw);
+    void *found = ds_btree_floor(&rw->btree, key);
+    ds_btree_rw_unlock(rw);
+    return found;
+}
+
+/**
+ * @brief Find an object under a read lock. See ds_btree_ceil().
+ */
+static inline void *ds_btree_rw_ceil(ds_btree_rw_t *rw, void *key)
+{
+    return ds_btree_rw_lower_bound(rw, key);
+}
+
+#endif // __DS_BTREE_RW_H__
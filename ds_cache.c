@@ -0,0 +1,201 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "ds_cache.h"
+
+#define DS_CACHE_ITEM_OF(_cache, _object) ((ds_cache_item_t *)((char *)(_object) + (_cache)->_offset_in_object))
+
+static void ds_cache_unlink(ds_cache_t *cache, void *object)
+{
+    ds_dlist_remove(&cache->recency, object);
+    ds_htable_remove(&cache->index, object);
+    cache->count--;
+    cache->bytes -= DS_CACHE_ITEM_OF(cache, object)->bytes;
+}
+
+// Evict from the back of the recency list, but never `inserted`. In CLOCK
+// mode, a referenced object is moved to the front instead, so at most one pass
+// over the list clears the marks before an object is evicted. If that pass
+// moved all the other objects ahead of `inserted`, it is moved to the front
+// too.
+static void ds_cache_shrink(ds_cache_t *cache, void *inserted)
+{
+    while (cache->count > 1 && ((cache->max_count && cache->count > cache->max_count) || (cache->max_bytes && cache->bytes > cache->max_bytes)))
+    {
+        void *object = DS_OBJECT_OF(&cache->recency, cache->recency.last);
+        ds_cache_item_t *item = DS_CACHE_ITEM_OF(cache, object);
+        if (object == inserted || (cache->mode == DS_CACHE_CLOCK && item->referenced))
+        {
+            item->referenced = 0;
+            ds_dlist_remove(&cache->recency, object);
+            ds_dlist_push(&cache->recency, object);
+            continue;
+        }
+        ds_cache_unlink(cache, object);
+        if (cache->evict)
+            cache->evict(object);
+    }
+}
+
+int ds_cache_init(ds_cache_t *cache, size_t offset_in_object, ds_htable_hash_f hash, ds_htable_eq_f eq,
+                  size_t max_count, size_t max_bytes, int mode, ds_cache_evict_f evict)
+{
+    cache->count = 0;
+    cache->bytes = 0;
+    cache->_offset_in_object = offset_in_object;
+    cache->max_count = max_count;
+    cache->max_bytes = max_bytes;
+    cache->mode = mode;
+    cache->evict = evict;
+    ds_dlist_init(&cache->recency, offset_in_object + offsetof(ds_cache_item_t, dlist_item));
+    return ds_htable_init(&cache->index, offset_in_object + offsetof(ds_cache_item_t, htable_item), hash, eq, max_count);
+}
+
+void ds_cache_destroy(ds_cache_t *cache)
+{
+    while (cache->recency.root)
+    {
+        void *object = DS_OBJECT_OF(&cache->recency, cache->recency.root);
+        ds_cache_unlink(cache, object);
+        if (cache->evict)
+            cache->evict(object);
+    }
+    ds_htable_destroy(&cache->index);
+}
+
+void *ds_cache_insert(ds_cache_t *cache, void *object, size_t bytes)
+{
+    // The object itself may already be in the cache
+    size_t count = cache->index.count;
+    void *equal = ds_htable_insert(&cache->index, object);
+    if (cache->index.count == count)
+        return equal;
+    ds_cache_item_t *item = DS_CACHE_ITEM_OF(cache, object);
+    item->bytes = bytes;
+    item->referenced = 0;
+    ds_dlist_push(&cache->recency, object);
+    cache->count++;
+    cache->bytes += bytes;
+    ds_cache_shrink(cache, object);
+    return object;
+}
+
+void *ds_cache_find(ds_cache_t *cache, void *key)
+{
+    void *object = ds_htable_find(&cache->index, key);
+    if (object == 0)
+        return 0;
+    if (cache->mode == DS_CACHE_CLOCK)
+    {
+        // Readers of a hot object do not write its cache line once marked
+        ds_cache_item_t *item = DS_CACHE_ITEM_OF(cache, object);
+        if (!__atomic_load_n(&item->referenced, __ATOMIC_RELAXED))
+            __atomic_store_n(&item->referenced, 1, __ATOMIC_RELAXED);
+    }
+    else if (cache->recency.root != DS_ITEM_OF(&cache->recency, object))
+    {
+        ds_dlist_remove(&cache->recency, object);
+        ds_dlist_push(&cache->recency, object);
+    }
+    return object;
+}
+
+void *ds_cache_remove(ds_cache_t *cache, void *key)
+{
+    void *object = ds_htable_find(&cache->index, key);
+    if (object)
+        ds_cache_unlink(cache, object);
+    return object;
+}
+
+int ds_cache_sharded_init(ds_cache_sharded_t *sharded, size_t shard_count, size_t offset_in_object,
+                          ds_htable_hash_f hash, ds_htable_eq_f eq, size_t max_count, size_t max_bytes,
+                          int mode, ds_cache_evict_f evict)
+{
+    sharded->shards = aligned_alloc(DS_CACHE_LINE_SIZE, shard_count * sizeof(ds_cache_shard_t));
+    if (sharded->shards == 0)
+        return -1;
+    sharded->shard_count = shard_count;
+    sharded->hash = hash;
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        ds_cache_shard_t *shard = &sharded->shards[i];
+        // A bound is rounded up to keep it non zero
+        size_t shard_max_count = (max_count + shard_count - 1) / shard_count;
+        size_t shard_max_bytes = (max_bytes + shard_count - 1) / shard_count;
+        if (ds_cache_init(&shard->cache, offset_in_object, hash, eq, shard_max_count, shard_max_bytes, mode, evict) == -1)
+        {
+            sharded->shard_count = i;
+            ds_cache_sharded_destroy(sharded);
+            return -1;
+        }
+        pthread_rwlock_init(&shard->lock, 0);
+    }
+    return 0;
+}
+
+void ds_cache_sharded_destroy(ds_cache_sharded_t *sharded)
+{
+    for (size_t i = 0; i < sharded->shard_count; i++)
+    {
+        ds_cache_destroy(&sharded->shards[i].cache);
+        pthread_rwlock_destroy(&sharded->shards[i].lock);
+    }
+    free(sharded->shards);
+    sharded->shards = 0;
+    sharded->shard_count = 0;
+}
+
+void *ds_cache_sharded_insert(ds_cache_sharded_t *sharded, void *object, size_t bytes)
+{
+    ds_cache_shard_t *shard = ds_cache_sharded_shard(sharded, object);
+    pthread_rwlock_wrlock(&shard->lock);
+    void *equal = ds_cache_insert(&shard->cache, object, bytes);
+    pthread_rwlock_unlock(&shard->lock);
+    return equal;
+}
+
+void *ds_cache_sharded_find(ds_cache_sharded_t *sharded, void *key)
+{
+    ds_cache_shard_t *shard = ds_cache_sharded_shard(sharded, key);
+    if (shard->cache.mode == DS_CACHE_CLOCK)
+        pthread_rwlock_rdlock(&shard->lock);
+    else
+        pthread_rwlock_wrlock(&shard->lock);
+    void *found = ds_cache_find(&shard->cache, key);
+    pthread_rwlock_unlock(&shard->lock);
+    return found;
+}
+
+void *ds_cache_sharded_remove(ds_cache_sharded_t *sharded, void *key)
+{
+    ds_cache_shard_t *shard = ds_cache_sharded_shard(sharded, key);
+    pthread_rwlock_wrlock(&shard->lock);
+    void *removed = ds_cache_remove(&shard->cache, key);
+    pthread_rwlock_unlock(&shard->lock);
+    return removed;
+}
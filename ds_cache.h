@@ -0,0 +1,207 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_CACHE_H__
+#define __DS_CACHE_H__
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "ds_common.h"
+#include "ds_dlist.h"
+#include "ds_htable.h"
+
+/**
+ * @brief Eviction policies. DS_CACHE_LRU moves an object to the front of the
+ * recency list on each hit. DS_CACHE_CLOCK only marks it as referenced: the
+ * eviction gives a referenced object a second chance, moving it to the front
+ * and clearing its mark.
+ */
+#define DS_CACHE_LRU 0
+#define DS_CACHE_CLOCK 1
+
+typedef struct ds_cache_item_s ds_cache_item_t;
+struct ds_cache_item_s
+{
+    ds_htable_item_t htable_item;
+    ds_dlist_item_t dlist_item;
+    size_t bytes;
+    int referenced;
+};
+
+/**
+ * @brief Eviction function prototype, called on each evicted object
+ *
+ */
+typedef void (*ds_cache_evict_f)(void *);
+
+/**
+ * @brief A cache of objects with unique keys, bounded by a number of objects
+ * and a number of bytes. The objects are indexed by a ds_htable and ordered
+ * from the most to the least recently used in a ds_dlist. Lookups, insertions
+ * and removals are O(1).
+ */
+typedef struct ds_cache_s ds_cache_t;
+struct ds_cache_s
+{
+    size_t count;
+    size_t bytes;
+    size_t _offset_in_object;
+    size_t max_count;
+    size_t max_bytes;
+    int mode;
+    ds_cache_evict_f evict;
+    ds_htable_t index;
+    ds_dlist_t recency;
+};
+
+/**
+ * @brief Initialize a cache
+ *
+ * @param cache The cache
+ * @param offset_in_object Offset of the ds_cache_item_t in the objects
+ * @param hash Hash function of the objects
+ * @param eq Equality function between objects
+ * @param max_count Maximum number of objects, 0 for no limit
+ * @param max_bytes Maximum sum of the sizes of the objects, 0 for no limit
+ * @param mode DS_CACHE_LRU or DS_CACHE_CLOCK
+ * @param evict Function called on each evicted object, or 0
+ * @return 0 on success, -1 if the index cannot be allocated
+ */
+int ds_cache_init(ds_cache_t *cache, size_t offset_in_object, ds_htable_hash_f hash, ds_htable_eq_f eq,
+                  size_t max_count, size_t max_bytes, int mode, ds_cache_evict_f evict);
+
+/**
+ * @brief Evict all the objects and free the index of a cache
+ *
+ * @param cache The cache
+ */
+void ds_cache_destroy(ds_cache_t *cache);
+
+/**
+ * @brief Insert an object as the most recently used one, then evict the least
+ * recently used objects until the cache is within its bounds. The inserted
+ * object is never evicted by its own insertion.
+ *
+ * @param cache The cache
+ * @param object The object
+ * @param bytes Size of the object, counted against `max_bytes`
+ * @return If `object` has no equal object in the cache, the object is
+ * inserted and the function returns `object`. Otherwise, it is not inserted
+ * and the function returns the equal object.
+ */
+void *ds_cache_insert(ds_cache_t *cache, void *object, size_t bytes);
+
+/**
+ * @brief Find the object equal to a key and record the hit. In CLOCK mode,
+ * the hit is only a relaxed atomic store of the referenced mark, so finds can
+ * run concurrently.
+ *
+ * @param cache The cache
+ * @param key The key to look for
+ * @return The equal object or 0 if there is none
+ */
+void *ds_cache_find(ds_cache_t *cache, void *key);
+
+/**
+ * @brief Remove the object equal to a key. The eviction function is not
+ * called.
+ *
+ * @param cache The cache
+ * @param key The key to look for
+ * @return The removed object or 0 if there is none
+ */
+void *ds_cache_remove(ds_cache_t *cache, void *key);
+
+/**
+ * @brief A cache shared between threads, split in shards by the hash of the
+ * keys. Each shard is a cache with its own lock and its share of the bounds.
+ * Finds take a read lock in CLOCK mode and the write lock in LRU mode.
+ * Insertions and removals take the write lock.
+ *
+ * An object returned by a find is no longer protected once the lock is
+ * released: lock the shard of the key around the find and the use of the
+ * object if another thread may evict and release it meanwhile.
+ */
+typedef struct ds_cache_shard_s ds_cache_shard_t;
+struct ds_cache_shard_s
+{
+    _Alignas(DS_CACHE_LINE_SIZE) pthread_rwlock_t lock;
+    ds_cache_t cache;
+};
+
+typedef struct ds_cache_sharded_s ds_cache_sharded_t;
+struct ds_cache_sharded_s
+{
+    size_t shard_count;
+    ds_cache_shard_t *shards;
+    ds_htable_hash_f hash;
+};
+
+/**
+ * @brief Initialize a sharded cache. The bounds are split evenly between the
+ * shards. See ds_cache_init().
+ *
+ * @param shard_count Number of shards
+ * @return 0 on success, -1 if the shards cannot be allocated
+ */
+int ds_cache_sharded_init(ds_cache_sharded_t *sharded, size_t shard_count, size_t offset_in_object,
+                          ds_htable_hash_f hash, ds_htable_eq_f eq, size_t max_count, size_t max_bytes,
+                          int mode, ds_cache_evict_f evict);
+
+/**
+ * @brief Evict all the objects and free the shards of a sharded cache
+ */
+void ds_cache_sharded_destroy(ds_cache_sharded_t *sharded);
+
+/**
+ * @brief Get the shard of a key, to lock it with `shard->lock` and use the
+ * functions of ds_cache.h on `&shard->cache`
+ */
+static inline ds_cache_shard_t *ds_cache_sharded_shard(ds_cache_sharded_t *sharded, void *key)
+{
+    uint64_t hash = sharded->hash(key);
+    // The high bits, the low ones select the buckets of the shard
+    return &sharded->shards[((hash >> 32) * sharded->shard_count) >> 32];
+}
+
+/**
+ * @brief Insert an object under the write lock of its shard. See
+ * ds_cache_insert().
+ */
+void *ds_cache_sharded_insert(ds_cache_sharded_t *sharded, void *object, size_t bytes);
+
+/**
+ * @brief Find an object under the lock of its shard. See ds_cache_find().
+ */
+void *ds_cache_sharded_find(ds_cache_sharded_t *sharded, void *key);
+
+/**
+ * @brief Remove an object under the write lock of its shard. See
+ * ds_cache_remove().
+ */
+void *ds_cache_sharded_remove(ds_cache_sharded_t *sharded, void *key);
+
+#endif // __DS_CACHE_H__
@@ -0,0 +1,125 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_CHUNK_H__
+#define __DS_CHUNK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ds_common.h"
+#include "ds_heap.h"
+
+/**
+ * @brief Number of object pointers in a chunk, so that a chunk is 512 bytes
+ * on 64 bits architectures
+ */
+#define DS_CHUNK_NMEMB 61
+
+/**
+ * @brief Chunk of object pointers of the unrolled fifo, lifo and dlist. The
+ * objects of a chunk are `object[begin]` to `object[end - 1]`. Chunks are
+ * taken from a ds_heap_t of ds_chunk_t, which can be shared by several
+ * unrolled lists of any kind.
+ */
+typedef struct ds_chunk_s ds_chunk_t;
+struct ds_chunk_s
+{
+    ds_chunk_t *next;
+    ds_chunk_t *prev;
+    uint32_t begin;
+    uint32_t end;
+    void *object[DS_CHUNK_NMEMB];
+};
+
+/**
+ * @brief Position of an object in the chunks of an unrolled list
+ */
+typedef struct ds_chunk_iter_s ds_chunk_iter_t;
+struct ds_chunk_iter_s
+{
+    ds_chunk_t *chunk;
+    uint32_t index;
+};
+
+/**
+ * @brief Take an empty chunk from a heap
+ *
+ * @param heap The heap of ds_chunk_t
+ * @param begin The index of the first object to add in the chunk
+ * @return The chunk or 0 if the heap is exhausted
+ */
+static inline ds_chunk_t *ds_chunk_alloc(ds_heap_t *heap, uint32_t begin)
+{
+    ds_chunk_t *chunk = ds_heap_alloc(heap);
+    if (!chunk)
+        return 0;
+    chunk->next = 0;
+    chunk->prev = 0;
+    chunk->begin = begin;
+    chunk->end = begin;
+    return chunk;
+}
+
+/**
+ * @brief Move an iterator to the next object, following the next chunks
+ *
+ * @return The object or 0 at the end of the list
+ */
+static inline void *ds_chunk_iter_next(ds_chunk_iter_t *iter)
+{
+    if (!iter->chunk)
+        return 0;
+    if (++iter->index == iter->chunk->end)
+    {
+        iter->chunk = iter->chunk->next;
+        if (!iter->chunk)
+            return 0;
+        iter->index = iter->chunk->begin;
+    }
+    return iter->chunk->object[iter->index];
+}
+
+/**
+ * @brief Move an iterator to the previous object, following the previous
+ * chunks
+ *
+ * @return The object or 0 at the beginning of the list
+ */
+static inline void *ds_chunk_iter_prev(ds_chunk_iter_t *iter)
+{
+    if (!iter->chunk)
+        return 0;
+    if (iter->index-- == iter->chunk->begin)
+    {
+        iter->chunk = iter->chunk->prev;
+        if (!iter->chunk)
+            return 0;
+        iter->index = iter->chunk->end - 1;
+    }
+    return iter->chunk->object[iter->index];
+}
+
+#endif // __DS_CHUNK_H__
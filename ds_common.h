@@ -30,3 +30,11 @@
 #define DS_ITEM_OF(_ds, _object) ((__typeof__((_ds)->root))(((char *)(_object)) + (_ds)->_offset_in_object))
 
 #define DS_EXT_OBJECT_OF(_item) ((_item)->object)
+
+/**
+ * @brief Size of a cache line, to keep apart the fields written by different
+ * threads
+ */
+#ifndef DS_CACHE_LINE_SIZE
+#define DS_CACHE_LINE_SIZE 64
+#endif
@@ -126,4 +126,195 @@ static inline void *ds_dlist_remove_item(ds_dlist_t *dlist, ds_dlist_item_t *ite
     return ds_dlist_remove(dlist, DS_OBJECT_OF(dlist, item));
 }
 
+/**
+ * @brief Move all objects of `other` at the end of the list, in O(1). `other`
+ * is left empty.
+ *
+ * @param dlist The list
+ * @param other A list with the same offset in objects
+ */
+static inline void ds_dlist_concat(ds_dlist_t *dlist, ds_dlist_t *other)
+{
+    if (!other->root)
+        return;
+    other->root->prev = dlist->last;
+    if (dlist->last)
+        dlist->last->next = other->root;
+    else
+        dlist->root = other->root;
+    dlist->last = other->last;
+    dlist->count += other->count;
+    other->root = 0;
+    other->last = 0;
+    other->count = 0;
+}
+
+/**
+ * @brief Move the objects from `first` to `last` of `other` before `before` in
+ * the list, or at its end if `before` is 0, in O(1). `other` may be the list
+ * itself, `before` is then outside of the moved range.
+ *
+ * @param dlist The list
+ * @param before An object of the list, or 0
+ * @param other The list holding the range, with the same offset in objects
+ * @param first The first object of the range
+ * @param last The last object of the range
+ * @param count The number of objects of the range
+ */
+static inline void ds_dlist_splice(ds_dlist_t *dlist, void *before, ds_dlist_t *other, void *first, void *last, size_t count)
+{
+    ds_dlist_item_t *first_item = DS_ITEM_OF(other, first);
+    ds_dlist_item_t *last_item = DS_ITEM_OF(other, last);
+    ds_dlist_item_t *next = before ? DS_ITEM_OF(dlist, before) : 0;
+    if (other->root == first_item)
+        other->root = last_item->next;
+    else
+        first_item->prev->next = last_item->next;
+    if (other->last == last_item)
+        other->last = first_item->prev;
+    else
+        last_item->next->prev = first_item->prev;
+    other->count -= count;
+    ds_dlist_item_t *prev = next ? next->prev : dlist->last;
+    first_item->prev = prev;
+    last_item->next = next;
+    if (prev)
+        prev->next = first_item;
+    else
+        dlist->root = first_item;
+    if (next)
+        next->prev = last_item;
+    else
+        dlist->last = last_item;
+    dlist->count += count;
+}
+
+/**
+ * @brief Enqueue a chain of objects already linked both ways by their items,
+ * in O(1)
+ *
+ * @param dlist The list
+ * @param first The first object of the chain, whose previous item is ignored
+ * @param last The last object of the chain, whose next item is ignored
+ * @param count The number of objects of the chain
+ */
+static inline void ds_dlist_enq_chain(ds_dlist_t *dlist, void *first, void *last, size_t count)
+{
+    ds_dlist_item_t *first_item = DS_ITEM_OF(dlist, first);
+    ds_dlist_item_t *last_item = DS_ITEM_OF(dlist, last);
+    first_item->prev = dlist->last;
+    last_item->next = 0;
+    if (dlist->last)
+        dlist->last->next = first_item;
+    else
+        dlist->root = first_item;
+    dlist->last = last_item;
+    dlist->count += count;
+}
+
+/**
+ * @brief Remove up to `count` objects from the front of the list
+ *
+ * @param dlist The list
+ * @param objects The array receiving the objects, in order
+ * @param count The size of the array
+ * @return The number of removed objects
+ */
+static inline size_t ds_dlist_deq_batch(ds_dlist_t *dlist, void **objects, size_t count)
+{
+    ds_dlist_item_t *item = dlist->root;
+    size_t i;
+    for (i = 0; i < count && item; i++)
+    {
+        objects[i] = DS_OBJECT_OF(dlist, item);
+        item = item->next;
+    }
+    dlist->root = item;
+    if (item)
+        item->prev = 0;
+    else
+        dlist->last = 0;
+    dlist->count -= i;
+    return i;
+}
+
+/**
+ * @brief Define functions specialized for a type of object, where the offset
+ * of the item in the object is a constant. The defined functions are
+ * `_name##_enq`, `_name##_push`, `_name##_remove`, `_name##_first`,
+ * `_name##_last`, `_name##_next`, `_name##_prev` and `_name##_object_of`.
+ *
+ * @param _name Prefix of the defined functions
+ * @param _type_t Type of the objects
+ * @param _member Name of the ds_dlist_item_t member of _type_t
+ */
+#define DS_DLIST_DEFINE(_name, _type_t, _member)                                 \
+    static inline _type_t *_name##_object_of(ds_dlist_item_t *item)              \
+    {                                                                            \
+        return (_type_t *)((char *)item - offsetof(_type_t, _member));           \
+    }                                                                            \
+                                                                                 \
+    static inline void _name##_enq(ds_dlist_t *dlist, _type_t *object)           \
+    {                                                                            \
+        ds_dlist_item_t *item = &object->_member;                                \
+        dlist->count++;                                                          \
+        item->next = 0;                                                          \
+        item->prev = dlist->last;                                                \
+        dlist->last = item;                                                      \
+        if (!dlist->root)                                                        \
+            dlist->root = item;                                                  \
+        else                                                                     \
+            item->prev->next = item;                                             \
+    }                                                                            \
+                                                                                 \
+    static inline void _name##_push(ds_dlist_t *dlist, _type_t *object)          \
+    {                                                                            \
+        ds_dlist_item_t *item = &object->_member;                                \
+        dlist->count++;                                                          \
+        item->next = dlist->root;                                                \
+        item->prev = 0;                                                          \
+        dlist->root = item;                                                      \
+        if (!dlist->last)                                                        \
+            dlist->last = item;                                                  \
+        else                                                                     \
+            item->next->prev = item;                                             \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_remove(ds_dlist_t *dlist, _type_t *object)    \
+    {                                                                            \
+        ds_dlist_item_t *item = &object->_member;                                \
+        if (dlist->root == item)                                                 \
+            dlist->root = item->next;                                            \
+        else                                                                     \
+            item->prev->next = item->next;                                       \
+        if (dlist->last == item)                                                 \
+            dlist->last = item->prev;                                            \
+        else                                                                     \
+            item->next->prev = item->prev;                                       \
+        dlist->count--;                                                          \
+        return object;                                                           \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_first(ds_dlist_t *dlist)                      \
+    {                                                                            \
+        return dlist->root ? _name##_object_of(dlist->root) : 0;                 \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_last(ds_dlist_t *dlist)                       \
+    {                                                                            \
+        return dlist->last ? _name##_object_of(dlist->last) : 0;                 \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_next(_type_t *object)                         \
+    {                                                                            \
+        ds_dlist_item_t *next = object->_member.next;                            \
+        return next ? _name##_object_of(next) : 0;                               \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_prev(_type_t *object)                         \
+    {                                                                            \
+        ds_dlist_item_t *prev = object->_member.prev;                            \
+        return prev ? _name##_object_of(prev) : 0;                               \
+    }
+
 #endif // __DS_DLIST_H__
@@ -111,4 +111,94 @@ static inline void *ds_dlist_ext_remove_item(ds_dlist_ext_t *dlist, ds_dlist_ext
     return item->object;
 }
 
+/**
+ * @brief Move all items of `other` at the end of the list, in O(1). `other`
+ * is left empty.
+ */
+static inline void ds_dlist_ext_concat(ds_dlist_ext_t *dlist, ds_dlist_ext_t *other)
+{
+    if (!other->root)
+        return;
+    other->root->prev = dlist->last;
+    if (dlist->last)
+        dlist->last->next = other->root;
+    else
+        dlist->root = other->root;
+    dlist->last = other->last;
+    dlist->count += other->count;
+    other->root = 0;
+    other->last = 0;
+    other->count = 0;
+}
+
+/**
+ * @brief Move the items from `first` to `last` of `other` before `before` in
+ * the list, or at its end if `before` is 0. See ds_dlist_splice().
+ */
+static inline void ds_dlist_ext_splice(ds_dlist_ext_t *dlist, ds_dlist_ext_item_t *before, ds_dlist_ext_t *other, ds_dlist_ext_item_t *first, ds_dlist_ext_item_t *last, size_t count)
+{
+    if (other->root == first)
+        other->root = last->next;
+    else
+        first->prev->next = last->next;
+    if (other->last == last)
+        other->last = first->prev;
+    else
+        last->next->prev = first->prev;
+    other->count -= count;
+    ds_dlist_ext_item_t *prev = before ? before->prev : dlist->last;
+    first->prev = prev;
+    last->next = before;
+    if (prev)
+        prev->next = first;
+    else
+        dlist->root = first;
+    if (before)
+        before->prev = last;
+    else
+        dlist->last = last;
+    dlist->count += count;
+}
+
+/**
+ * @brief Enqueue a chain of items already linked both ways and associated
+ * with their objects, in O(1). The previous item of `first` and the next item
+ * of `last` are ignored.
+ */
+static inline void ds_dlist_ext_enq_chain(ds_dlist_ext_t *dlist, ds_dlist_ext_item_t *first, ds_dlist_ext_item_t *last, size_t count)
+{
+    first->prev = dlist->last;
+    last->next = 0;
+    if (dlist->last)
+        dlist->last->next = first;
+    else
+        dlist->root = first;
+    dlist->last = last;
+    dlist->count += count;
+}
+
+/**
+ * @brief Remove up to `count` objects from the front of the list into an
+ * array, in order
+ *
+ * @return The number of removed objects
+ */
+static inline size_t ds_dlist_ext_deq_batch(ds_dlist_ext_t *dlist, void **objects, size_t count)
+{
+    ds_dlist_ext_item_t *item = dlist->root;
+    size_t i;
+    for (i = 0; i < count && item; i++)
+    {
+        objects[i] = item->object;
+        item = item->next;
+    }
+    dlist->root = item;
+    if (item)
+        item->prev = 0;
+    else
+        dlist->last = 0;
+    dlist->count -= i;
+    return i;
+}
+
 #endif // __DS_DLIST_EXT_H__
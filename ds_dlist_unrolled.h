@@ -0,0 +1,261 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_DLIST_UNROLLED_H__
+#define __DS_DLIST_UNROLLED_H__
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ds_common.h"
+#include "ds_chunk.h"
+
+/**
+ * @brief Double ended list of object pointers stored by chunks of
+ * DS_CHUNK_NMEMB, instead of one ds_dlist_ext_item_t per object. Objects are
+ * enqueued at the end of the last chunk and pushed at the beginning of the
+ * first chunk. A removed object closes its gap within its chunk, and a chunk
+ * goes back to the heap as soon as it is empty.
+ */
+typedef struct ds_dlist_unrolled_s ds_dlist_unrolled_t;
+struct ds_dlist_unrolled_s
+{
+    size_t count;
+    ds_chunk_t *root;
+    ds_chunk_t *last;
+    ds_heap_t *chunk_heap;
+};
+
+/**
+ * @brief Initialize an unrolled list
+ *
+ * @param dlist The list
+ * @param chunk_heap A heap of ds_chunk_t where chunks are taken from
+ */
+static inline void ds_dlist_unrolled_init(ds_dlist_unrolled_t *dlist, ds_heap_t *chunk_heap)
+{
+    dlist->root = 0;
+    dlist->last = 0;
+    dlist->count = 0;
+    dlist->chunk_heap = chunk_heap;
+}
+
+/**
+ * @brief Add an object at the end of the list
+ *
+ * @return 0 or -1 if no chunk can be taken from the heap
+ */
+static inline int ds_dlist_unrolled_enq(ds_dlist_unrolled_t *dlist, void *object)
+{
+    ds_chunk_t *last = dlist->last;
+    if (!last || last->end == DS_CHUNK_NMEMB)
+    {
+        ds_chunk_t *chunk = ds_chunk_alloc(dlist->chunk_heap, 0);
+        if (!chunk)
+            return -1;
+        chunk->prev = last;
+        if (last)
+            last->next = chunk;
+        else
+            dlist->root = chunk;
+        dlist->last = last = chunk;
+    }
+    last->object[last->end++] = object;
+    dlist->count++;
+    return 0;
+}
+
+/**
+ * @brief Add an object at the front of the list
+ *
+ * @return 0 or -1 if no chunk can be taken from the heap
+ */
+static inline int ds_dlist_unrolled_push(ds_dlist_unrolled_t *dlist, void *object)
+{
+    ds_chunk_t *root = dlist->root;
+    if (!root || root->begin == 0)
+    {
+        ds_chunk_t *chunk = ds_chunk_alloc(dlist->chunk_heap, DS_CHUNK_NMEMB);
+        if (!chunk)
+            return -1;
+        chunk->next = root;
+        if (root)
+            root->prev = chunk;
+        else
+            dlist->last = chunk;
+        dlist->root = root = chunk;
+    }
+    root->object[--root->begin] = object;
+    dlist->count++;
+    return 0;
+}
+
+// Unlink an empty chunk and give it back to the heap
+static inline void ds_dlist_unrolled_free_chunk(ds_dlist_unrolled_t *dlist, ds_chunk_t *chunk)
+{
+    if (dlist->root == chunk)
+        dlist->root = chunk->next;
+    else
+        chunk->prev->next = chunk->next;
+    if (dlist->last == chunk)
+        dlist->last = chunk->prev;
+    else
+        chunk->next->prev = chunk->prev;
+    ds_heap_free(dlist->chunk_heap, chunk);
+}
+
+/**
+ * @brief Remove the object at the front of the list
+ *
+ * @return The object or 0 if the list is empty
+ */
+static inline void *ds_dlist_unrolled_deq(ds_dlist_unrolled_t *dlist)
+{
+    ds_chunk_t *root = dlist->root;
+    if (!root)
+        return 0;
+    void *object = root->object[root->begin++];
+    dlist->count--;
+    if (root->begin == root->end)
+        ds_dlist_unrolled_free_chunk(dlist, root);
+    return object;
+}
+
+/**
+ * @brief Remove the object an iterator is positioned on. The objects of its
+ * chunk on the shorter side of the removed object are moved to close the gap.
+ *
+ * @param dlist The list
+ * @param iter An iterator positioned on an object of the list, moved to the
+ * next object
+ * @return The next object or 0 at the end of the list
+ */
+static inline void *ds_dlist_unrolled_remove(ds_dlist_unrolled_t *dlist, ds_chunk_iter_t *iter)
+{
+    ds_chunk_t *chunk = iter->chunk;
+    uint32_t before = iter->index - chunk->begin;
+    uint32_t after = chunk->end - 1 - iter->index;
+    if (before < after)
+    {
+        memmove(&chunk->object[chunk->begin + 1], &chunk->object[chunk->begin], before * sizeof(void *));
+        chunk->begin++;
+        iter->index++;
+    }
+    else
+    {
+        memmove(&chunk->object[iter->index], &chunk->object[iter->index + 1], after * sizeof(void *));
+        chunk->end--;
+    }
+    dlist->count--;
+    if (iter->index == chunk->end)
+    {
+        iter->chunk = chunk->next;
+        iter->index = iter->chunk ? iter->chunk->begin : 0;
+        if (chunk->begin == chunk->end)
+            ds_dlist_unrolled_free_chunk(dlist, chunk);
+    }
+    return iter->chunk ? iter->chunk->object[iter->index] : 0;
+}
+
+/**
+ * @brief Move all objects of `other` at the end of the list, in O(1). Both
+ * lists must take their chunks from the same heap. `other` is left empty.
+ */
+static inline void ds_dlist_unrolled_concat(ds_dlist_unrolled_t *dlist, ds_dlist_unrolled_t *other)
+{
+    if (!other->root)
+        return;
+    other->root->prev = dlist->last;
+    if (dlist->last)
+        dlist->last->next = other->root;
+    else
+        dlist->root = other->root;
+    dlist->last = other->last;
+    dlist->count += other->count;
+    other->root = 0;
+    other->last = 0;
+    other->count = 0;
+}
+
+/**
+ * @brief Give back all the chunks of the list to the heap. The list is empty.
+ */
+static inline void ds_dlist_unrolled_clear(ds_dlist_unrolled_t *dlist)
+{
+    ds_chunk_t *chunk = dlist->root;
+    while (chunk)
+    {
+        ds_chunk_t *next = chunk->next;
+        ds_heap_free(dlist->chunk_heap, chunk);
+        chunk = next;
+    }
+    ds_dlist_unrolled_init(dlist, dlist->chunk_heap);
+}
+
+/**
+ * @brief Position an iterator on the first object of the list
+ *
+ * @return The object or 0 if the list is empty
+ */
+static inline void *ds_dlist_unrolled_first(ds_dlist_unrolled_t *dlist, ds_chunk_iter_t *iter)
+{
+    iter->chunk = dlist->root;
+    iter->index = iter->chunk ? iter->chunk->begin : 0;
+    return iter->chunk ? iter->chunk->object[iter->index] : 0;
+}
+
+/**
+ * @brief Position an iterator on the last object of the list
+ *
+ * @return The object or 0 if the list is empty
+ */
+static inline void *ds_dlist_unrolled_last(ds_dlist_unrolled_t *dlist, ds_chunk_iter_t *iter)
+{
+    iter->chunk = dlist->last;
+    iter->index = iter->chunk ? iter->chunk->end - 1 : 0;
+    return iter->chunk ? iter->chunk->object[iter->index] : 0;
+}
+
+/**
+ * @brief Move an iterator to the next object of the list
+ *
+ * @return The object or 0 at the end of the list
+ */
+static inline void *ds_dlist_unrolled_next(ds_chunk_iter_t *iter)
+{
+    return ds_chunk_iter_next(iter);
+}
+
+/**
+ * @brief Move an iterator to the previous object of the list
+ *
+ * @return The object or 0 at the beginning of the list
+ */
+static inline void *ds_dlist_unrolled_prev(ds_chunk_iter_t *iter)
+{
+    return ds_chunk_iter_prev(iter);
+}
+
+#endif // __DS_DLIST_UNROLLED_H__
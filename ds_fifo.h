@@ -77,4 +77,122 @@ static inline void *ds_fifo_deq(ds_fifo_t *fifo)
     return DS_OBJECT_OF(fifo, item);
 }
 
+/**
+ * @brief Move all objects of `other` at the end of the fifo, in O(1). `other`
+ * is left empty.
+ *
+ * @param fifo The fifo
+ * @param other A fifo with the same offset in objects
+ */
+static inline void ds_fifo_concat(ds_fifo_t *fifo, ds_fifo_t *other)
+{
+    if (!other->root)
+        return;
+    if (fifo->last)
+        fifo->last->next = other->root;
+    else
+        fifo->root = other->root;
+    fifo->last = other->last;
+    fifo->count += other->count;
+    other->root = 0;
+    other->last = 0;
+    other->count = 0;
+}
+
+/**
+ * @brief Enqueue a chain of objects already linked by their items, in O(1)
+ *
+ * @param fifo The fifo
+ * @param first The first object of the chain
+ * @param last The last object of the chain, whose next item is ignored
+ * @param count The number of objects of the chain
+ */
+static inline void ds_fifo_enq_chain(ds_fifo_t *fifo, void *first, void *last, size_t count)
+{
+    ds_fifo_item_t *last_item = DS_ITEM_OF(fifo, last);
+    last_item->next = 0;
+    if (fifo->last)
+        fifo->last->next = DS_ITEM_OF(fifo, first);
+    else
+        fifo->root = DS_ITEM_OF(fifo, first);
+    fifo->last = last_item;
+    fifo->count += count;
+}
+
+/**
+ * @brief Dequeue up to `count` objects
+ *
+ * @param fifo The fifo
+ * @param objects The array receiving the objects, in order
+ * @param count The size of the array
+ * @return The number of dequeued objects
+ */
+static inline size_t ds_fifo_deq_batch(ds_fifo_t *fifo, void **objects, size_t count)
+{
+    ds_fifo_item_t *item = fifo->root;
+    size_t i;
+    for (i = 0; i < count && item; i++)
+    {
+        objects[i] = DS_OBJECT_OF(fifo, item);
+        item = item->next;
+    }
+    fifo->root = item;
+    if (!item)
+        fifo->last = 0;
+    fifo->count -= i;
+    return i;
+}
+
+/**
+ * @brief Define functions specialized for a type of object, where the offset
+ * of the item in the object is a constant. The defined functions are
+ * `_name##_enq`, `_name##_deq`, `_name##_first`, `_name##_next` and
+ * `_name##_object_of`. `_name##_first` and `_name##_next` walk the fifo
+ * without dequeueing, from the oldest object to the newest.
+ *
+ * @param _name Prefix of the defined functions
+ * @param _type_t Type of the objects
+ * @param _member Name of the ds_fifo_item_t member of _type_t
+ */
+#define DS_FIFO_DEFINE(_name, _type_t, _member)                                  \
+    static inline _type_t *_name##_object_of(ds_fifo_item_t *item)               \
+    {                                                                            \
+        return (_type_t *)((char *)item - offsetof(_type_t, _member));           \
+    }                                                                            \
+                                                                                 \
+    static inline void _name##_enq(ds_fifo_t *fifo, _type_t *object)             \
+    {                                                                            \
+        ds_fifo_item_t *item = &object->_member;                                 \
+        fifo->count++;                                                           \
+        item->next = 0;                                                          \
+        if (fifo->last)                                                          \
+            fifo->last->next = item;                                             \
+        else                                                                     \
+            fifo->root = item;                                                   \
+        fifo->last = item;                                                       \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_deq(ds_fifo_t *fifo)                          \
+    {                                                                            \
+        ds_fifo_item_t *item = fifo->root;                                       \
+        if (!item)                                                               \
+            return 0;                                                            \
+        fifo->root = item->next;                                                 \
+        if (!fifo->root)                                                         \
+            fifo->last = 0;                                                      \
+        fifo->count--;                                                           \
+        return _name##_object_of(item);                                          \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_first(ds_fifo_t *fifo)                        \
+    {                                                                            \
+        return fifo->root ? _name##_object_of(fifo->root) : 0;                   \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_next(_type_t *object)                         \
+    {                                                                            \
+        ds_fifo_item_t *next = object->_member.next;                             \
+        return next ? _name##_object_of(next) : 0;                               \
+    }
+
 #endif // __DS_FIFO_H__
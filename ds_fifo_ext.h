@@ -76,4 +76,59 @@ static inline void *ds_fifo_ext_deq(ds_fifo_ext_t *fifo)
     return item->object;
 }
 
+/**
+ * @brief Move all items of `other` at the end of the fifo, in O(1). `other`
+ * is left empty.
+ */
+static inline void ds_fifo_ext_concat(ds_fifo_ext_t *fifo, ds_fifo_ext_t *other)
+{
+    if (!other->root)
+        return;
+    if (fifo->last)
+        fifo->last->next = other->root;
+    else
+        fifo->root = other->root;
+    fifo->last = other->last;
+    fifo->count += other->count;
+    other->root = 0;
+    other->last = 0;
+    other->count = 0;
+}
+
+/**
+ * @brief Enqueue a chain of items already linked and associated with their
+ * objects, in O(1). The next item of `last` is ignored.
+ */
+static inline void ds_fifo_ext_enq_chain(ds_fifo_ext_t *fifo, ds_fifo_ext_item_t *first, ds_fifo_ext_item_t *last, size_t count)
+{
+    last->next = 0;
+    if (fifo->last)
+        fifo->last->next = first;
+    else
+        fifo->root = first;
+    fifo->last = last;
+    fifo->count += count;
+}
+
+/**
+ * @brief Dequeue up to `count` objects into an array, in order
+ *
+ * @return The number of dequeued objects
+ */
+static inline size_t ds_fifo_ext_deq_batch(ds_fifo_ext_t *fifo, void **objects, size_t count)
+{
+    ds_fifo_ext_item_t *item = fifo->root;
+    size_t i;
+    for (i = 0; i < count && item; i++)
+    {
+        objects[i] = item->object;
+        item = item->next;
+    }
+    fifo->root = item;
+    if (!item)
+        fifo->last = 0;
+    fifo->count -= i;
+    return i;
+}
+
 #endif // __DS_FIFO_EXT_H__
@@ -0,0 +1,202 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_FIFO_UNROLLED_H__
+#define __DS_FIFO_UNROLLED_H__
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ds_common.h"
+#include "ds_chunk.h"
+
+/**
+ * @brief Fifo of object pointers stored by chunks of DS_CHUNK_NMEMB, instead
+ * of one ds_fifo_ext_item_t per object. Objects are enqueued at the end of
+ * the last chunk and dequeued from the beginning of the first chunk. A chunk
+ * goes back to the heap as soon as it is empty.
+ */
+typedef struct ds_fifo_unrolled_s ds_fifo_unrolled_t;
+struct ds_fifo_unrolled_s
+{
+    size_t count;
+    ds_chunk_t *root;
+    ds_chunk_t *last;
+    ds_heap_t *chunk_heap;
+};
+
+/**
+ * @brief Initialize an unrolled fifo
+ *
+ * @param fifo The fifo
+ * @param chunk_heap A heap of ds_chunk_t where chunks are taken from
+ */
+static inline void ds_fifo_unrolled_init(ds_fifo_unrolled_t *fifo, ds_heap_t *chunk_heap)
+{
+    fifo->root = 0;
+    fifo->last = 0;
+    fifo->count = 0;
+    fifo->chunk_heap = chunk_heap;
+}
+
+/**
+ * @brief Add an object at the end of the fifo
+ *
+ * @return 0 or -1 if no chunk can be taken from the heap
+ */
+static inline int ds_fifo_unrolled_enq(ds_fifo_unrolled_t *fifo, void *object)
+{
+    ds_chunk_t *last = fifo->last;
+    if (!last || last->end == DS_CHUNK_NMEMB)
+    {
+        ds_chunk_t *chunk = ds_chunk_alloc(fifo->chunk_heap, 0);
+        if (!chunk)
+            return -1;
+        chunk->prev = last;
+        if (last)
+            last->next = chunk;
+        else
+            fifo->root = chunk;
+        fifo->last = last = chunk;
+    }
+    last->object[last->end++] = object;
+    fifo->count++;
+    return 0;
+}
+
+/**
+ * @brief Remove the object at the beginning of the fifo
+ *
+ * @return The object or 0 if the fifo is empty
+ */
+static inline void *ds_fifo_unrolled_deq(ds_fifo_unrolled_t *fifo)
+{
+    ds_chunk_t *root = fifo->root;
+    if (!root)
+        return 0;
+    void *object = root->object[root->begin++];
+    fifo->count--;
+    if (root->begin == root->end)
+    {
+        fifo->root = root->next;
+        if (fifo->root)
+            fifo->root->prev = 0;
+        else
+            fifo->last = 0;
+        ds_heap_free(fifo->chunk_heap, root);
+    }
+    return object;
+}
+
+/**
+ * @brief Dequeue up to `count` objects into an array, in order, copying them
+ * chunk by chunk
+ *
+ * @return The number of dequeued objects
+ */
+static inline size_t ds_fifo_unrolled_deq_batch(ds_fifo_unrolled_t *fifo, void **objects, size_t count)
+{
+    size_t done = 0;
+    while (done < count && fifo->root)
+    {
+        ds_chunk_t *root = fifo->root;
+        size_t n = root->end - root->begin;
+        if (n > count - done)
+            n = count - done;
+        memcpy(objects + done, &root->object[root->begin], n * sizeof(void *));
+        root->begin += n;
+        done += n;
+        if (root->begin == root->end)
+        {
+            fifo->root = root->next;
+            ds_heap_free(fifo->chunk_heap, root);
+        }
+    }
+    if (fifo->root)
+        fifo->root->prev = 0;
+    else
+        fifo->last = 0;
+    fifo->count -= done;
+    return done;
+}
+
+/**
+ * @brief Move all objects of `other` at the end of the fifo, in O(1). Both
+ * fifos must take their chunks from the same heap. `other` is left empty.
+ */
+static inline void ds_fifo_unrolled_concat(ds_fifo_unrolled_t *fifo, ds_fifo_unrolled_t *other)
+{
+    if (!other->root)
+        return;
+    other->root->prev = fifo->last;
+    if (fifo->last)
+        fifo->last->next = other->root;
+    else
+        fifo->root = other->root;
+    fifo->last = other->last;
+    fifo->count += other->count;
+    other->root = 0;
+    other->last = 0;
+    other->count = 0;
+}
+
+/**
+ * @brief Give back all the chunks of the fifo to the heap. The fifo is empty.
+ */
+static inline void ds_fifo_unrolled_clear(ds_fifo_unrolled_t *fifo)
+{
+    ds_chunk_t *chunk = fifo->root;
+    while (chunk)
+    {
+        ds_chunk_t *next = chunk->next;
+        ds_heap_free(fifo->chunk_heap, chunk);
+        chunk = next;
+    }
+    ds_fifo_unrolled_init(fifo, fifo->chunk_heap);
+}
+
+/**
+ * @brief Position an iterator on the first object of the fifo
+ *
+ * @return The object or 0 if the fifo is empty
+ */
+static inline void *ds_fifo_unrolled_first(ds_fifo_unrolled_t *fifo, ds_chunk_iter_t *iter)
+{
+    iter->chunk = fifo->root;
+    iter->index = iter->chunk ? iter->chunk->begin : 0;
+    return iter->chunk ? iter->chunk->object[iter->index] : 0;
+}
+
+/**
+ * @brief Move an iterator to the next object of the fifo
+ *
+ * @return The object or 0 at the end of the fifo
+ */
+static inline void *ds_fifo_unrolled_next(ds_chunk_iter_t *iter)
+{
+    return ds_chunk_iter_next(iter);
+}
+
+#endif // __DS_FIFO_UNROLLED_H__
@@ -27,17 +27,58 @@
 #define __DS_HEAP_H__
 
 #include <stddef.h>
+#include <stdlib.h>
 
 #include "ds_common.h"
 #include "ds_lifo.h"
 
+/**
+ * @brief Size of the header of a slab, keeping the elements of the slab
+ * aligned as malloc() does
+ */
+#define DS_HEAP_SLAB_HEADER_SIZE \
+    ((sizeof(ds_lifo_item_t) + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) * _Alignof(max_align_t))
+
 typedef struct ds_heap_s ds_heap_t;
 struct ds_heap_s
 {
     ds_lifo_t free_list;
     void *store;
+    // Elements not yet used at the end of the store or of the last slab
+    char *bump;
+    char *bump_end;
+    size_t _element_size;
+    size_t _slab_nmemb;
+    ds_lifo_t slabs;
+    size_t slab_count;
+    size_t count;
+    size_t high_water;
 };
 
+/**
+ * @brief Initialize a heap. Use DS_HEAP_INIT(), DS_HEAP_INIT_LAZY() or
+ * DS_HEAP_INIT_GROWABLE() instead.
+ *
+ * @param heap The heap to initialize
+ * @param store An array of elements, or 0
+ * @param nmemb Number of elements in the array taken with the bump pointer
+ * @param element_size Size of the elements
+ * @param slab_nmemb Number of elements of the slabs allocated on demand, or 0
+ */
+static inline void ds_heap_init(ds_heap_t *heap, void *store, size_t nmemb, size_t element_size, size_t slab_nmemb)
+{
+    ds_lifo_init(&heap->free_list, 0);
+    heap->store = store;
+    heap->bump = store;
+    heap->bump_end = (char *)store + nmemb * element_size;
+    heap->_element_size = element_size;
+    heap->_slab_nmemb = slab_nmemb;
+    ds_lifo_init(&heap->slabs, 0);
+    heap->slab_count = 0;
+    heap->count = 0;
+    heap->high_water = 0;
+}
+
 /**
  \* @brief Initialize a heap given an array of typed elements
  *
@@ -46,29 +87,84 @@ struct ds_heap_s
  \* @param _nmemb Number of elements in the array
  \* @param _type_t Type of elements
  */
-#define DS_HEAP_INIT(_heap, _store, _nmemb, _type_t) \
-    do                                               \
-    {                                                \
-        _heap.store = _store;                        \
-        ds_lifo_t *free_list = &(_heap.free_list);   \
-        _type_t *item = _heap.store;                 \
-        ds_lifo_init(free_list, 0);                  \
-        for (size_t i = 0; i < (_nmemb); i++)        \
-        {                                            \
-            ds_lifo_push(free_list, item);           \
-            item++;                                  \
-        }                                            \
+#define DS_HEAP_INIT(_heap, _store, _nmemb, _type_t)                \
+    do                                                              \
+    {                                                               \
+        ds_heap_init(&(_heap), _store, 0, sizeof(_type_t), 0);      \
+        ds_lifo_t *free_list = &(_heap.free_list);                  \
+        _type_t *item = _heap.store;                                \
+        for (size_t i = 0; i < (_nmemb); i++)                       \
+        {                                                           \
+            ds_lifo_push(free_list, item);                          \
+            item++;                                                 \
+        }                                                           \
     } while (0)
 
 /**
- \* @brief Take an element from the heap free list
+ * @brief Initialize a heap given an array of typed elements, without touching
+ * the array. The elements are taken in order with a bump pointer, and the
+ * free list only holds the given back elements.
+ *
+ * @param _heap The heap to initialize
+ * @param _store An array, possibly malloc() allocated, of _type_t elements
+ * @param _nmemb Number of elements in the array
+ * @param _type_t Type of elements
+ */
+#define DS_HEAP_INIT_LAZY(_heap, _store, _nmemb, _type_t) \
+    ds_heap_init(&(_heap), _store, _nmemb, sizeof(_type_t), 0)
+
+/**
+ * @brief Initialize an empty heap of typed elements, growing by malloc()
+ * allocated slabs when both the last slab and the free list are exhausted.
+ * The slabs are freed by ds_heap_destroy().
+ *
+ * @param _heap The heap to initialize
+ * @param _slab_nmemb Number of elements of a slab
+ * @param _type_t Type of elements
+ */
+#define DS_HEAP_INIT_GROWABLE(_heap, _slab_nmemb, _type_t) \
+    ds_heap_init(&(_heap), 0, 0, sizeof(_type_t), _slab_nmemb)
+
+/**
+ * @brief Allocate a new slab and take its first element
+ *
+ * @param heap The heap to grow
+ * @return The taken element or 0 if the heap can't grow
+ */
+static inline void *ds_heap_grow(ds_heap_t *heap)
+{
+    if (heap->_slab_nmemb == 0)
+        return 0;
+    char *slab = malloc(DS_HEAP_SLAB_HEADER_SIZE + heap->_slab_nmemb * heap->_element_size);
+    if (!slab)
+        return 0;
+    ds_lifo_push(&heap->slabs, slab);
+    heap->slab_count++;
+    heap->bump = slab + DS_HEAP_SLAB_HEADER_SIZE + heap->_element_size;
+    heap->bump_end = slab + DS_HEAP_SLAB_HEADER_SIZE + heap->_slab_nmemb * heap->_element_size;
+    return slab + DS_HEAP_SLAB_HEADER_SIZE;
+}
+
+/**
+ \* @brief Take an element from the heap: first with the bump pointer, then from
+ \* the free list, then from a new slab if the heap is growable
  *
  \* @param heap The heap to take the element from
- \* @return The taken element or 0 if free list is empty
+ \* @return The taken element or 0 if the heap is exhausted
  */
 static inline void *ds_heap_alloc(ds_heap_t *heap)
 {
-    return ds_lifo_pop(&heap->free_list);
+    void *item;
+    if (heap->bump < heap->bump_end)
+    {
+        item = heap->bump;
+        heap->bump += heap->_element_size;
+    }
+    else if ((item = ds_lifo_pop(&heap->free_list)) == 0 && (item = ds_heap_grow(heap)) == 0)
+        return 0;
+    if (++heap->count > heap->high_water)
+        heap->high_water = heap->count;
+    return item;
 }
 
 /**
@@ -80,6 +176,21 @@ static inline void *ds_heap_alloc(ds_heap_t *heap)
 static inline void ds_heap_free(ds_heap_t *heap, void *item)
 {
     ds_lifo_push(&heap->free_list, item);
+    heap->count--;
+}
+
+/**
+ * @brief Free the slabs of a growable heap. All its elements become invalid
+ * and the heap is empty.
+ *
+ * @param heap The heap to destroy
+ */
+static inline void ds_heap_destroy(ds_heap_t *heap)
+{
+    void *slab;
+    while ((slab = ds_lifo_pop(&heap->slabs)) != 0)
+        free(slab);
+    ds_heap_init(heap, 0, 0, heap->_element_size, heap->_slab_nmemb);
 }
 
 #endif // __DS_HEAP_H__
@@ -0,0 +1,299 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_HEAP_CACHE_H__
+#define __DS_HEAP_CACHE_H__
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "ds_heap.h"
+
+/**
+ * @brief Number of elements of a magazine
+ */
+#ifndef DS_HEAP_CACHE_MAGAZINE_SIZE
+#define DS_HEAP_CACHE_MAGAZINE_SIZE 64
+#endif
+
+/**
+ * @brief Number of magazines allocated at once by a cache
+ */
+#define DS_HEAP_CACHE_MAGAZINE_SLAB 16
+
+/**
+ * @brief A stack of free elements, owned by a thread or kept in the depot of a
+ * cache
+ */
+typedef struct ds_heap_magazine_s ds_heap_magazine_t;
+struct ds_heap_magazine_s
+{
+    ds_lifo_item_t depot_item;
+    int count;
+    void *objects[DS_HEAP_CACHE_MAGAZINE_SIZE];
+};
+
+/**
+ * @brief A heap shared between threads. Each thread allocates from and frees
+ * to its own pair of magazines with no lock. Only full and empty magazines are
+ * exchanged with the depot of the cache, under its lock, and the heap itself
+ * is only used when the depot has no full magazine or no empty one.
+ *
+ * An element may be freed by another thread than the one which allocated it.
+ * The elements cached by a thread return to the depot when the thread exits
+ * or calls ds_heap_cache_flush().
+ */
+typedef struct ds_heap_cache_s ds_heap_cache_t;
+struct ds_heap_cache_s
+{
+    ds_heap_t *heap;
+    pthread_mutex_t lock;
+    pthread_key_t key;
+    ds_lifo_t full;
+    ds_lifo_t empty;
+    ds_heap_t magazine_heap;
+};
+
+/**
+ * @brief The magazines of a thread. The loaded one is used first and the
+ * previous one avoids going to the depot when allocations and frees
+ * alternate at a magazine boundary.
+ */
+typedef struct ds_heap_cache_thread_s ds_heap_cache_thread_t;
+struct ds_heap_cache_thread_s
+{
+    ds_heap_cache_t *cache;
+    ds_heap_magazine_t *loaded;
+    ds_heap_magazine_t *previous;
+};
+
+// Give back a magazine to the depot, cache locked
+static inline void ds_heap_cache_deposit(ds_heap_cache_t *cache, ds_heap_magazine_t *magazine)
+{
+    ds_lifo_push(magazine->count ? &cache->full : &cache->empty, magazine);
+}
+
+// Take an empty magazine from the depot, cache locked
+static inline ds_heap_magazine_t *ds_heap_cache_empty_magazine(ds_heap_cache_t *cache)
+{
+    ds_heap_magazine_t *magazine = ds_lifo_pop(&cache->empty);
+    if (!magazine)
+        magazine = ds_heap_alloc(&cache->magazine_heap);
+    if (magazine)
+        magazine->count = 0;
+    return magazine;
+}
+
+/**
+ * @brief Give back the magazines of the calling thread to the depot
+ *
+ * @param cache The cache
+ */
+static inline void ds_heap_cache_flush(ds_heap_cache_t *cache)
+{
+    ds_heap_cache_thread_t *thread = pthread_getspecific(cache->key);
+    if (!thread)
+        return;
+    pthread_mutex_lock(&cache->lock);
+    ds_heap_cache_deposit(cache, thread->loaded);
+    ds_heap_cache_deposit(cache, thread->previous);
+    pthread_mutex_unlock(&cache->lock);
+    pthread_setspecific(cache->key, 0);
+    free(thread);
+}
+
+// Thread exit destructor of the magazines
+static inline void ds_heap_cache_thread_exit(void *_thread)
+{
+    ds_heap_cache_thread_t *thread = _thread;
+    pthread_setspecific(thread->cache->key, thread);
+    ds_heap_cache_flush(thread->cache);
+}
+
+/**
+ * @brief Initialize a cache in front of a heap. The heap must no longer be
+ * used directly.
+ *
+ * @param cache The cache
+ * @param heap The heap
+ * @return 0 or -1 if the thread key can't be created
+ */
+static inline int ds_heap_cache_init(ds_heap_cache_t *cache, ds_heap_t *heap)
+{
+    if (pthread_key_create(&cache->key, ds_heap_cache_thread_exit) != 0)
+        return -1;
+    cache->heap = heap;
+    pthread_mutex_init(&cache->lock, 0);
+    ds_lifo_init(&cache->full, offsetof(ds_heap_magazine_t, depot_item));
+    ds_lifo_init(&cache->empty, offsetof(ds_heap_magazine_t, depot_item));
+    DS_HEAP_INIT_GROWABLE(cache->magazine_heap, DS_HEAP_CACHE_MAGAZINE_SLAB, ds_heap_magazine_t);
+    return 0;
+}
+
+/**
+ * @brief Give back all cached elements to the heap and release the cache.
+ * The other threads must have exited or flushed their magazines.
+ *
+ * @param cache The cache
+ */
+static inline void ds_heap_cache_destroy(ds_heap_cache_t *cache)
+{
+    ds_heap_magazine_t *magazine;
+    ds_heap_cache_flush(cache);
+    while ((magazine = ds_lifo_pop(&cache->full)) != 0)
+        while (magazine->count > 0)
+            ds_heap_free(cache->heap, magazine->objects[--magazine->count]);
+    ds_heap_destroy(&cache->magazine_heap);
+    pthread_key_delete(cache->key);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+// Get the magazines of the calling thread, created on first use
+static inline ds_heap_cache_thread_t *ds_heap_cache_thread(ds_heap_cache_t *cache)
+{
+    ds_heap_cache_thread_t *thread = pthread_getspecific(cache->key);
+    if (thread)
+        return thread;
+    thread = malloc(sizeof(ds_heap_cache_thread_t));
+    if (!thread)
+        return 0;
+    thread->cache = cache;
+    pthread_mutex_lock(&cache->lock);
+    thread->loaded = ds_heap_cache_empty_magazine(cache);
+    thread->previous = ds_heap_cache_empty_magazine(cache);
+    if (!thread->loaded || !thread->previous || pthread_setspecific(cache->key, thread) != 0)
+    {
+        if (thread->loaded)
+            ds_heap_cache_deposit(cache, thread->loaded);
+        if (thread->previous)
+            ds_heap_cache_deposit(cache, thread->previous);
+        free(thread);
+        thread = 0;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return thread;
+}
+
+// Load a full magazine from the depot, or fill the loaded one from the heap,
+// when both magazines of the thread are empty
+static inline void ds_heap_cache_reload(ds_heap_cache_thread_t *thread)
+{
+    ds_heap_cache_t *cache = thread->cache;
+    pthread_mutex_lock(&cache->lock);
+    ds_heap_magazine_t *full = ds_lifo_pop(&cache->full);
+    if (full)
+    {
+        ds_lifo_push(&cache->empty, thread->previous);
+        thread->previous = thread->loaded;
+        thread->loaded = full;
+    }
+    else
+    {
+        ds_heap_magazine_t *loaded = thread->loaded;
+        void *object;
+        while (loaded->count < DS_HEAP_CACHE_MAGAZINE_SIZE && (object = ds_heap_alloc(cache->heap)) != 0)
+            loaded->objects[loaded->count++] = object;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Move the previous magazine to the depot and load an empty one when both
+// magazines of the thread are full. It returns 0 if there is no empty
+// magazine and none can be allocated.
+static inline int ds_heap_cache_unload(ds_heap_cache_thread_t *thread)
+{
+    ds_heap_cache_t *cache = thread->cache;
+    pthread_mutex_lock(&cache->lock);
+    ds_heap_magazine_t *empty = ds_heap_cache_empty_magazine(cache);
+    if (empty)
+    {
+        ds_lifo_push(&cache->full, thread->previous);
+        thread->previous = thread->loaded;
+        thread->loaded = empty;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return empty != 0;
+}
+
+static inline void ds_heap_cache_swap(ds_heap_cache_thread_t *thread)
+{
+    ds_heap_magazine_t *magazine = thread->loaded;
+    thread->loaded = thread->previous;
+    thread->previous = magazine;
+}
+
+/**
+ * @brief Take an element from the magazines of the calling thread
+ *
+ * @param cache The cache
+ * @return The taken element or 0 if the heap is exhausted
+ */
+static inline void *ds_heap_cache_alloc(ds_heap_cache_t *cache)
+{
+    ds_heap_cache_thread_t *thread = ds_heap_cache_thread(cache);
+    if (!thread)
+        return 0;
+    if (thread->loaded->count == 0)
+    {
+        if (thread->previous->count > 0)
+            ds_heap_cache_swap(thread);
+        else
+        {
+            ds_heap_cache_reload(thread);
+            if (thread->loaded->count == 0)
+                return 0;
+        }
+    }
+    return thread->loaded->objects[--thread->loaded->count];
+}
+
+/**
+ * @brief Give back an element to the magazines of the calling thread
+ *
+ * @param cache The cache
+ * @param object The element, allocated by any thread
+ */
+static inline void ds_heap_cache_free(ds_heap_cache_t *cache, void *object)
+{
+    ds_heap_cache_thread_t *thread = ds_heap_cache_thread(cache);
+    if (thread && thread->loaded->count == DS_HEAP_CACHE_MAGAZINE_SIZE)
+    {
+        if (thread->previous->count == 0)
+            ds_heap_cache_swap(thread);
+        else if (!ds_heap_cache_unload(thread))
+            thread = 0;
+    }
+    if (!thread)
+    {
+        // No magazine: the element goes straight back to the heap
+        pthread_mutex_lock(&cache->lock);
+        ds_heap_free(cache->heap, object);
+        pthread_mutex_unlock(&cache->lock);
+        return;
+    }
+    thread->loaded->objects[thread->loaded->count++] = object;
+}
+
+#endif // __DS_HEAP_CACHE_H__
@@ -0,0 +1,220 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ds_hmap.h"
+
+#define DS_HMAP_EMPTY ((int8_t)0x80)
+#define DS_HMAP_DELETED ((int8_t)0xfe)
+
+// Control bytes of full slots are the low 7 bits of the hash, the groups are
+// probed from the other bits
+#define DS_HMAP_H1(_hash) ((_hash) >> 7)
+#define DS_HMAP_H2(_hash) ((int8_t)((_hash) & 0x7f))
+
+// Bit masks of the slots of a group whose control byte is `h2`, is empty, or
+// is empty or deleted. Only the empty and deleted marks have their high bit
+// set.
+#ifdef __SSE2__
+static inline unsigned ds_hmap_match(int8_t *ctrl, int8_t h2)
+{
+    __m128i group = _mm_loadu_si128((__m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+}
+
+static inline unsigned ds_hmap_match_empty_or_deleted(int8_t *ctrl)
+{
+    return _mm_movemask_epi8(_mm_loadu_si128((__m128i *)ctrl));
+}
+#else
+static inline unsigned ds_hmap_match(int8_t *ctrl, int8_t h2)
+{
+    unsigned mask = 0;
+    for (int i = 0; i < DS_HMAP_GROUP_SIZE; i++)
+        mask |= (unsigned)(ctrl[i] == h2) << i;
+    return mask;
+}
+
+static inline unsigned ds_hmap_match_empty_or_deleted(int8_t *ctrl)
+{
+    unsigned mask = 0;
+    for (int i = 0; i < DS_HMAP_GROUP_SIZE; i++)
+        mask |= (unsigned)(ctrl[i] < 0) << i;
+    return mask;
+}
+#endif
+
+static inline unsigned ds_hmap_match_empty(int8_t *ctrl)
+{
+    return ds_hmap_match(ctrl, DS_HMAP_EMPTY);
+}
+
+// Find the slot of the object equal to a key, or -1. The groups are probed
+// with triangular steps, which visit every group of a power of 2 count. The
+// probe stops at the first group with an empty slot: an insertion never goes
+// past such a group.
+static size_t ds_hmap_find_slot(ds_hmap_t *hmap, uint64_t hash, void *key)
+{
+    size_t group = DS_HMAP_H1(hash) & hmap->_group_mask;
+    int8_t h2 = DS_HMAP_H2(hash);
+    for (size_t step = 1;; step++)
+    {
+        int8_t *ctrl = &hmap->_ctrl[group * DS_HMAP_GROUP_SIZE];
+        for (unsigned match = ds_hmap_match(ctrl, h2); match; match &= match - 1)
+        {
+            size_t slot = group * DS_HMAP_GROUP_SIZE + __builtin_ctz(match);
+            if (hmap->eq(key, hmap->slots[slot]))
+                return slot;
+        }
+        if (ds_hmap_match_empty(ctrl))
+            return -1;
+        group = (group + step) & hmap->_group_mask;
+    }
+}
+
+// Find the first empty or deleted slot on the probe sequence of a hash
+static size_t ds_hmap_free_slot(ds_hmap_t *hmap, uint64_t hash)
+{
+    size_t group = DS_HMAP_H1(hash) & hmap->_group_mask;
+    for (size_t step = 1;; step++)
+    {
+        unsigned match = ds_hmap_match_empty_or_deleted(&hmap->_ctrl[group * DS_HMAP_GROUP_SIZE]);
+        if (match)
+            return group * DS_HMAP_GROUP_SIZE + __builtin_ctz(match);
+        group = (group + step) & hmap->_group_mask;
+    }
+}
+
+static int ds_hmap_alloc(ds_hmap_t *hmap, size_t groups)
+{
+    size_t slots = groups * DS_HMAP_GROUP_SIZE;
+    void **store = malloc(slots * (sizeof(void *) + 1));
+    if (store == 0)
+        return -1;
+    hmap->slots = store;
+    hmap->_ctrl = (int8_t *)(store + slots);
+    memset(hmap->_ctrl, DS_HMAP_EMPTY, slots);
+    hmap->_group_mask = groups - 1;
+    hmap->_growth_left = slots - slots / 8;
+    return 0;
+}
+
+// Move all objects to new slots, twice as many unless the deleted slots are
+// enough to make room
+static int ds_hmap_rehash(ds_hmap_t *hmap)
+{
+    ds_hmap_t old = *hmap;
+    size_t slots = (old._group_mask + 1) * DS_HMAP_GROUP_SIZE;
+    size_t groups = old._group_mask + 1;
+    if (old.count >= slots / 2 - slots / 16)
+        groups *= 2;
+    if (ds_hmap_alloc(hmap, groups) == -1)
+        return -1;
+    for (size_t slot = 0; slot < slots; slot++)
+    {
+        if (old._ctrl[slot] < 0)
+            continue;
+        uint64_t hash = hmap->hash(old.slots[slot]);
+        size_t new_slot = ds_hmap_free_slot(hmap, hash);
+        hmap->_ctrl[new_slot] = DS_HMAP_H2(hash);
+        hmap->slots[new_slot] = old.slots[slot];
+    }
+    hmap->_growth_left -= old.count;
+    free(old.slots);
+    return 0;
+}
+
+int ds_hmap_init(ds_hmap_t *hmap, ds_htable_hash_f hash, ds_htable_eq_f eq, size_t size)
+{
+    size_t groups = 1;
+    while (groups * DS_HMAP_GROUP_SIZE * 7 / 8 < size)
+        groups <<= 1;
+    hmap->count = 0;
+    hmap->hash = hash;
+    hmap->eq = eq;
+    return ds_hmap_alloc(hmap, groups);
+}
+
+void ds_hmap_destroy(ds_hmap_t *hmap)
+{
+    free(hmap->slots);
+    hmap->slots = 0;
+    hmap->_ctrl = 0;
+    hmap->count = 0;
+}
+
+void *ds_hmap_insert(ds_hmap_t *hmap, void *object)
+{
+    uint64_t hash = hmap->hash(object);
+    size_t slot = ds_hmap_find_slot(hmap, hash, object);
+    if (slot != (size_t)-1)
+        return hmap->slots[slot];
+    slot = ds_hmap_free_slot(hmap, hash);
+    // Filling a deleted slot leaves the count of empty slots unchanged
+    if (hmap->_ctrl[slot] == DS_HMAP_EMPTY)
+    {
+        if (hmap->_growth_left == 0)
+        {
+            if (ds_hmap_rehash(hmap) == -1)
+                return 0;
+            slot = ds_hmap_free_slot(hmap, hash);
+        }
+        hmap->_growth_left--;
+    }
+    hmap->_ctrl[slot] = DS_HMAP_H2(hash);
+    hmap->slots[slot] = object;
+    hmap->count++;
+    return object;
+}
+
+void *ds_hmap_find(ds_hmap_t *hmap, void *key)
+{
+    size_t slot = ds_hmap_find_slot(hmap, hmap->hash(key), key);
+    return slot == (size_t)-1 ? 0 : hmap->slots[slot];
+}
+
+void *ds_hmap_remove(ds_hmap_t *hmap, void *key)
+{
+    size_t slot = ds_hmap_find_slot(hmap, hmap->hash(key), key);
+    if (slot == (size_t)-1)
+        return 0;
+    // A group with an empty slot has never been full, so no probe went past it
+    // and the slot can be empty again
+    int8_t *ctrl = &hmap->_ctrl[slot & ~(size_t)(DS_HMAP_GROUP_SIZE - 1)];
+    if (ds_hmap_match_empty(ctrl))
+    {
+        hmap->_ctrl[slot] = DS_HMAP_EMPTY;
+        hmap->_growth_left++;
+    }
+    else
+        hmap->_ctrl[slot] = DS_HMAP_DELETED;
+    hmap->count--;
+    return hmap->slots[slot];
+}
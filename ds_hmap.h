@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_HMAP_H__
+#define __DS_HMAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ds_common.h"
+#include "ds_htable.h"
+
+/**
+ * @brief Number of slots probed at once, with one SSE2 comparison when
+ * available
+ */
+#define DS_HMAP_GROUP_SIZE 16
+
+/**
+ * @brief A hash map of objects with unique keys, by open addressing. It stores
+ * pointers to the objects in a flat array of slots, so the objects need no
+ * item. Each slot has a control byte holding 7 bits of the hash of its object,
+ * or a mark for an empty or a deleted slot. Lookups compare the control bytes
+ * of a group of slots at once and only call the equality function on the
+ * slots whose hash bits match. A removed slot is marked empty, not deleted,
+ * when its group has never been full. The map holds up to 7/8 of its slots,
+ * an entry costs 9 bytes per slot.
+ */
+typedef struct ds_hmap_s ds_hmap_t;
+struct ds_hmap_s
+{
+    size_t count;
+    void **slots;
+    int8_t *_ctrl;
+    size_t _group_mask;
+    size_t _growth_left;
+    ds_htable_hash_f hash;
+    ds_htable_eq_f eq;
+};
+
+/**
+ * @brief Initialize a hash map
+ *
+ * @param hmap The hash map
+ * @param hash Hash function of the objects
+ * @param eq Equality function between objects
+ * @param size Expected number of objects, 0 if unknown
+ * @return 0 on success, -1 if the slots cannot be allocated
+ */
+int ds_hmap_init(ds_hmap_t *hmap, ds_htable_hash_f hash, ds_htable_eq_f eq, size_t size);
+
+/**
+ * @brief Free the slots of a hash map. The objects are left untouched.
+ *
+ * @param hmap The hash map
+ */
+void ds_hmap_destroy(ds_hmap_t *hmap);
+
+/**
+ * @brief Insert an object
+ *
+ * @param hmap The hash map
+ * @param object The object
+ * @return If `object` has no equal object in the hash map, the object is
+ * inserted and the function returns `object`. Otherwise, it is not inserted
+ * and the function returns the equal object. If the hash map needs to grow and
+ * the slots cannot be allocated, the function returns 0.
+ */
+void *ds_hmap_insert(ds_hmap_t *hmap, void *object);
+
+/**
+ * @brief Find the object equal to a key. See ds_htable_find().
+ *
+ * @param hmap The hash map
+ * @param key The key to look for
+ * @return The equal object or 0 if there is none
+ */
+void *ds_hmap_find(ds_hmap_t *hmap, void *key);
+
+/**
+ * @brief Remove the object equal to a key
+ *
+ * @param hmap The hash map
+ * @param key The key to look for
+ * @return The removed object or 0 if there is none
+ */
+void *ds_hmap_remove(ds_hmap_t *hmap, void *key);
+
+#endif // __DS_HMAP_H__
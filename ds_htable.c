@@ -0,0 +1,200 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "ds_htable.h"
+#include "ds_htable_ext.h"
+
+#define DS_HTABLE_BUCKETS_MIN 16
+
+static inline void *ds_htable_object_of(ds_htable_t *htable, ds_htable_item_t *node)
+{
+    return htable->_offset_in_object == (size_t)-1 ? ((ds_htable_ext_item_t *)node)->object : DS_OBJECT_OF(htable, node);
+}
+
+// Find the link to the node equal to a key in a chain, or 0. The cached hashes
+// avoid most calls to the equality function.
+static ds_htable_item_t **ds_htable_chain_find(ds_htable_t *htable, ds_htable_item_t **link, uint64_t hash, void *key)
+{
+    for (; *link; link = &(*link)->next)
+        if ((*link)->hash == hash && htable->eq(key, ds_htable_object_of(htable, *link)))
+            return link;
+    return 0;
+}
+
+// While the table grows, a node is either in its bucket of the previous table,
+// if that bucket is not migrated yet, or in the current table.
+static ds_htable_item_t **ds_htable_node_find(ds_htable_t *htable, uint64_t hash, void *key)
+{
+    if (htable->_old_buckets)
+    {
+        size_t index = hash & htable->_old_mask;
+        if (index >= htable->_migrated)
+        {
+            ds_htable_item_t **link = ds_htable_chain_find(htable, &htable->_old_buckets[index], hash, key);
+            if (link)
+                return link;
+        }
+    }
+    return ds_htable_chain_find(htable, &htable->buckets[hash & htable->_mask], hash, key);
+}
+
+// Move a few buckets of the previous table to the current one. The previous
+// table is fully migrated before the current one needs to grow: it grows when
+// it holds as many objects as buckets, that is twice the number of buckets of
+// the previous table.
+static void ds_htable_migrate(ds_htable_t *htable)
+{
+    if (htable->_old_buckets == 0)
+        return;
+    size_t end = htable->_migrated + DS_HTABLE_MIGRATE_BUCKETS;
+    if (end > htable->_old_mask + 1)
+        end = htable->_old_mask + 1;
+    for (; htable->_migrated < end; htable->_migrated++)
+    {
+        ds_htable_item_t *node = htable->_old_buckets[htable->_migrated];
+        while (node)
+        {
+            ds_htable_item_t *next = node->next;
+            ds_htable_item_t **bucket = &htable->buckets[node->hash & htable->_mask];
+            node->next = *bucket;
+            *bucket = node;
+            node = next;
+        }
+    }
+    if (htable->_migrated > htable->_old_mask)
+    {
+        free(htable->_old_buckets);
+        htable->_old_buckets = 0;
+    }
+}
+
+// Start the migration to a table twice as large. If it cannot be allocated, the
+// chains just get longer.
+static void ds_htable_grow(ds_htable_t *htable)
+{
+    ds_htable_item_t **buckets = calloc(2 * (htable->_mask + 1), sizeof(ds_htable_item_t *));
+    if (buckets == 0)
+        return;
+    htable->_old_buckets = htable->buckets;
+    htable->_old_mask = htable->_mask;
+    htable->_migrated = 0;
+    htable->buckets = buckets;
+    htable->_mask = 2 * htable->_mask + 1;
+}
+
+static void *ds_htable_node_insert(ds_htable_t *htable, ds_htable_item_t *node, void *object)
+{
+    ds_htable_migrate(htable);
+    uint64_t hash = htable->hash(object);
+    ds_htable_item_t **link = ds_htable_node_find(htable, hash, object);
+    if (link)
+        return ds_htable_object_of(htable, *link);
+    ds_htable_item_t **bucket = &htable->buckets[hash & htable->_mask];
+    node->hash = hash;
+    node->next = *bucket;
+    *bucket = node;
+    htable->count++;
+    if (htable->count > htable->_mask && htable->_old_buckets == 0)
+        ds_htable_grow(htable);
+    return object;
+}
+
+static int ds_htable_buckets_init(ds_htable_t *htable, size_t size)
+{
+    size_t count = DS_HTABLE_BUCKETS_MIN;
+    while (count < size)
+        count <<= 1;
+    htable->count = 0;
+    htable->buckets = calloc(count, sizeof(ds_htable_item_t *));
+    htable->_mask = count - 1;
+    htable->_old_buckets = 0;
+    htable->_old_mask = 0;
+    htable->_migrated = 0;
+    return htable->buckets ? 0 : -1;
+}
+
+int ds_htable_init(ds_htable_t *htable, size_t offset_in_object, ds_htable_hash_f hash, ds_htable_eq_f eq, size_t size)
+{
+    htable->_offset_in_object = offset_in_object;
+    htable->hash = hash;
+    htable->eq = eq;
+    return ds_htable_buckets_init(htable, size);
+}
+
+int ds_htable_ext_init(ds_htable_ext_t *htable, ds_htable_hash_f hash, ds_htable_eq_f eq, size_t size)
+{
+    return ds_htable_init(htable, -1, hash, eq, size);
+}
+
+void ds_htable_destroy(ds_htable_t *htable)
+{
+    free(htable->buckets);
+    free(htable->_old_buckets);
+    htable->buckets = 0;
+    htable->_old_buckets = 0;
+    htable->count = 0;
+}
+
+void *ds_htable_insert(ds_htable_t *htable, void *object)
+{
+    return ds_htable_node_insert(htable, (ds_htable_item_t *)((char *)object + htable->_offset_in_object), object);
+}
+
+void *ds_htable_ext_insert(ds_htable_ext_t *htable, ds_htable_ext_item_t *item, void *object)
+{
+    item->object = object;
+    return ds_htable_node_insert(htable, (ds_htable_item_t *)item, object);
+}
+
+void *ds_htable_find(ds_htable_t *htable, void *key)
+{
+    ds_htable_item_t **link = ds_htable_node_find(htable, htable->hash(key), key);
+    return link ? ds_htable_object_of(htable, *link) : 0;
+}
+
+void *ds_htable_remove(ds_htable_t *htable, void *key)
+{
+    ds_htable_migrate(htable);
+    ds_htable_item_t **link = ds_htable_node_find(htable, htable->hash(key), key);
+    if (link == 0)
+        return 0;
+    ds_htable_item_t *node = *link;
+    *link = node->next;
+    htable->count--;
+    return ds_htable_object_of(htable, node);
+}
+
+void *ds_htable_ext_remove(ds_htable_ext_t *htable, ds_htable_ext_item_t *item)
+{
+    ds_htable_migrate(htable);
+    ds_htable_item_t **link = ds_htable_node_find(htable, htable->hash(item->object), item->object);
+    if (link == 0 || *link != (ds_htable_item_t *)item)
+        return 0;
+    *link = (ds_htable_item_t *)item->next;
+    htable->count--;
+    return item->object;
+}
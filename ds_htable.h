@@ -0,0 +1,134 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_HTABLE_H__
+#define __DS_HTABLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ds_common.h"
+
+/**
+ * @brief Number of buckets of the previous table moved to the current table
+ * by each insertion or removal, while a hash table grows
+ */
+#ifndef DS_HTABLE_MIGRATE_BUCKETS
+#define DS_HTABLE_MIGRATE_BUCKETS 8
+#endif
+
+typedef struct ds_htable_item_s ds_htable_item_t;
+struct ds_htable_item_s
+{
+    ds_htable_item_t *next;
+    uint64_t hash;
+};
+
+/**
+ * @brief Hash function prototype. The low bits of the hash select the bucket,
+ * they must be well distributed.
+ *
+ */
+typedef uint64_t (*ds_htable_hash_f)(void *);
+
+/**
+ * @brief Equality function prototype. It returns non zero if both objects
+ * have the same key.
+ *
+ */
+typedef int (*ds_htable_eq_f)(void *, void *);
+
+/**
+ * @brief A hash table of objects with unique keys, chained in buckets. The
+ * table doubles when it holds as many objects as buckets. The buckets of the
+ * previous table are then moved by small steps on the next insertions and
+ * removals, so no operation ever rehashes the whole table.
+ */
+typedef struct ds_htable_s ds_htable_t;
+struct ds_htable_s
+{
+    size_t count;
+    ds_htable_item_t **buckets;
+    size_t _offset_in_object;
+    ds_htable_hash_f hash;
+    ds_htable_eq_f eq;
+    size_t _mask;
+    ds_htable_item_t **_old_buckets;
+    size_t _old_mask;
+    size_t _migrated;
+};
+
+/**
+ * @brief Initialize a hash table
+ *
+ * @param htable The hash table
+ * @param offset_in_object Offset of the ds_htable_item_t in the objects
+ * @param hash Hash function of the objects
+ * @param eq Equality function between objects
+ * @param size Expected number of objects, 0 if unknown
+ * @return 0 on success, -1 if the buckets cannot be allocated
+ */
+int ds_htable_init(ds_htable_t *htable, size_t offset_in_object, ds_htable_hash_f hash, ds_htable_eq_f eq, size_t size);
+
+/**
+ * @brief Free the buckets of a hash table. The objects are left untouched.
+ *
+ * @param htable The hash table
+ */
+void ds_htable_destroy(ds_htable_t *htable);
+
+/**
+ * @brief Insert an object
+ *
+ * @param htable The hash table
+ * @param object The object
+ * @return If `object` has no equal object in the hash table, the object is
+ * inserted and the function returns `object`. Otherwise, it is not inserted
+ * and the function returns the equal object.
+ */
+void *ds_htable_insert(ds_htable_t *htable, void *object);
+
+/**
+ * @brief Find the object equal to a key. The hash function is called on `key`
+ * and the equality function with `key` as its first argument, so `key` needs
+ * not be linked in any hash table. The hash table is not modified, so finds
+ * can run concurrently.
+ *
+ * @param htable The hash table
+ * @param key The key to look for
+ * @return The equal object or 0 if there is none
+ */
+void *ds_htable_find(ds_htable_t *htable, void *key);
+
+/**
+ * @brief Remove the object equal to a key
+ *
+ * @param htable The hash table
+ * @param key The key to look for
+ * @return The removed object or 0 if there is none
+ */
+void *ds_htable_remove(ds_htable_t *htable, void *key);
+
+#endif // __DS_HTABLE_H__
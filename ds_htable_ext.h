@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_HTABLE_EXT_H__
+#define __DS_HTABLE_EXT_H__
+
+#include <stddef.h>
+
+#include "ds_htable.h"
+
+typedef struct ds_htable_ext_item_s ds_htable_ext_item_t;
+struct ds_htable_ext_item_s
+{
+    ds_htable_ext_item_t *next;
+    uint64_t hash;
+    void *object;
+};
+
+typedef ds_htable_t ds_htable_ext_t;
+
+/**
+ * @brief Initialize a hash table of external items. See ds_htable_init().
+ */
+int ds_htable_ext_init(ds_htable_ext_t *htable, ds_htable_hash_f hash, ds_htable_eq_f eq, size_t size);
+
+/**
+ * @brief Free the buckets of a hash table. See ds_htable_destroy().
+ */
+static inline void ds_htable_ext_destroy(ds_htable_ext_t *htable)
+{
+    ds_htable_destroy(htable);
+}
+
+/**
+ * @brief Insert an item and associate the related object. See
+ * ds_htable_insert().
+ *
+ * @param htable The hash table
+ * @param item The item to insert
+ * @param object The associated object
+ */
+void *ds_htable_ext_insert(ds_htable_ext_t *htable, ds_htable_ext_item_t *item, void *object);
+
+/**
+ * @brief Find the object equal to a key. See ds_htable_find().
+ */
+static inline void *ds_htable_ext_find(ds_htable_ext_t *htable, void *key)
+{
+    return ds_htable_find(htable, key);
+}
+
+/**
+ * @brief Remove an item from a hash table
+ *
+ * @param htable The hash table
+ * @param item The item in the hash table to remove
+ * @return The object of the item or 0 if the item is not in the hash table
+ */
+void *ds_htable_ext_remove(ds_htable_ext_t *htable, ds_htable_ext_item_t *item);
+
+#endif // __DS_HTABLE_EXT_H__
@@ -70,4 +70,113 @@ static inline void *ds_lifo_pop(ds_lifo_t *lifo)
     return DS_OBJECT_OF(lifo, item);
 }
 
+/**
+ * @brief Push a chain of objects already linked by their items, in O(1). The
+ * first object of the chain becomes the top of the lifo.
+ *
+ * @param lifo The lifo
+ * @param first The first object of the chain
+ * @param last The last object of the chain, whose next item is ignored
+ * @param count The number of objects of the chain
+ */
+static inline void ds_lifo_push_chain(ds_lifo_t *lifo, void *first, void *last, size_t count)
+{
+    DS_ITEM_OF(lifo, last)->next = lifo->root;
+    lifo->root = DS_ITEM_OF(lifo, first);
+    lifo->count += count;
+}
+
+/**
+ * @brief Move all objects of `other` on top of the lifo, keeping their order.
+ * `other` is left empty. A lifo does not know its bottom, so this walks
+ * `other`: use ds_lifo_push_chain() when the last object is known.
+ *
+ * @param lifo The lifo
+ * @param other A lifo with the same offset in objects
+ */
+static inline void ds_lifo_concat(ds_lifo_t *lifo, ds_lifo_t *other)
+{
+    ds_lifo_item_t *last = other->root;
+    if (!last)
+        return;
+    while (last->next)
+        last = last->next;
+    last->next = lifo->root;
+    lifo->root = other->root;
+    lifo->count += other->count;
+    other->root = 0;
+    other->count = 0;
+}
+
+/**
+ * @brief Pop up to `count` objects
+ *
+ * @param lifo The lifo
+ * @param objects The array receiving the objects, from the top one
+ * @param count The size of the array
+ * @return The number of popped objects
+ */
+static inline size_t ds_lifo_pop_batch(ds_lifo_t *lifo, void **objects, size_t count)
+{
+    ds_lifo_item_t *item = lifo->root;
+    size_t i;
+    for (i = 0; i < count && item; i++)
+    {
+        ds_lifo_item_t *next = item->next;
+        item->next = 0;
+        objects[i] = DS_OBJECT_OF(lifo, item);
+        item = next;
+    }
+    lifo->root = item;
+    lifo->count -= i;
+    return i;
+}
+
+/**
+ * @brief Define functions specialized for a type of object, where the offset
+ * of the item in the object is a constant. The defined functions are
+ * `_name##_push`, `_name##_pop`, `_name##_first`, `_name##_next` and
+ * `_name##_object_of`. `_name##_first` and `_name##_next` walk the lifo
+ * without popping, from the top object to the bottom.
+ *
+ * @param _name Prefix of the defined functions
+ * @param _type_t Type of the objects
+ * @param _member Name of the ds_lifo_item_t member of _type_t
+ */
+#define DS_LIFO_DEFINE(_name, _type_t, _member)                                  \
+    static inline _type_t *_name##_object_of(ds_lifo_item_t *item)               \
+    {                                                                            \
+        return (_type_t *)((char *)item - offsetof(_type_t, _member));           \
+    }                                                                            \
+                                                                                 \
+    static inline void _name##_push(ds_lifo_t *lifo, _type_t *object)            \
+    {                                                                            \
+        ds_lifo_item_t *item = &object->_member;                                 \
+        lifo->count++;                                                           \
+        item->next = lifo->root;                                                 \
+        lifo->root = item;                                                       \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_pop(ds_lifo_t *lifo)                          \
+    {                                                                            \
+        ds_lifo_item_t *item = lifo->root;                                       \
+        if (!item)                                                               \
+            return 0;                                                            \
+        lifo->root = item->next;                                                 \
+        item->next = 0;                                                          \
+        lifo->count--;                                                           \
+        return _name##_object_of(item);                                          \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_first(ds_lifo_t *lifo)                        \
+    {                                                                            \
+        return lifo->root ? _name##_object_of(lifo->root) : 0;                   \
+    }                                                                            \
+                                                                                 \
+    static inline _type_t *_name##_next(_type_t *object)                         \
+    {                                                                            \
+        ds_lifo_item_t *next = object->_member.next;                             \
+        return next ? _name##_object_of(next) : 0;                               \
+    }
+
 #endif // __DS_LIFO_H__
@@ -0,0 +1,165 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_LIFO_ATOMIC_H__
+#define __DS_LIFO_ATOMIC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "ds_common.h"
+#include "ds_lifo.h"
+
+/**
+ * @brief Top of an atomic lifo: the root item and a tag incremented by each
+ * pop, swapped together by a double width compare and swap. A pop which read
+ * a root item, then was delayed while this item was popped and pushed again,
+ * sees a different tag and retries.
+ */
+typedef struct ds_lifo_atomic_top_s ds_lifo_atomic_top_t;
+struct ds_lifo_atomic_top_s
+{
+    ds_lifo_item_t *root;
+    uintptr_t tag;
+};
+
+/**
+ * @brief A lifo shared between threads with no lock (a Treiber stack), on the
+ * same ds_lifo_item_t items as ds_lifo_t. It has no count.
+ *
+ * A pop may read the link of an item that another thread has just popped: the
+ * objects must stay mapped while the lifo is used, as the elements of a
+ * ds_heap_t do, and the value read is then discarded. Needs libatomic on some
+ * targets.
+ */
+typedef struct ds_lifo_atomic_s ds_lifo_atomic_t;
+struct ds_lifo_atomic_s
+{
+    _Atomic ds_lifo_atomic_top_t top;
+    size_t _offset_in_object;
+};
+
+static inline void ds_lifo_atomic_init(ds_lifo_atomic_t *lifo, size_t offset_in_object)
+{
+    ds_lifo_atomic_top_t top = {0, 0};
+    atomic_init(&lifo->top, top);
+    lifo->_offset_in_object = offset_in_object;
+}
+
+// Link a chain of items, from `first` to `last`, on top of the lifo
+static inline void ds_lifo_atomic_link(ds_lifo_atomic_t *lifo, ds_lifo_item_t *first, ds_lifo_item_t *last)
+{
+    ds_lifo_atomic_top_t top = atomic_load_explicit(&lifo->top, memory_order_relaxed);
+    ds_lifo_atomic_top_t new_top;
+    do
+    {
+        __atomic_store_n(&last->next, top.root, __ATOMIC_RELAXED);
+        new_top.root = first;
+        new_top.tag = top.tag;
+    } while (!atomic_compare_exchange_weak_explicit(&lifo->top, &top, new_top, memory_order_release, memory_order_relaxed));
+}
+
+/**
+ * @brief Push an object. Safe from any number of threads.
+ */
+static inline void ds_lifo_atomic_push(ds_lifo_atomic_t *lifo, void *object)
+{
+    ds_lifo_item_t *item = (ds_lifo_item_t *)((char *)object + lifo->_offset_in_object);
+    ds_lifo_atomic_link(lifo, item, item);
+}
+
+/**
+ * @brief Push all objects of a lifo, keeping their order, with a single
+ * compare and swap. The lifo `chain` is left empty.
+ *
+ * @param lifo The atomic lifo
+ * @param chain A lifo with the same offset in objects
+ */
+static inline void ds_lifo_atomic_push_chain(ds_lifo_atomic_t *lifo, ds_lifo_t *chain)
+{
+    ds_lifo_item_t *last = chain->root;
+    if (!last)
+        return;
+    while (last->next)
+        last = last->next;
+    ds_lifo_atomic_link(lifo, chain->root, last);
+    chain->root = 0;
+    chain->count = 0;
+}
+
+/**
+ * @brief Pop an object. Safe from any number of threads.
+ *
+ * @return The object or 0 if the lifo is empty
+ */
+static inline void *ds_lifo_atomic_pop(ds_lifo_atomic_t *lifo)
+{
+    ds_lifo_atomic_top_t top = atomic_load_explicit(&lifo->top, memory_order_acquire);
+    ds_lifo_atomic_top_t new_top;
+    do
+    {
+        if (!top.root)
+            return 0;
+        new_top.root = __atomic_load_n(&top.root->next, __ATOMIC_RELAXED);
+        new_top.tag = top.tag + 1;
+    } while (!atomic_compare_exchange_weak_explicit(&lifo->top, &top, new_top, memory_order_acquire, memory_order_acquire));
+    __atomic_store_n(&top.root->next, 0, __ATOMIC_RELAXED);
+    return DS_OBJECT_OF(lifo, top.root);
+}
+
+/**
+ * @brief Pop all objects with a single compare and swap and push them,
+ * keeping their order, on a lifo owned by the calling thread
+ *
+ * @param lifo The atomic lifo
+ * @param chain A lifo with the same offset in objects
+ * @return The number of popped objects
+ */
+static inline size_t ds_lifo_atomic_pop_all(ds_lifo_atomic_t *lifo, ds_lifo_t *chain)
+{
+    ds_lifo_atomic_top_t top = atomic_load_explicit(&lifo->top, memory_order_relaxed);
+    ds_lifo_atomic_top_t new_top;
+    do
+    {
+        if (!top.root)
+            return 0;
+        new_top.root = 0;
+        new_top.tag = top.tag + 1;
+    } while (!atomic_compare_exchange_weak_explicit(&lifo->top, &top, new_top, memory_order_acquire, memory_order_relaxed));
+    size_t count = 1;
+    ds_lifo_item_t *last = top.root;
+    while (last->next)
+    {
+        last = last->next;
+        count++;
+    }
+    __atomic_store_n(&last->next, chain->root, __ATOMIC_RELAXED);
+    chain->root = top.root;
+    chain->count += count;
+    return count;
+}
+
+#endif // __DS_LIFO_ATOMIC_H__
@@ -69,4 +69,54 @@ static inline void *ds_lifo_ext_pop(ds_lifo_ext_t *lifo)
     return item->object;
 }
 
+/**
+ * @brief Push a chain of items already linked and associated with their
+ * objects, in O(1). The next item of `last` is ignored.
+ */
+static inline void ds_lifo_ext_push_chain(ds_lifo_ext_t *lifo, ds_lifo_ext_item_t *first, ds_lifo_ext_item_t *last, size_t count)
+{
+    last->next = lifo->root;
+    lifo->root = first;
+    lifo->count += count;
+}
+
+/**
+ * @brief Move all items of `other` on top of the lifo, keeping their order.
+ * See ds_lifo_concat().
+ */
+static inline void ds_lifo_ext_concat(ds_lifo_ext_t *lifo, ds_lifo_ext_t *other)
+{
+    ds_lifo_ext_item_t *last = other->root;
+    if (!last)
+        return;
+    while (last->next)
+        last = last->next;
+    last->next = lifo->root;
+    lifo->root = other->root;
+    lifo->count += other->count;
+    other->root = 0;
+    other->count = 0;
+}
+
+/**
+ * @brief Pop up to `count` objects into an array, from the top one
+ *
+ * @return The number of popped objects
+ */
+static inline size_t ds_lifo_ext_pop_batch(ds_lifo_ext_t *lifo, void **objects, size_t count)
+{
+    ds_lifo_ext_item_t *item = lifo->root;
+    size_t i;
+    for (i = 0; i < count && item; i++)
+    {
+        ds_lifo_ext_item_t *next = item->next;
+        item->next = 0;
+        objects[i] = item->object;
+        item = next;
+    }
+    lifo->root = item;
+    lifo->count -= i;
+    return i;
+}
+
 #endif // __DS_LIFO_EXT_H__
@@ -0,0 +1,162 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_LIFO_UNROLLED_H__
+#define __DS_LIFO_UNROLLED_H__
+
+#include <stddef.h>
+
+#include "ds_common.h"
+#include "ds_chunk.h"
+
+/**
+ * @brief Lifo of object pointers stored by chunks of DS_CHUNK_NMEMB, instead
+ * of one ds_lifo_ext_item_t per object. The root chunk holds the top of the
+ * lifo and links to the chunks below with its `prev` pointer. A chunk goes
+ * back to the heap as soon as it is empty.
+ */
+typedef struct ds_lifo_unrolled_s ds_lifo_unrolled_t;
+struct ds_lifo_unrolled_s
+{
+    size_t count;
+    ds_chunk_t *root;
+    ds_heap_t *chunk_heap;
+};
+
+/**
+ * @brief Initialize an unrolled lifo
+ *
+ * @param lifo The lifo
+ * @param chunk_heap A heap of ds_chunk_t where chunks are taken from
+ */
+static inline void ds_lifo_unrolled_init(ds_lifo_unrolled_t *lifo, ds_heap_t *chunk_heap)
+{
+    lifo->root = 0;
+    lifo->count = 0;
+    lifo->chunk_heap = chunk_heap;
+}
+
+/**
+ * @brief Push an object on top of the lifo
+ *
+ * @return 0 or -1 if no chunk can be taken from the heap
+ */
+static inline int ds_lifo_unrolled_push(ds_lifo_unrolled_t *lifo, void *object)
+{
+    ds_chunk_t *root = lifo->root;
+    if (!root || root->end == DS_CHUNK_NMEMB)
+    {
+        ds_chunk_t *chunk = ds_chunk_alloc(lifo->chunk_heap, 0);
+        if (!chunk)
+            return -1;
+        chunk->prev = root;
+        lifo->root = root = chunk;
+    }
+    root->object[root->end++] = object;
+    lifo->count++;
+    return 0;
+}
+
+/**
+ * @brief Pop the object on top of the lifo
+ *
+ * @return The object or 0 if the lifo is empty
+ */
+static inline void *ds_lifo_unrolled_pop(ds_lifo_unrolled_t *lifo)
+{
+    ds_chunk_t *root = lifo->root;
+    if (!root)
+        return 0;
+    void *object = root->object[--root->end];
+    lifo->count--;
+    if (root->end == 0)
+    {
+        lifo->root = root->prev;
+        ds_heap_free(lifo->chunk_heap, root);
+    }
+    return object;
+}
+
+/**
+ * @brief Pop up to `count` objects into an array, from the top one
+ *
+ * @return The number of popped objects
+ */
+static inline size_t ds_lifo_unrolled_pop_batch(ds_lifo_unrolled_t *lifo, void **objects, size_t count)
+{
+    size_t done = 0;
+    while (done < count && lifo->root)
+    {
+        ds_chunk_t *root = lifo->root;
+        while (done < count && root->end > 0)
+            objects[done++] = root->object[--root->end];
+        if (root->end == 0)
+        {
+            lifo->root = root->prev;
+            ds_heap_free(lifo->chunk_heap, root);
+        }
+    }
+    lifo->count -= done;
+    return done;
+}
+
+/**
+ * @brief Give back all the chunks of the lifo to the heap. The lifo is empty.
+ */
+static inline void ds_lifo_unrolled_clear(ds_lifo_unrolled_t *lifo)
+{
+    ds_chunk_t *chunk = lifo->root;
+    while (chunk)
+    {
+        ds_chunk_t *prev = chunk->prev;
+        ds_heap_free(lifo->chunk_heap, chunk);
+        chunk = prev;
+    }
+    ds_lifo_unrolled_init(lifo, lifo->chunk_heap);
+}
+
+/**
+ * @brief Position an iterator on the top object of the lifo
+ *
+ * @return The object or 0 if the lifo is empty
+ */
+static inline void *ds_lifo_unrolled_first(ds_lifo_unrolled_t *lifo, ds_chunk_iter_t *iter)
+{
+    iter->chunk = lifo->root;
+    iter->index = iter->chunk ? iter->chunk->end - 1 : 0;
+    return iter->chunk ? iter->chunk->object[iter->index] : 0;
+}
+
+/**
+ * @brief Move an iterator to the object below in the lifo
+ *
+ * @return The object or 0 at the bottom of the lifo
+ */
+static inline void *ds_lifo_unrolled_next(ds_chunk_iter_t *iter)
+{
+    return ds_chunk_iter_prev(iter);
+}
+
+#endif // __DS_LIFO_UNROLLED_H__
@@ -0,0 +1,231 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_MPMC_H__
+#define __DS_MPMC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#include "ds_common.h"
+
+/**
+ * @brief A slot of a mpmc fifo. Its sequence number tells which lap of the
+ * fifo may use it next, and whether it holds an object.
+ */
+typedef struct ds_mpmc_slot_s ds_mpmc_slot_t;
+struct ds_mpmc_slot_s
+{
+    _Atomic size_t sequence;
+    void *object;
+};
+
+/**
+ * @brief A bounded fifo of object pointers shared by any number of producer
+ * and consumer threads, in a power of two sized array of slots. A producer
+ * claims the slot at the tail with a compare and swap, and a consumer the slot
+ * at the head. The slots are then filled and emptied in parallel. A batch
+ * claims consecutive slots with a single compare and swap.
+ */
+typedef struct ds_mpmc_s ds_mpmc_t;
+struct ds_mpmc_s
+{
+    _Alignas(DS_CACHE_LINE_SIZE) _Atomic size_t tail;
+    _Alignas(DS_CACHE_LINE_SIZE) _Atomic size_t head;
+    _Alignas(DS_CACHE_LINE_SIZE) ds_mpmc_slot_t *slots;
+    size_t mask;
+};
+
+/**
+ * @brief Initialize a mpmc fifo given an array of slots
+ *
+ * @param mpmc The fifo
+ * @param slots The array of slots
+ * @param size The number of slots, a power of two
+ * @return 0 or -1 if size is not a power of two
+ */
+static inline int ds_mpmc_init(ds_mpmc_t *mpmc, ds_mpmc_slot_t *slots, size_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+        return -1;
+    for (size_t i = 0; i < size; i++)
+        atomic_init(&slots[i].sequence, i);
+    atomic_init(&mpmc->tail, 0);
+    atomic_init(&mpmc->head, 0);
+    mpmc->slots = slots;
+    mpmc->mask = size - 1;
+    return 0;
+}
+
+// Claim up to `count` consecutive slots from an index, the slot at position
+// `pos` being ready when its sequence is `pos + lap`. It returns the number
+// of claimed slots and their first position.
+static inline size_t ds_mpmc_claim(ds_mpmc_t *mpmc, _Atomic size_t *index, size_t lap, size_t count, size_t *first)
+{
+    size_t pos = atomic_load_explicit(index, memory_order_relaxed);
+    for (;;)
+    {
+        size_t ready = 0;
+        while (ready < count)
+        {
+            size_t sequence = atomic_load_explicit(&mpmc->slots[(pos + ready) & mpmc->mask].sequence, memory_order_acquire);
+            intptr_t diff = (intptr_t)(sequence - (pos + ready + lap));
+            if (diff != 0)
+            {
+                // Another thread claimed this slot: start again from the
+                // new index
+                if (ready == 0 && diff > 0)
+                    ready = SIZE_MAX;
+                break;
+            }
+            ready++;
+        }
+        if (ready == SIZE_MAX)
+            pos = atomic_load_explicit(index, memory_order_relaxed);
+        else if (ready == 0)
+            return 0;
+        else if (atomic_compare_exchange_weak_explicit(index, &pos, pos + ready, memory_order_relaxed, memory_order_relaxed))
+        {
+            *first = pos;
+            return ready;
+        }
+    }
+}
+
+/**
+ * @brief Enqueue up to `count` objects
+ *
+ * @param mpmc The fifo
+ * @param objects The objects to enqueue, in order
+ * @param count The number of objects
+ * @return The number of enqueued objects, less than `count` if the fifo is
+ * full
+ */
+static inline size_t ds_mpmc_try_enq_batch(ds_mpmc_t *mpmc, void **objects, size_t count)
+{
+    size_t pos;
+    count = ds_mpmc_claim(mpmc, &mpmc->tail, 0, count, &pos);
+    for (size_t i = 0; i < count; i++)
+    {
+        ds_mpmc_slot_t *slot = &mpmc->slots[(pos + i) & mpmc->mask];
+        slot->object = objects[i];
+        atomic_store_explicit(&slot->sequence, pos + i + 1, memory_order_release);
+    }
+    return count;
+}
+
+/**
+ * @brief Dequeue up to `count` objects
+ *
+ * @param mpmc The fifo
+ * @param objects The array receiving the objects, in order
+ * @param count The size of the array
+ * @return The number of dequeued objects, 0 if the fifo is empty
+ */
+static inline size_t ds_mpmc_try_deq_batch(ds_mpmc_t *mpmc, void **objects, size_t count)
+{
+    size_t pos;
+    count = ds_mpmc_claim(mpmc, &mpmc->head, 1, count, &pos);
+    for (size_t i = 0; i < count; i++)
+    {
+        ds_mpmc_slot_t *slot = &mpmc->slots[(pos + i) & mpmc->mask];
+        objects[i] = slot->object;
+        atomic_store_explicit(&slot->sequence, pos + i + mpmc->mask + 1, memory_order_release);
+    }
+    return count;
+}
+
+/**
+ * @brief Enqueue an object
+ *
+ * @return 0 or -1 if the fifo is full
+ */
+static inline int ds_mpmc_try_enq(ds_mpmc_t *mpmc, void *object)
+{
+    return ds_mpmc_try_enq_batch(mpmc, &object, 1) ? 0 : -1;
+}
+
+/**
+ * @brief Dequeue an object
+ *
+ * @return The object or 0 if the fifo is empty
+ */
+static inline void *ds_mpmc_try_deq(ds_mpmc_t *mpmc)
+{
+    void *object;
+    return ds_mpmc_try_deq_batch(mpmc, &object, 1) ? object : 0;
+}
+
+/**
+ * @brief Enqueue `count` objects, yielding the processor while the fifo is
+ * full
+ */
+static inline void ds_mpmc_enq_batch(ds_mpmc_t *mpmc, void **objects, size_t count)
+{
+    while (count > 0)
+    {
+        size_t enqueued = ds_mpmc_try_enq_batch(mpmc, objects, count);
+        if (enqueued == 0)
+            sched_yield();
+        objects += enqueued;
+        count -= enqueued;
+    }
+}
+
+/**
+ * @brief Dequeue between 1 and `count` objects, yielding the processor while
+ * the fifo is empty
+ *
+ * @return The number of dequeued objects
+ */
+static inline size_t ds_mpmc_deq_batch(ds_mpmc_t *mpmc, void **objects, size_t count)
+{
+    size_t dequeued;
+    while ((dequeued = ds_mpmc_try_deq_batch(mpmc, objects, count)) == 0)
+        sched_yield();
+    return dequeued;
+}
+
+/**
+ * @brief Enqueue an object, yielding the processor while the fifo is full
+ */
+static inline void ds_mpmc_enq(ds_mpmc_t *mpmc, void *object)
+{
+    ds_mpmc_enq_batch(mpmc, &object, 1);
+}
+
+/**
+ * @brief Dequeue an object, yielding the processor while the fifo is empty
+ */
+static inline void *ds_mpmc_deq(ds_mpmc_t *mpmc)
+{
+    void *object;
+    ds_mpmc_deq_batch(mpmc, &object, 1);
+    return object;
+}
+
+#endif // __DS_MPMC_H__
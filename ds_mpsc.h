@@ -0,0 +1,132 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_MPSC_H__
+#define __DS_MPSC_H__
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "ds_common.h"
+
+typedef struct ds_mpsc_item_s ds_mpsc_item_t;
+struct ds_mpsc_item_s
+{
+    _Atomic(ds_mpsc_item_t *) next;
+};
+
+/**
+ * @brief A fifo with any number of producer threads and a single consumer
+ * thread. An enqueue is one atomic exchange and never waits. The consumer
+ * follows the links with no atomic read-modify-write, except when the fifo
+ * gets empty. The fifo always holds a stub item, so that it is never really
+ * empty.
+ *
+ * ds_mpsc_deq() returns 0 when the fifo is empty, but also when the next
+ * object is being enqueued by a producer which did not link it yet: the
+ * consumer then tries again later.
+ */
+typedef struct ds_mpsc_s ds_mpsc_t;
+struct ds_mpsc_s
+{
+    _Alignas(DS_CACHE_LINE_SIZE) _Atomic(ds_mpsc_item_t *) last;
+    _Alignas(DS_CACHE_LINE_SIZE) ds_mpsc_item_t *root;
+    size_t _offset_in_object;
+    ds_mpsc_item_t stub;
+};
+
+static inline void ds_mpsc_init(ds_mpsc_t *mpsc, size_t offset_in_object)
+{
+    mpsc->_offset_in_object = offset_in_object;
+    atomic_init(&mpsc->stub.next, 0);
+    atomic_init(&mpsc->last, &mpsc->stub);
+    mpsc->root = &mpsc->stub;
+}
+
+// Link an item after the last one
+static inline void ds_mpsc_enq_item(ds_mpsc_t *mpsc, ds_mpsc_item_t *item)
+{
+    atomic_store_explicit(&item->next, 0, memory_order_relaxed);
+    ds_mpsc_item_t *prev = atomic_exchange_explicit(&mpsc->last, item, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, item, memory_order_release);
+}
+
+/**
+ * @brief Enqueue an object. Safe from any number of threads.
+ */
+static inline void ds_mpsc_enq(ds_mpsc_t *mpsc, void *object)
+{
+    ds_mpsc_enq_item(mpsc, DS_ITEM_OF(mpsc, object));
+}
+
+/**
+ * @brief Dequeue an object. Only from the consumer thread.
+ *
+ * @return The object or 0 if there is none ready
+ */
+static inline void *ds_mpsc_deq(ds_mpsc_t *mpsc)
+{
+    ds_mpsc_item_t *root = mpsc->root;
+    ds_mpsc_item_t *next = atomic_load_explicit(&root->next, memory_order_acquire);
+    if (root == &mpsc->stub)
+    {
+        // Skip the stub
+        if (!next)
+            return 0;
+        mpsc->root = root = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (!next)
+    {
+        // The root may be the last item: put the stub back after it, so that
+        // it can be dequeued
+        if (root != atomic_load_explicit(&mpsc->last, memory_order_acquire))
+            return 0;
+        ds_mpsc_enq_item(mpsc, &mpsc->stub);
+        next = atomic_load_explicit(&root->next, memory_order_acquire);
+        if (!next)
+            return 0;
+    }
+    mpsc->root = next;
+    return DS_OBJECT_OF(mpsc, root);
+}
+
+/**
+ * @brief Dequeue up to `max` objects. Only from the consumer thread.
+ *
+ * @param mpsc The fifo
+ * @param objects The array receiving the objects, in order
+ * @param max The size of the array
+ * @return The number of dequeued objects
+ */
+static inline size_t ds_mpsc_deq_batch(ds_mpsc_t *mpsc, void **objects, size_t max)
+{
+    size_t count = 0;
+    while (count < max && (objects[count] = ds_mpsc_deq(mpsc)) != 0)
+        count++;
+    return count;
+}
+
+#endif // __DS_MPSC_H__
@@ -0,0 +1,160 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ds_pqueue.h"
+
+static inline int ds_pqueue_cmp_items(ds_pqueue_t *pqueue, ds_pqueue_item_t *left, ds_pqueue_item_t *right)
+{
+    return pqueue->cmp(DS_OBJECT_OF(pqueue, left), DS_OBJECT_OF(pqueue, right));
+}
+
+// Link two subtrees with no siblings: the greater root becomes the first
+// child of the other one. It returns the root of the linked subtree.
+static ds_pqueue_item_t *ds_pqueue_link(ds_pqueue_t *pqueue, ds_pqueue_item_t *a, ds_pqueue_item_t *b)
+{
+    if (a == 0)
+        return b;
+    if (b == 0)
+        return a;
+    if (ds_pqueue_cmp_items(pqueue, b, a) < 0)
+    {
+        ds_pqueue_item_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    b->next = a->child;
+    if (a->child)
+        a->child->prev = b;
+    b->prev = a;
+    a->child = b;
+    return a;
+}
+
+// Unlink a subtree from its father and siblings
+static void ds_pqueue_detach(ds_pqueue_item_t *item)
+{
+    if (item->prev->child == item)
+        item->prev->child = item->next;
+    else
+        item->prev->next = item->next;
+    if (item->next)
+        item->next->prev = item->prev;
+    item->next = 0;
+    item->prev = 0;
+}
+
+// Link a list of siblings into one subtree, in two passes: link them by pairs
+// from left to right, then link the pairs from right to left. It returns the
+// root of the subtree.
+static ds_pqueue_item_t *ds_pqueue_merge_pairs(ds_pqueue_t *pqueue, ds_pqueue_item_t *first)
+{
+    ds_pqueue_item_t *pairs = 0;
+    while (first)
+    {
+        ds_pqueue_item_t *a = first;
+        ds_pqueue_item_t *b = a->next;
+        first = b ? b->next : 0;
+        a->next = 0;
+        a->prev = 0;
+        if (b)
+        {
+            b->next = 0;
+            b->prev = 0;
+        }
+        // The pairs are stacked in reverse order
+        a = ds_pqueue_link(pqueue, a, b);
+        a->next = pairs;
+        pairs = a;
+    }
+    ds_pqueue_item_t *root = 0;
+    while (pairs)
+    {
+        ds_pqueue_item_t *next = pairs->next;
+        pairs->next = 0;
+        root = ds_pqueue_link(pqueue, root, pairs);
+        pairs = next;
+    }
+    return root;
+}
+
+void ds_pqueue_init(ds_pqueue_t *pqueue, size_t offset_in_object, ds_pqueue_cmp_f cmp)
+{
+    pqueue->count = 0;
+    pqueue->root = 0;
+    pqueue->_offset_in_object = offset_in_object;
+    pqueue->cmp = cmp;
+}
+
+void ds_pqueue_insert(ds_pqueue_t *pqueue, void *object)
+{
+    ds_pqueue_item_t *item = DS_ITEM_OF(pqueue, object);
+    item->child = 0;
+    item->next = 0;
+    item->prev = 0;
+    pqueue->root = ds_pqueue_link(pqueue, pqueue->root, item);
+    pqueue->count++;
+}
+
+void *ds_pqueue_pop_min(ds_pqueue_t *pqueue)
+{
+    ds_pqueue_item_t *root = pqueue->root;
+    if (root == 0)
+        return 0;
+    pqueue->root = ds_pqueue_merge_pairs(pqueue, root->child);
+    pqueue->count--;
+    root->child = 0;
+    return DS_OBJECT_OF(pqueue, root);
+}
+
+void ds_pqueue_decrease_key(ds_pqueue_t *pqueue, void *object)
+{
+    ds_pqueue_item_t *item = DS_ITEM_OF(pqueue, object);
+    if (item == pqueue->root)
+        return;
+    ds_pqueue_detach(item);
+    pqueue->root = ds_pqueue_link(pqueue, pqueue->root, item);
+}
+
+void ds_pqueue_remove(ds_pqueue_t *pqueue, void *object)
+{
+    ds_pqueue_item_t *item = DS_ITEM_OF(pqueue, object);
+    if (item == pqueue->root)
+    {
+        ds_pqueue_pop_min(pqueue);
+        return;
+    }
+    ds_pqueue_detach(item);
+    pqueue->root = ds_pqueue_link(pqueue, pqueue->root, ds_pqueue_merge_pairs(pqueue, item->child));
+    pqueue->count--;
+    item->child = 0;
+}
+
+void ds_pqueue_meld(ds_pqueue_t *pqueue, ds_pqueue_t *other)
+{
+    pqueue->root = ds_pqueue_link(pqueue, pqueue->root, other->root);
+    pqueue->count += other->count;
+    other->root = 0;
+    other->count = 0;
+}
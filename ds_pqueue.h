@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_PQUEUE_H__
+#define __DS_PQUEUE_H__
+
+#include <stddef.h>
+
+#include "ds_common.h"
+
+/**
+ * @brief Item of a pairing heap. The children of an item are linked by their
+ * `next` fields from its `child` field. `prev` is the previous sibling, or the
+ * father for the first child.
+ */
+typedef struct ds_pqueue_item_s ds_pqueue_item_t;
+struct ds_pqueue_item_s
+{
+    ds_pqueue_item_t *child;
+    ds_pqueue_item_t *next;
+    ds_pqueue_item_t *prev;
+};
+
+/**
+ * @brief Objects comparison function prototype
+ *
+ */
+typedef int (*ds_pqueue_cmp_f)(void *, void *);
+
+/**
+ * @brief A priority queue of objects, as a pairing heap. Equal objects are
+ * allowed. Insertion and meld are O(1), removing the minimum or any object is
+ * O(log n) amortized. Decrease key does O(1) work, but its amortized cost is
+ * only known to lie between Omega(log log n) and O(2^(2 sqrt(log log n))).
+ * Nothing is allocated.
+ */
+typedef struct ds_pqueue_s ds_pqueue_t;
+struct ds_pqueue_s
+{
+    size_t count;
+    ds_pqueue_item_t *root;
+    size_t _offset_in_object;
+    ds_pqueue_cmp_f cmp;
+};
+
+/**
+ * @brief Initialize a priority queue
+ *
+ * @param pqueue The priority queue
+ * @param offset_in_object Offset of the ds_pqueue_item_t in the objects
+ * @param cmp Comparison function between objects, the minimum being first
+ */
+void ds_pqueue_init(ds_pqueue_t *pqueue, size_t offset_in_object, ds_pqueue_cmp_f cmp);
+
+/**
+ * @brief Insert an object
+ *
+ * @param pqueue The priority queue
+ * @param object The object
+ */
+void ds_pqueue_insert(ds_pqueue_t *pqueue, void *object);
+
+/**
+ * @brief Get the minimum object
+ *
+ * @param pqueue The priority queue
+ * @return The minimum object or 0 if the priority queue is empty
+ */
+static inline void *ds_pqueue_peek_min(ds_pqueue_t *pqueue)
+{
+    return pqueue->root ? DS_OBJECT_OF(pqueue, pqueue->root) : 0;
+}
+
+/**
+ * @brief Remove the minimum object
+ *
+ * @param pqueue The priority queue
+ * @return The removed object or 0 if the priority queue is empty
+ */
+void *ds_pqueue_pop_min(ds_pqueue_t *pqueue);
+
+/**
+ * @brief Move an object whose key has just been decreased. The object is cut
+ * from its father and linked with the root, but the later removals pay for
+ * it: see ds_pqueue_t for the amortized cost.
+ *
+ * @param pqueue The priority queue
+ * @param object The object, in the priority queue
+ */
+void ds_pqueue_decrease_key(ds_pqueue_t *pqueue, void *object);
+
+/**
+ * @brief Remove an object
+ *
+ * @param pqueue The priority queue
+ * @param object The object, in the priority queue
+ */
+void ds_pqueue_remove(ds_pqueue_t *pqueue, void *object);
+
+/**
+ * @brief Move all objects of `other` into `pqueue`. `other` is left empty.
+ *
+ * @param pqueue The priority queue
+ * @param other A priority queue with the same offset and comparison function
+ */
+void ds_pqueue_meld(ds_pqueue_t *pqueue, ds_pqueue_t *other);
+
+#endif // __DS_PQUEUE_H__
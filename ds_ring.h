@@ -0,0 +1,148 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_RING_H__
+#define __DS_RING_H__
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "ds_common.h"
+
+/**
+ * @brief A bounded fifo of object pointers between one producer thread and one
+ * consumer thread, in a power of two sized array. Each side owns one index
+ * and keeps a copy of the other index, read again only when the copy says
+ * the ring is full (or empty). A batch costs one acquire read at most and one
+ * release write.
+ */
+typedef struct ds_ring_s ds_ring_t;
+struct ds_ring_s
+{
+    // Producer side
+    _Alignas(DS_CACHE_LINE_SIZE) _Atomic size_t tail;
+    size_t head_cache;
+    // Consumer side
+    _Alignas(DS_CACHE_LINE_SIZE) _Atomic size_t head;
+    size_t tail_cache;
+    // Read only
+    _Alignas(DS_CACHE_LINE_SIZE) void **store;
+    size_t mask;
+};
+
+/**
+ * @brief Initialize a ring given an array of object pointers
+ *
+ * @param ring The ring
+ * @param store The array
+ * @param size The number of pointers of the array, a power of two
+ * @return 0 or -1 if size is not a power of two
+ */
+static inline int ds_ring_init(ds_ring_t *ring, void **store, size_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+        return -1;
+    atomic_init(&ring->tail, 0);
+    ring->head_cache = 0;
+    atomic_init(&ring->head, 0);
+    ring->tail_cache = 0;
+    ring->store = store;
+    ring->mask = size - 1;
+    return 0;
+}
+
+/**
+ * @brief Enqueue up to `count` objects. Only from the producer thread.
+ *
+ * @param ring The ring
+ * @param objects The objects to enqueue, in order
+ * @param count The number of objects
+ * @return The number of enqueued objects, less than `count` if the ring is
+ * full
+ */
+static inline size_t ds_ring_enq_batch(ds_ring_t *ring, void **objects, size_t count)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t space = ring->mask + 1 - (tail - ring->head_cache);
+    if (space < count)
+    {
+        ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+        space = ring->mask + 1 - (tail - ring->head_cache);
+        if (space < count)
+            count = space;
+    }
+    for (size_t i = 0; i < count; i++)
+        ring->store[(tail + i) & ring->mask] = objects[i];
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
+
+/**
+ * @brief Dequeue up to `count` objects. Only from the consumer thread.
+ *
+ * @param ring The ring
+ * @param objects The array receiving the objects, in order
+ * @param count The size of the array
+ * @return The number of dequeued objects
+ */
+static inline size_t ds_ring_deq_batch(ds_ring_t *ring, void **objects, size_t count)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t ready = ring->tail_cache - head;
+    if (ready < count)
+    {
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        ready = ring->tail_cache - head;
+        if (ready < count)
+            count = ready;
+    }
+    for (size_t i = 0; i < count; i++)
+        objects[i] = ring->store[(head + i) & ring->mask];
+    atomic_store_explicit(&ring->head, head + count, memory_order_release);
+    return count;
+}
+
+/**
+ * @brief Enqueue an object. Only from the producer thread.
+ *
+ * @return 0 or -1 if the ring is full
+ */
+static inline int ds_ring_enq(ds_ring_t *ring, void *object)
+{
+    return ds_ring_enq_batch(ring, &object, 1) ? 0 : -1;
+}
+
+/**
+ * @brief Dequeue an object. Only from the consumer thread.
+ *
+ * @return The object or 0 if the ring is empty
+ */
+static inline void *ds_ring_deq(ds_ring_t *ring)
+{
+    void *object;
+    return ds_ring_deq_batch(ring, &object, 1) ? object : 0;
+}
+
+#endif // __DS_RING_H__
@@ -0,0 +1,172 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#include "ds_sort.h"
+
+// The items of fifos and lists both start with their next item
+typedef struct ds_sort_node_s ds_sort_node_t;
+struct ds_sort_node_s
+{
+    ds_sort_node_t *next;
+};
+
+#define DS_SORT_OBJECT_OF(_node, _offset) ((void *)((char *)(_node) - (_offset)))
+#define DS_SORT_KEY_OF(_node, _offset, _key_offset) (*(uint64_t *)((char *)(_node) - (_offset) + (_key_offset)))
+
+// Merge two sorted runs. On ties, the nodes of `older` come first, so the sort
+// is stable.
+static ds_sort_node_t *ds_sort_merge(ds_sort_node_t *older, ds_sort_node_t *newer, size_t offset, bs_btree_cmp_f cmp)
+{
+    ds_sort_node_t head;
+    ds_sort_node_t *tail = &head;
+    while (older && newer)
+    {
+        if (cmp(DS_SORT_OBJECT_OF(newer, offset), DS_SORT_OBJECT_OF(older, offset)) < 0)
+        {
+            tail->next = newer;
+            newer = newer->next;
+        }
+        else
+        {
+            tail->next = older;
+            older = older->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = older ? older : newer;
+    return head.next;
+}
+
+// Bottom-up merge sort: `runs[i]` holds a sorted run of 2^i nodes or 0, like
+// the bits of a binary counter of the nodes seen so far. Each node is added as
+// a run of 1 and carried up while the bins are full.
+static ds_sort_node_t *ds_sort_nodes(ds_sort_node_t *list, size_t offset, bs_btree_cmp_f cmp)
+{
+    ds_sort_node_t *runs[64] = {0};
+    int top = 0;
+    while (list)
+    {
+        ds_sort_node_t *run = list;
+        list = list->next;
+        run->next = 0;
+        int i;
+        for (i = 0; runs[i]; i++)
+        {
+            run = ds_sort_merge(runs[i], run, offset, cmp);
+            runs[i] = 0;
+        }
+        runs[i] = run;
+        if (i > top)
+            top = i;
+    }
+    // The higher runs hold the older nodes
+    ds_sort_node_t *sorted = 0;
+    for (int i = 0; i <= top; i++)
+        if (runs[i])
+            sorted = sorted ? ds_sort_merge(runs[i], sorted, offset, cmp) : runs[i];
+    return sorted;
+}
+
+// LSD radix sort, distributing the nodes in 256 buckets per pass and linking
+// the buckets back in order
+static ds_sort_node_t *ds_sort_radix_nodes(ds_sort_node_t *list, size_t offset, size_t key_offset)
+{
+    if (!list)
+        return 0;
+    uint64_t first = DS_SORT_KEY_OF(list, offset, key_offset);
+    uint64_t diff = 0;
+    for (ds_sort_node_t *node = list->next; node; node = node->next)
+        diff |= DS_SORT_KEY_OF(node, offset, key_offset) ^ first;
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        if (((diff >> shift) & 0xff) == 0)
+            continue;
+        ds_sort_node_t *heads[256] = {0};
+        ds_sort_node_t *tails[256];
+        for (ds_sort_node_t *node = list; node; node = node->next)
+        {
+            int byte = (DS_SORT_KEY_OF(node, offset, key_offset) >> shift) & 0xff;
+            if (heads[byte])
+                tails[byte]->next = node;
+            else
+                heads[byte] = node;
+            tails[byte] = node;
+        }
+        ds_sort_node_t head;
+        ds_sort_node_t *tail = &head;
+        for (int byte = 0; byte < 256; byte++)
+        {
+            if (!heads[byte])
+                continue;
+            tail->next = heads[byte];
+            tail = tails[byte];
+        }
+        tail->next = 0;
+        list = head.next;
+    }
+    return list;
+}
+
+static void ds_sort_fifo_relink(ds_fifo_t *fifo, ds_sort_node_t *sorted)
+{
+    fifo->root = (ds_fifo_item_t *)sorted;
+    fifo->last = 0;
+    for (ds_fifo_item_t *item = fifo->root; item; item = item->next)
+        fifo->last = item;
+}
+
+// Restore the previous items, which the sort does not maintain
+static void ds_sort_dlist_relink(ds_dlist_t *dlist, ds_sort_node_t *sorted)
+{
+    dlist->root = (ds_dlist_item_t *)sorted;
+    dlist->last = 0;
+    for (ds_dlist_item_t *item = dlist->root; item; item = item->next)
+    {
+        item->prev = dlist->last;
+        dlist->last = item;
+    }
+}
+
+void ds_fifo_sort(ds_fifo_t *fifo, bs_btree_cmp_f cmp)
+{
+    ds_sort_fifo_relink(fifo, ds_sort_nodes((ds_sort_node_t *)fifo->root, fifo->_offset_in_object, cmp));
+}
+
+void ds_dlist_sort(ds_dlist_t *dlist, bs_btree_cmp_f cmp)
+{
+    ds_sort_dlist_relink(dlist, ds_sort_nodes((ds_sort_node_t *)dlist->root, dlist->_offset_in_object, cmp));
+}
+
+void ds_fifo_radix_sort(ds_fifo_t *fifo, size_t key_offset_in_object)
+{
+    ds_sort_fifo_relink(fifo, ds_sort_radix_nodes((ds_sort_node_t *)fifo->root, fifo->_offset_in_object, key_offset_in_object));
+}
+
+void ds_dlist_radix_sort(ds_dlist_t *dlist, size_t key_offset_in_object)
+{
+    ds_sort_dlist_relink(dlist, ds_sort_radix_nodes((ds_sort_node_t *)dlist->root, dlist->_offset_in_object, key_offset_in_object));
+}
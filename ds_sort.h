@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_SORT_H__
+#define __DS_SORT_H__
+
+#include <stddef.h>
+
+#include "ds_fifo.h"
+#include "ds_dlist.h"
+#include "ds_btree.h"
+
+/**
+ * @brief Sort a fifo in place by a stable bottom-up merge sort over its links.
+ * Nothing is allocated, the runs to merge are held in a fixed array.
+ *
+ * @param fifo The fifo
+ * @param cmp Comparison function between objects
+ */
+void ds_fifo_sort(ds_fifo_t *fifo, bs_btree_cmp_f cmp);
+
+/**
+ * @brief Sort a list in place by a stable bottom-up merge sort over its links.
+ * See ds_fifo_sort().
+ *
+ * @param dlist The list
+ * @param cmp Comparison function between objects
+ */
+void ds_dlist_sort(ds_dlist_t *dlist, bs_btree_cmp_f cmp);
+
+/**
+ * @brief Sort a fifo in place by a stable LSD radix sort on a uint64_t key of
+ * the objects, one byte per pass. The bytes equal in all keys are skipped.
+ *
+ * @param fifo The fifo
+ * @param key_offset_in_object Offset of the uint64_t key in the objects
+ */
+void ds_fifo_radix_sort(ds_fifo_t *fifo, size_t key_offset_in_object);
+
+/**
+ * @brief Sort a list in place by a stable LSD radix sort on a uint64_t key of
+ * the objects. See ds_fifo_radix_sort().
+ *
+ * @param dlist The list
+ * @param key_offset_in_object Offset of the uint64_t key in the objects
+ */
+void ds_dlist_radix_sort(ds_dlist_t *dlist, size_t key_offset_in_object);
+
+#endif // __DS_SORT_H__
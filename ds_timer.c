@@ -0,0 +1,164 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ds_timer.h"
+
+#define DS_TIMER_ITEM_OF(_timer, _object) ((ds_timer_item_t *)((char *)(_object) + (_timer)->_offset_in_object))
+
+// The level of a timer is the level of the highest digit, in base
+// DS_TIMER_SLOTS, where its expiry tick differs from the current tick. Its
+// slot is the digit of its expiry tick at that level, which is always ahead
+// of the current one: the bucket is moved down when the current tick reaches
+// it, before any of its timers expires.
+static void ds_timer_link(ds_timer_t *timer, void *object, ds_timer_item_t *item)
+{
+    uint64_t expires = item->expires < timer->now ? timer->now : item->expires;
+    uint64_t diff = expires ^ timer->now;
+    int level = 0;
+    while (level < DS_TIMER_LEVELS - 1 && diff >> ((level + 1) * DS_TIMER_LEVEL_BITS))
+        level++;
+    int slot = (expires >> (level * DS_TIMER_LEVEL_BITS)) & (DS_TIMER_SLOTS - 1);
+    ds_dlist_t *bucket = &timer->buckets[level][slot];
+    ds_dlist_enq(bucket, object);
+    item->_bucket = bucket;
+    timer->_pending[level] |= (uint64_t)1 << slot;
+}
+
+static void ds_timer_unlink(ds_timer_t *timer, void *object, ds_timer_item_t *item)
+{
+    ds_dlist_t *bucket = item->_bucket;
+    ds_dlist_remove(bucket, object);
+    item->_bucket = 0;
+    if (bucket->count == 0)
+    {
+        size_t index = bucket - &timer->buckets[0][0];
+        timer->_pending[index / DS_TIMER_SLOTS] &= ~((uint64_t)1 << (index % DS_TIMER_SLOTS));
+    }
+}
+
+// Move the timers of a bucket down to the lower levels
+static void ds_timer_cascade(ds_timer_t *timer, int level, int slot)
+{
+    ds_dlist_t *bucket = &timer->buckets[level][slot];
+    ds_dlist_item_t *dlist_item = bucket->root;
+    ds_dlist_init(bucket, timer->_offset_in_object);
+    timer->_pending[level] &= ~((uint64_t)1 << slot);
+    while (dlist_item)
+    {
+        ds_dlist_item_t *next = dlist_item->next;
+        ds_timer_item_t *item = (ds_timer_item_t *)dlist_item;
+        ds_timer_link(timer, DS_OBJECT_OF(timer, item), item);
+        dlist_item = next;
+    }
+}
+
+// The first tick after `tick` with a bucket to process, or UINT64_MAX if the
+// wheel is empty. The lowest level with a pending slot ahead of the digit of
+// `tick` holds the earliest one.
+static uint64_t ds_timer_next(ds_timer_t *timer, uint64_t tick)
+{
+    for (int level = 0; level < DS_TIMER_LEVELS; level++)
+    {
+        int shift = level * DS_TIMER_LEVEL_BITS;
+        int digit = (tick >> shift) & (DS_TIMER_SLOTS - 1);
+        if (digit == DS_TIMER_SLOTS - 1)
+            continue;
+        uint64_t pending = timer->_pending[level] & (~(uint64_t)0 << (digit + 1));
+        if (pending == 0)
+            continue;
+        uint64_t next = (uint64_t)__builtin_ctzll(pending) << shift;
+        if (shift + DS_TIMER_LEVEL_BITS < 64)
+            next |= tick >> (shift + DS_TIMER_LEVEL_BITS) << (shift + DS_TIMER_LEVEL_BITS);
+        return next;
+    }
+    return UINT64_MAX;
+}
+
+void ds_timer_init(ds_timer_t *timer, size_t offset_in_object, uint64_t now)
+{
+    timer->count = 0;
+    timer->_offset_in_object = offset_in_object;
+    timer->now = now;
+    for (int level = 0; level < DS_TIMER_LEVELS; level++)
+    {
+        timer->_pending[level] = 0;
+        for (int slot = 0; slot < DS_TIMER_SLOTS; slot++)
+            ds_dlist_init(&timer->buckets[level][slot], offset_in_object);
+    }
+}
+
+void ds_timer_schedule(ds_timer_t *timer, void *object, uint64_t expires)
+{
+    ds_timer_item_t *item = DS_TIMER_ITEM_OF(timer, object);
+    if (item->_bucket)
+        ds_timer_unlink(timer, object, item);
+    else
+        timer->count++;
+    item->expires = expires;
+    ds_timer_link(timer, object, item);
+}
+
+int ds_timer_cancel(ds_timer_t *timer, void *object)
+{
+    ds_timer_item_t *item = DS_TIMER_ITEM_OF(timer, object);
+    if (item->_bucket == 0)
+        return -1;
+    ds_timer_unlink(timer, object, item);
+    timer->count--;
+    return 0;
+}
+
+size_t ds_timer_advance(ds_timer_t *timer, uint64_t now, ds_dlist_t *expired)
+{
+    size_t count = 0;
+    while (timer->now <= now)
+    {
+        uint64_t tick = timer->now;
+        // Cascade from the highest level whose digit changed at this tick
+        int level = 1;
+        while (level < DS_TIMER_LEVELS && (tick & (((uint64_t)1 << (level * DS_TIMER_LEVEL_BITS)) - 1)) == 0)
+            level++;
+        while (--level > 0)
+        {
+            int slot = (tick >> (level * DS_TIMER_LEVEL_BITS)) & (DS_TIMER_SLOTS - 1);
+            if (timer->_pending[level] & ((uint64_t)1 << slot))
+                ds_timer_cascade(timer, level, slot);
+        }
+        int slot = tick & (DS_TIMER_SLOTS - 1);
+        ds_dlist_t *bucket = &timer->buckets[0][slot];
+        while (bucket->root)
+        {
+            void *object = ds_dlist_remove_item(bucket, bucket->root);
+            DS_TIMER_ITEM_OF(timer, object)->_bucket = 0;
+            ds_dlist_enq(expired, object);
+            timer->count--;
+            count++;
+        }
+        timer->_pending[0] &= ~((uint64_t)1 << slot);
+        uint64_t next = ds_timer_next(timer, tick);
+        timer->now = next > now ? now + 1 : next;
+    }
+    return count;
+}
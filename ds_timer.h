@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2021 Alain Basty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __DS_TIMER_H__
+#define __DS_TIMER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ds_common.h"
+#include "ds_dlist.h"
+
+/**
+ * @brief Number of slots of each level of a timer wheel, one bit each in the
+ * pending map of the level
+ */
+#define DS_TIMER_LEVEL_BITS 6
+#define DS_TIMER_SLOTS (1 << DS_TIMER_LEVEL_BITS)
+
+/**
+ * @brief Number of levels of a timer wheel, enough for any 64 bits expiry tick
+ */
+#define DS_TIMER_LEVELS ((64 + DS_TIMER_LEVEL_BITS - 1) / DS_TIMER_LEVEL_BITS)
+
+/**
+ * @brief Item of a timer. `dlist_item` must stay the first field: the buckets
+ * are lists of objects at the same offset as the timer item.
+ */
+typedef struct ds_timer_item_s ds_timer_item_t;
+struct ds_timer_item_s
+{
+    ds_dlist_item_t dlist_item;
+    uint64_t expires;
+    ds_dlist_t *_bucket;
+};
+
+/**
+ * @brief A hierarchical timer wheel. Level `l` has DS_TIMER_SLOTS buckets of
+ * DS_TIMER_SLOTS^l ticks each. Scheduling and cancelling are O(1), a timer is
+ * moved down at most once per level before it expires. Ticks with no bucket to
+ * process are skipped.
+ */
+typedef struct ds_timer_s ds_timer_t;
+struct ds_timer_s
+{
+    size_t count;
+    size_t _offset_in_object;
+    uint64_t now;
+    uint64_t _pending[DS_TIMER_LEVELS];
+    ds_dlist_t buckets[DS_TIMER_LEVELS][DS_TIMER_SLOTS];
+};
+
+/**
+ * @brief Initialize a timer wheel
+ *
+ * @param timer The timer wheel
+ * @param offset_in_object Offset of the ds_timer_item_t in the objects
+ * @param now The first tick to be processed
+ */
+void ds_timer_init(ds_timer_t *timer, size_t offset_in_object, uint64_t now);
+
+/**
+ * @brief Schedule an object to expire at a tick. An object already scheduled
+ * is rescheduled. An expiry tick in the past expires at the next processed
+ * tick.
+ *
+ * @param timer The timer wheel
+ * @param object The object, whose timer item is either scheduled or
+ * zero-initialized
+ * @param expires The expiry tick
+ */
+void ds_timer_schedule(ds_timer_t *timer, void *object, uint64_t expires);
+
+/**
+ * @brief Tell whether an object is scheduled
+ *
+ * @param timer The timer wheel
+ * @param object The object
+ * @return 1 if the object is scheduled, 0 otherwise
+ */
+static inline int ds_timer_pending(ds_timer_t *timer, void *object)
+{
+    ds_timer_item_t *item = (ds_timer_item_t *)((char *)object + timer->_offset_in_object);
+    return item->_bucket != 0;
+}
+
+/**
+ * @brief Cancel a scheduled object
+ *
+ * @param timer The timer wheel
+ * @param object The object
+ * @return 0 if the object was scheduled, -1 otherwise
+ */
+int ds_timer_cancel(ds_timer_t *timer, void *object);
+
+/**
+ * @brief Process all the ticks up to `now` included, and move the expired
+ * objects, in expiry order, at the end of `expired`. The moved objects are no
+ * longer scheduled.
+ *
+ * @param timer The timer wheel
+ * @param now The last tick to process, lower than UINT64_MAX
+ * @param expired A list with the same offset as the timer wheel
+ * @return The number of expired objects
+ */
+size_t ds_timer_advance(ds_timer_t *timer, uint64_t now, ds_dlist_t *expired);
+
+#endif // __DS_TIMER_H__
@@ -2,13 +2,34 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <assert.h>
 
 #include "ds_heap.h"
+#include "ds_heap_cache.h"
 #include "ds_lifo.h"
 #include "ds_fifo.h"
 #include "ds_dlist.h"
+#include "ds_fifo_ext.h"
+#include "ds_lifo_ext.h"
+#include "ds_dlist_ext.h"
 #include "ds_btree.h"
 #include "ds_btree_ext.h"
+#include "ds_btree_rw.h"
+#include "ds_bptree.h"
+#include "ds_mpsc.h"
+#include "ds_ring.h"
+#include "ds_mpmc.h"
+#include "ds_lifo_atomic.h"
+#include "ds_pqueue.h"
+#include "ds_timer.h"
+#include "ds_htable.h"
+#include "ds_htable_ext.h"
+#include "ds_hmap.h"
+#include "ds_cache.h"
+#include "ds_sort.h"
+#include "ds_fifo_unrolled.h"
+#include "ds_lifo_unrolled.h"
+#include "ds_dlist_unrolled.h"
 
 #ifdef NDEBUG
     #define DO(X)
@@ -18,6 +39,9 @@
 
 #define ITEM_MAX 42
 #define ERROR_MAX 150
+#define STRESS_MAX 1000
+#define READER_MAX 4
+#define BULK_MAX 50000
 
 typedef struct element_s element_t;
 struct element_s
@@ -26,7 +50,13 @@ struct element_s
     ds_lifo_item_t lifo_item;
     ds_dlist_item_t dlist_item;
     ds_btree_item_t btree_item;
+    ds_mpsc_item_t mpsc_item;
+    ds_pqueue_item_t pqueue_item;
+    ds_timer_item_t timer_item;
+    ds_htable_item_t htable_item;
+    ds_cache_item_t cache_item;
     int int1;
+    uint64_t id;
 };
 
 #define elementof(_ds, _item) ((element_t *)DS_OBJECT_OF(_ds, _item))
@@ -104,6 +134,105 @@ void btree_right_print(ds_btree_t *btree)
     printf("\n");
 }
 
+// Compare two objects of a btree, including uint64_t keyed btrees
+int btree_object_cmp(ds_btree_t *btree, void *left, void *right)
+{
+    if (btree->cmp)
+        return btree->cmp(left, right);
+    uint64_t left_key = *(uint64_t *)((char *)left + btree->_key_offset_in_object);
+    uint64_t right_key = *(uint64_t *)((char *)right + btree->_key_offset_in_object);
+    return (left_key > right_key) - (left_key < right_key);
+}
+
+// Check heights, balance and order of a subtree and return its node count
+size_t btree_node_check(ds_btree_t *btree, ds_btree_item_t *node, int *height)
+{
+    if (!node)
+    {
+        *height = 0;
+        return 0;
+    }
+    int left_height, right_height;
+    size_t count = btree_node_check(btree, node->left, &left_height) + 1;
+    count += btree_node_check(btree, node->right, &right_height);
+    *height = 1 + (left_height > right_height ? left_height : right_height);
+    assert(node->height == *height);
+    assert(!btree->_ranked || node->size == count);
+    assert(left_height - right_height <= 1 && right_height - left_height <= 1);
+    if (node->left)
+        assert(btree_object_cmp(btree, DS_OBJECT_OF(btree, node->left), DS_OBJECT_OF(btree, node)) < 0);
+    if (node->right)
+        assert(btree_object_cmp(btree, DS_OBJECT_OF(btree, node), DS_OBJECT_OF(btree, node->right)) < 0);
+    return count;
+}
+
+void btree_check(ds_btree_t *btree)
+{
+    int height;
+    size_t count = btree_node_check(btree, btree->root, &height);
+    assert(count == btree->count);
+    (void)count;
+}
+
+// Check fill, separators and depth of a bptree subtree and return its object
+// count
+size_t bptree_node_check(ds_bptree_t *bptree, ds_bptree_node_t *node, int depth)
+{
+    assert(node == bptree->root || node->count >= DS_BPTREE_ORDER_MIN);
+    for (int i = 1; i < node->count; i++)
+        assert(bptree->cmp(node->object[i - 1], node->object[i]) < 0);
+    if (node->leaf)
+    {
+        assert(depth == bptree->height);
+        return node->count;
+    }
+    size_t count = 0;
+    for (int i = 0; i <= node->count; i++)
+    {
+        ds_bptree_node_t *child = node->child[i];
+        if (i > 0)
+        {
+            ds_bptree_node_t *leftmost = child;
+            while (!leftmost->leaf)
+                leftmost = leftmost->child[0];
+            assert(node->object[i - 1] == leftmost->object[0]);
+        }
+        count += bptree_node_check(bptree, child, depth + 1);
+    }
+    return count;
+}
+
+void bptree_check(ds_bptree_t *bptree)
+{
+    if (!bptree->root)
+    {
+        assert(bptree->count == 0 && bptree->height == 0);
+        return;
+    }
+    size_t count = bptree_node_check(bptree, bptree->root, 1);
+    assert(count == bptree->count);
+    ds_bptree_iter_t iter;
+    count = 0;
+    void *previous = 0;
+    for (void *object = ds_bptree_first(bptree, &iter); object; object = ds_bptree_next(&iter))
+    {
+        assert(!previous || bptree->cmp(previous, object) < 0);
+        previous = object;
+        count++;
+    }
+    assert(count == bptree->count);
+    void *last = ds_bptree_last(bptree, &iter);
+    assert(previous == last);
+    (void)previous;
+    (void)last;
+}
+
+uint64_t element_prefix(void *_element)
+{
+    element_t *element = (element_t *)_element;
+    return (uint64_t)element->int1;
+}
+
 int btree_node_cmp(void *_left, void *_right)
 {
     element_t *left = (element_t *)_left;
@@ -115,6 +244,16 @@ int btree_node_cmp(void *_left, void *_right)
     return 1;
 }
 
+static inline int element_cmp(element_t *left, element_t *right)
+{
+    return (left->int1 > right->int1) - (left->int1 < right->int1);
+}
+
+DS_BTREE_DEFINE(element_btree, element_t, btree_item, element_cmp)
+DS_FIFO_DEFINE(element_fifo, element_t, fifo_item)
+DS_LIFO_DEFINE(element_lifo, element_t, lifo_item)
+DS_DLIST_DEFINE(element_dlist, element_t, dlist_item)
+
 static inline int btree_strcmp(void *_left, void *_right)
 {
     char *left = (char *)_left;
@@ -122,6 +261,255 @@ static inline int btree_strcmp(void *_left, void *_right)
     return strcmp(left, right);
 }
 
+void *btree_rw_reader(void *_rw)
+{
+    ds_btree_rw_t *rw = _rw;
+    size_t found = 0;
+    for (int i = 0; i < 16 * STRESS_MAX; i++)
+    {
+        element_t key = {.int1 = i % STRESS_MAX};
+        ds_btree_rw_rdlock(rw);
+        element_t *element = ds_btree_find(&rw->btree, &key);
+        if (element)
+        {
+            assert(element->int1 == key.int1);
+            found++;
+        }
+        ds_btree_rw_unlock(rw);
+    }
+    return (void *)found;
+}
+
+#define HEAP_CACHE_IN_USE 0x5a5a5a5a5a5a5a5aULL
+
+typedef struct heap_cache_thread_s heap_cache_thread_t;
+struct heap_cache_thread_s
+{
+    ds_heap_cache_t *cache;
+    pthread_barrier_t *barrier;
+    element_t **elements;
+    element_t **next_thread_elements;
+};
+
+// Allocate elements, then free the ones allocated by the next thread
+void *heap_cache_thread(void *_thread)
+{
+    heap_cache_thread_t *thread = _thread;
+    for (int round = 0; round < 8; round++)
+    {
+        for (int i = 0; i < STRESS_MAX; i++)
+        {
+            element_t *element = ds_heap_cache_alloc(thread->cache);
+            assert(element != 0);
+            uint64_t id = __atomic_exchange_n(&element->id, HEAP_CACHE_IN_USE, __ATOMIC_RELAXED);
+            assert(id != HEAP_CACHE_IN_USE);
+            (void)id;
+            thread->elements[i] = element;
+        }
+        pthread_barrier_wait(thread->barrier);
+        for (int i = 0; i < STRESS_MAX; i++)
+        {
+            element_t *element = thread->next_thread_elements[i];
+            uint64_t id = __atomic_exchange_n(&element->id, 0, __ATOMIC_RELAXED);
+            assert(id == HEAP_CACHE_IN_USE);
+            (void)id;
+            ds_heap_cache_free(thread->cache, element);
+        }
+        pthread_barrier_wait(thread->barrier);
+    }
+    return 0;
+}
+
+typedef struct mpsc_producer_s mpsc_producer_t;
+struct mpsc_producer_s
+{
+    ds_mpsc_t *mpsc;
+    element_t *elements;
+};
+
+void *mpsc_producer(void *_producer)
+{
+    mpsc_producer_t *producer = _producer;
+    for (int i = 0; i < STRESS_MAX; i++)
+        ds_mpsc_enq(producer->mpsc, &producer->elements[i]);
+    return 0;
+}
+
+#define RING_SIZE 64
+#define RING_MESSAGES (16 * STRESS_MAX)
+
+// Send the integers from 1 to RING_MESSAGES in batches of various sizes
+void *ring_producer(void *ring)
+{
+    uintptr_t batch[17];
+    uintptr_t next = 1;
+    while (next <= RING_MESSAGES)
+    {
+        size_t count = 1 + next % 17;
+        for (size_t i = 0; i < count; i++)
+            batch[i] = next + i;
+        if (next + count > RING_MESSAGES + 1)
+            count = RING_MESSAGES + 1 - next;
+        next += ds_ring_enq_batch(ring, (void **)batch, count);
+    }
+    return 0;
+}
+
+#define MPMC_SIZE 32
+
+typedef struct mpmc_thread_s mpmc_thread_t;
+struct mpmc_thread_s
+{
+    ds_mpmc_t *mpmc;
+    element_t *elements;
+    size_t count;
+};
+
+// Enqueue elements in batches of various sizes
+void *mpmc_producer(void *_thread)
+{
+    mpmc_thread_t *thread = _thread;
+    for (size_t i = 0; i < thread->count;)
+    {
+        void *batch[5];
+        size_t count = 1 + i % 5 < thread->count - i ? 1 + i % 5 : thread->count - i;
+        for (size_t j = 0; j < count; j++)
+            batch[j] = &thread->elements[i + j];
+        if (i % 2)
+            ds_mpmc_enq_batch(thread->mpmc, batch, count);
+        else
+        {
+            for (size_t j = 0; j < count; j++)
+                ds_mpmc_enq(thread->mpmc, batch[j]);
+        }
+        i += count;
+    }
+    return 0;
+}
+
+// Dequeue elements and count their receptions
+void *mpmc_consumer(void *_thread)
+{
+    mpmc_thread_t *thread = _thread;
+    for (size_t received = 0; received < thread->count;)
+    {
+        void *batch[7];
+        size_t max = 1 + received % 7 < thread->count - received ? 1 + received % 7 : thread->count - received;
+        size_t count = ds_mpmc_deq_batch(thread->mpmc, batch, max);
+        for (size_t i = 0; i < count; i++)
+            __atomic_fetch_add(&((element_t *)batch[i])->int1, 1, __ATOMIC_RELAXED);
+        received += count;
+    }
+    return 0;
+}
+
+typedef struct lifo_atomic_thread_s lifo_atomic_thread_t;
+struct lifo_atomic_thread_s
+{
+    ds_lifo_atomic_t *lifo;
+    int index;
+};
+
+// Pop elements, check that no other thread holds them, then push them back
+// one by one or as chains
+void *lifo_atomic_thread(void *_thread)
+{
+    lifo_atomic_thread_t *thread = _thread;
+    ds_lifo_t chain;
+    ds_lifo_init(&chain, offsetof(element_t, lifo_item));
+    for (int i = 0; i < 16 * STRESS_MAX; i++)
+    {
+        element_t *element = ds_lifo_atomic_pop(thread->lifo);
+        if (!element)
+            continue;
+        int owner = __atomic_exchange_n(&element->int1, thread->index, __ATOMIC_RELAXED);
+        assert(owner == -1);
+        owner = __atomic_exchange_n(&element->int1, -1, __ATOMIC_RELAXED);
+        assert(owner == thread->index);
+        (void)owner;
+        if (i % 3)
+            ds_lifo_atomic_push(thread->lifo, element);
+        else
+        {
+            ds_lifo_push(&chain, element);
+            if (chain.count == 4)
+                ds_lifo_atomic_push_chain(thread->lifo, &chain);
+        }
+    }
+    ds_lifo_atomic_push_chain(thread->lifo, &chain);
+    return 0;
+}
+
+uint64_t element_hash(void *_element)
+{
+    return (uint64_t)((element_t *)_element)->int1 * 0x9e3779b97f4a7c15ULL >> 17;
+}
+
+int element_eq(void *_left, void *_right)
+{
+    return ((element_t *)_left)->int1 == ((element_t *)_right)->int1;
+}
+
+uint64_t str_hash(void *_str)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char *c = _str; *c; c++)
+        hash = (hash ^ *c) * 0x100000001b3ULL;
+    return hash;
+}
+
+int str_eq(void *left, void *right)
+{
+    return strcmp(left, right) == 0;
+}
+
+size_t cache_evicted;
+
+void cache_evict(void *object)
+{
+    __atomic_fetch_add(&cache_evicted, 1, __ATOMIC_RELAXED);
+    ((element_t *)object)->id = 0;
+}
+
+typedef struct cache_thread_s cache_thread_t;
+struct cache_thread_s
+{
+    ds_cache_sharded_t *sharded;
+    element_t *elements;
+};
+
+void *cache_thread(void *_thread)
+{
+    cache_thread_t *thread = _thread;
+    for (int i = 0; i < 20 * STRESS_MAX; i++)
+    {
+        element_t *element = &thread->elements[random() % (STRESS_MAX / READER_MAX)];
+        int op = random() % 8;
+        if (op == 0)
+            ds_cache_sharded_remove(thread->sharded, element);
+        else if (op == 1)
+        {
+            element_t *inserted = ds_cache_sharded_insert(thread->sharded, element, 1);
+            assert(inserted == element);
+            (void)inserted;
+        }
+        else
+        {
+            element_t *found = ds_cache_sharded_find(thread->sharded, element);
+            assert(found == 0 || found == element);
+            (void)found;
+        }
+    }
+    return 0;
+}
+
+size_t btree_dropped;
+
+void btree_drop(void *object)
+{
+    btree_dropped++;
+}
+
 int main()
 {
     DO(printf("# Data structure test\n"));
@@ -191,6 +579,7 @@ int main()
         if (removed)
         {
             ds_dlist_remove(&dlist, removed);
+            btree_check(&btree);
             DO(printf("also removed %d from dlist\n", removed->int1));
             DO(btree_print(&btree));
         }
@@ -212,6 +601,7 @@ int main()
             DO(printf("# No node inserted: %d is duplicate\n", element->int1));
         else
             DO(btree_print(&btree));
+        btree_check(&btree);
     }
 
     char *errors[ERROR_MAX];
@@ -226,4 +616,1571 @@ int main()
     }
     DO(printf("# Alpha ordered error string list (%zu items)\n", error_tree.count));
     DO(btree_print_str(&error_tree));
+
+    DO(printf("\n# Randomly insert and remove %d elements in btree\n", STRESS_MAX));
+    element_t *stress_elements = calloc(STRESS_MAX, sizeof(element_t));
+    ds_btree_t stress_tree;
+    ds_btree_init(&stress_tree, offsetof(element_t, btree_item), btree_node_cmp);
+    for (int i = 0; i < 8 * STRESS_MAX; i++)
+    {
+        element_t *element = &stress_elements[random() % STRESS_MAX];
+        if (ds_btree_remove_object(&stress_tree, element) != element)
+        {
+            element->int1 = random() % (2 * STRESS_MAX);
+            ds_btree_insert(&stress_tree, element);
+        }
+        if (i % 512 == 0)
+            btree_check(&stress_tree);
+    }
+    btree_check(&stress_tree);
+    DO(printf("# %zu elements left\n", stress_tree.count));
+
+    DO(printf("# Search btree from %d threads while removing and inserting elements\n", READER_MAX));
+    ds_btree_rw_t rw;
+    ds_btree_rw_init(&rw, offsetof(element_t, btree_item), btree_node_cmp);
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        stress_elements[i].int1 = i;
+        ds_btree_rw_insert(&rw, &stress_elements[i]);
+    }
+    pthread_t readers[READER_MAX];
+    for (int i = 0; i < READER_MAX; i++)
+        pthread_create(&readers[i], 0, btree_rw_reader, &rw);
+    for (int i = 0; i < 4 * STRESS_MAX; i++)
+    {
+        element_t *element = &stress_elements[random() % STRESS_MAX];
+        if (!ds_btree_rw_remove_object(&rw, element))
+            ds_btree_rw_insert(&rw, element);
+    }
+    for (int i = 0; i < READER_MAX; i++)
+        pthread_join(readers[i], 0);
+    btree_check(&rw.btree);
+    ds_btree_rw_destroy(&rw);
+
+    DO(printf("# Randomly insert and remove %d elements in bptree\n", STRESS_MAX));
+    size_t bptree_node_max = 2 * STRESS_MAX / DS_BPTREE_ORDER_MIN;
+    ds_bptree_node_t *bptree_nodes = calloc(bptree_node_max, sizeof(ds_bptree_node_t));
+    ds_heap_t bptree_heap;
+    DS_HEAP_INIT(bptree_heap, bptree_nodes, bptree_node_max, ds_bptree_node_t);
+    for (int with_prefix = 0; with_prefix < 2; with_prefix++)
+    {
+        ds_bptree_t bptree;
+        ds_bptree_init(&bptree, &bptree_heap, btree_node_cmp, with_prefix ? element_prefix : 0);
+        for (int i = 0; i < STRESS_MAX; i++)
+            stress_elements[i].int1 = i;
+        for (int i = 0; i < 16 * STRESS_MAX; i++)
+        {
+            element_t *element = &stress_elements[random() % STRESS_MAX];
+            if (ds_bptree_remove(&bptree, element) != element)
+            {
+                element_t *inserted = ds_bptree_insert(&bptree, element);
+                assert(inserted == element);
+                (void)inserted;
+            }
+            else
+                assert(ds_bptree_find(&bptree, element) == 0);
+            if (i % 512 == 0)
+                bptree_check(&bptree);
+        }
+        bptree_check(&bptree);
+        for (int k = -1; k <= STRESS_MAX; k++)
+        {
+            element_t key = {.int1 = k};
+            ds_bptree_iter_t iter;
+            element_t *element = ds_bptree_seek(&bptree, &iter, &key);
+            assert(!element || element->int1 >= k);
+            element_t *previous = ds_bptree_prev(&iter);
+            assert(!previous || previous->int1 < k);
+            (void)element;
+            (void)previous;
+        }
+        while (bptree.root)
+        {
+            ds_bptree_iter_t iter;
+            ds_bptree_remove(&bptree, ds_bptree_first(&bptree, &iter));
+        }
+        bptree_check(&bptree);
+    }
+    assert(bptree_heap.free_list.count == bptree_node_max);
+    free(bptree_nodes);
+
+    DO(printf("# Mix specialized and generic functions on btree, fifo, lifo and dlist\n"));
+    ds_btree_init(&stress_tree, offsetof(element_t, btree_item), btree_node_cmp);
+    ds_fifo_init(&fifo, offsetof(element_t, fifo_item));
+    ds_lifo_init(&lifo, offsetof(element_t, lifo_item));
+    ds_dlist_init(&dlist, offsetof(element_t, dlist_item));
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        element_t *element = &stress_elements[i];
+        element->int1 = random() % (2 * STRESS_MAX);
+        element_t *inserted;
+        if (i % 2)
+        {
+            inserted = element_btree_insert(&stress_tree, element);
+            assert(inserted == ds_btree_find(&stress_tree, element));
+        }
+        else
+        {
+            inserted = ds_btree_insert(&stress_tree, element);
+            assert(inserted == element_btree_find(&stress_tree, element));
+        }
+        (void)inserted;
+        element_fifo_enq(&fifo, element);
+        element_lifo_push(&lifo, element);
+        if (i % 2)
+            element_dlist_enq(&dlist, element);
+        else
+            element_dlist_push(&dlist, element);
+    }
+    btree_check(&stress_tree);
+    for (int k = -1; k <= 2 * STRESS_MAX; k++)
+    {
+        element_t key = {.int1 = k};
+        assert(element_btree_find(&stress_tree, &key) == ds_btree_find(&stress_tree, &key));
+        assert(element_btree_lower_bound(&stress_tree, &key) == ds_btree_lower_bound(&stress_tree, &key));
+        assert(element_btree_upper_bound(&stress_tree, &key) == ds_btree_upper_bound(&stress_tree, &key));
+        assert(element_btree_floor(&stress_tree, &key) == ds_btree_floor(&stress_tree, &key));
+        (void)key;
+    }
+    element_t *fifo_element = element_fifo_first(&fifo);
+    element_t *lifo_element = element_lifo_first(&lifo);
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        assert(fifo_element == &stress_elements[i]);
+        assert(lifo_element == &stress_elements[STRESS_MAX - 1 - i]);
+        fifo_element = element_fifo_next(fifo_element);
+        lifo_element = element_lifo_next(lifo_element);
+    }
+    assert(!fifo_element && !lifo_element);
+    assert(element_dlist_first(&dlist) == &stress_elements[STRESS_MAX - 2]);
+    assert(element_dlist_last(&dlist) == &stress_elements[STRESS_MAX - 1]);
+    assert(element_dlist_prev(element_dlist_next(&stress_elements[0])) == &stress_elements[0]);
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        element_t *element = &stress_elements[i];
+        if (i % 2)
+            element_btree_remove(&stress_tree, element);
+        else
+            ds_btree_remove_object(&stress_tree, element);
+        element_t *fifo_deq = element_fifo_deq(&fifo);
+        element_t *lifo_pop = ds_lifo_pop(&lifo);
+        assert(fifo_deq == element);
+        assert(lifo_pop == &stress_elements[STRESS_MAX - 1 - i]);
+        (void)fifo_deq;
+        (void)lifo_pop;
+        element_dlist_remove(&dlist, element);
+    }
+    assert(stress_tree.count == 0 && DS_IS_EMPTY(&fifo) && DS_IS_EMPTY(&dlist) && !dlist.root && !dlist.last);
+
+    DO(printf("# Randomly insert and remove %d elements in an uint64_t keyed btree\n", STRESS_MAX));
+    ds_btree_t u64_tree;
+    ds_btree_u64_init(&u64_tree, offsetof(element_t, btree_item), offsetof(element_t, id));
+    for (int i = 0; i < 8 * STRESS_MAX; i++)
+    {
+        element_t *element = &stress_elements[random() % STRESS_MAX];
+        if (ds_btree_u64_remove(&u64_tree, element->id) != element)
+        {
+            element->id = ((uint64_t)random() << 32) % (2 * (uint64_t)STRESS_MAX << 32);
+            if (i % 2)
+                ds_btree_u64_insert(&u64_tree, element);
+            else
+                ds_btree_insert(&u64_tree, element);
+        }
+        if (i % 512 == 0)
+            btree_check(&u64_tree);
+    }
+    btree_check(&u64_tree);
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        uint64_t key = stress_elements[i].id + i % 3 - 1;
+        element_t key_element = {.id = key};
+        assert(ds_btree_u64_find(&u64_tree, key) == ds_btree_find(&u64_tree, &key_element));
+        assert(ds_btree_u64_lower_bound(&u64_tree, key) == ds_btree_lower_bound(&u64_tree, &key_element));
+        assert(ds_btree_u64_upper_bound(&u64_tree, key) == ds_btree_upper_bound(&u64_tree, &key_element));
+        assert(ds_btree_u64_floor(&u64_tree, key) == ds_btree_floor(&u64_tree, &key_element));
+        (void)key_element;
+    }
+
+    DO(printf("# Build balanced btrees from sorted arrays, fifo and dlist\n"));
+    void *sorted[STRESS_MAX];
+    for (int count = 0; count <= STRESS_MAX; count += count < 20 ? 1 : 97)
+    {
+        ds_btree_init(&stress_tree, offsetof(element_t, btree_item), btree_node_cmp);
+        ds_fifo_init(&fifo, offsetof(element_t, fifo_item));
+        ds_dlist_init(&dlist, offsetof(element_t, dlist_item));
+        for (int i = 0; i < count; i++)
+        {
+            stress_elements[i].int1 = 2 * i;
+            sorted[i] = &stress_elements[i];
+            ds_fifo_enq(&fifo, &stress_elements[i]);
+            ds_dlist_enq(&dlist, &stress_elements[i]);
+        }
+        int built = ds_btree_build_sorted(&stress_tree, sorted, count, 1);
+        assert(built == 0);
+        btree_check(&stress_tree);
+        if (count >= 2)
+        {
+            built = ds_btree_build_sorted(&stress_tree, sorted, count, 1);
+            assert(built == -1);
+        }
+        for (int i = 0; i < count; i++)
+            assert(ds_btree_find(&stress_tree, &stress_elements[i]) == &stress_elements[i]);
+        ds_btree_init(&stress_tree, offsetof(element_t, btree_item), btree_node_cmp);
+        built = ds_btree_build_sorted_fifo(&stress_tree, &fifo, 1);
+        assert(built == 0);
+        btree_check(&stress_tree);
+        ds_btree_init(&stress_tree, offsetof(element_t, btree_item), btree_node_cmp);
+        built = ds_btree_build_sorted_dlist(&stress_tree, &dlist, 0);
+        assert(built == 0);
+        btree_check(&stress_tree);
+        if (count >= 2)
+        {
+            ds_btree_init(&stress_tree, offsetof(element_t, btree_item), btree_node_cmp);
+            stress_elements[count - 1].int1 = stress_elements[count - 2].int1;
+            built = ds_btree_build_sorted(&stress_tree, sorted, count, 1);
+            assert(built == -1);
+            assert(stress_tree.count == 0 && stress_tree.root == 0);
+        }
+        (void)built;
+    }
+    ds_btree_ext_item_t sorted_error_items[ERROR_MAX];
+    void *sorted_errors[ERROR_MAX];
+    size_t sorted_error_count = 0;
+    for (char *error = ds_btree_ext_lower_bound(&error_tree, ""); error; error = ds_btree_ext_upper_bound(&error_tree, error))
+        sorted_errors[sorted_error_count++] = error;
+    ds_btree_t sorted_error_tree;
+    ds_btree_ext_init(&sorted_error_tree, (bs_btree_cmp_f)strcmp);
+    int sorted_error_built = ds_btree_ext_build_sorted(&sorted_error_tree, sorted_error_items, sorted_errors, sorted_error_count, 1);
+    assert(sorted_error_built == 0 && sorted_error_tree.count == error_tree.count);
+    (void)sorted_error_built;
+    for (size_t i = 0; i < sorted_error_count; i++)
+        assert(ds_btree_ext_find(&sorted_error_tree, sorted_errors[i]) == sorted_errors[i]);
+    ds_btree_rank_enable(&sorted_error_tree);
+    for (size_t i = 0; i < sorted_error_count; i++)
+    {
+        assert(ds_btree_ext_select(&sorted_error_tree, i) == sorted_errors[i]);
+        assert(ds_btree_ext_rank(&sorted_error_tree, sorted_errors[i]) == i);
+    }
+
+    DO(printf("# Select and rank in a ranked btree while inserting and removing\n"));
+    ds_btree_init(&stress_tree, offsetof(element_t, btree_item), btree_node_cmp);
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        stress_elements[i].int1 = 2 * i;
+        if (i % 3 == 0)
+            ds_btree_insert(&stress_tree, &stress_elements[i]);
+    }
+    ds_btree_rank_enable(&stress_tree);
+    btree_check(&stress_tree);
+    for (int i = 0; i < 4 * STRESS_MAX; i++)
+    {
+        element_t *element = &stress_elements[random() % STRESS_MAX];
+        if (!ds_btree_remove_object(&stress_tree, element))
+            element_btree_insert(&stress_tree, element);
+        if (i % 256 == 0)
+        {
+            btree_check(&stress_tree);
+            size_t rank = 0;
+            for (int j = 0; j < STRESS_MAX; j++)
+            {
+                element_t key = {.int1 = 2 * j - 1};
+                assert(ds_btree_rank(&stress_tree, &key) == rank);
+                (void)key;
+                if (ds_btree_find(&stress_tree, &stress_elements[j]))
+                {
+                    assert(ds_btree_rank(&stress_tree, &stress_elements[j]) == rank);
+                    assert(ds_btree_select(&stress_tree, rank) == &stress_elements[j]);
+                    rank++;
+                }
+            }
+            assert(rank == stress_tree.count);
+            assert(ds_btree_select(&stress_tree, rank) == 0);
+        }
+    }
+
+    DO(printf("# Walk and remove with btree cursors\n"));
+    ds_btree_cursor_t cursor;
+    element_t *cursor_element;
+    int cursor_count = 0;
+    for (cursor_element = ds_btree_cursor_first(&cursor, &stress_tree); cursor_element; cursor_element = ds_btree_cursor_next(&cursor))
+    {
+        assert(ds_btree_select(&stress_tree, cursor_count) == cursor_element);
+        cursor_count++;
+    }
+    assert(cursor_count == stress_tree.count);
+    cursor_element = ds_btree_cursor_next(&cursor);
+    assert(cursor_element == 0 && ds_btree_cursor_object(&cursor) == 0);
+    for (cursor_element = ds_btree_cursor_last(&cursor, &stress_tree); cursor_element; cursor_element = ds_btree_cursor_prev(&cursor))
+    {
+        cursor_count--;
+        assert(ds_btree_select(&stress_tree, cursor_count) == cursor_element);
+    }
+    assert(cursor_count == 0);
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        element_t key = {.int1 = 2 * i - 1};
+        cursor_element = ds_btree_cursor_seek(&cursor, &stress_tree, &key);
+        assert(cursor_element == ds_btree_lower_bound(&stress_tree, &key));
+        if (cursor_element)
+        {
+            element_t *cursor_moved = ds_btree_cursor_next(&cursor);
+            assert(cursor_moved == ds_btree_upper_bound(&stress_tree, cursor_element));
+            ds_btree_cursor_seek(&cursor, &stress_tree, cursor_element);
+            cursor_moved = ds_btree_cursor_prev(&cursor);
+            assert(cursor_moved == ds_btree_floor(&stress_tree, &key));
+            (void)cursor_moved;
+        }
+    }
+    size_t cursor_kept = 0;
+    cursor_element = ds_btree_cursor_first(&cursor, &stress_tree);
+    while (cursor_element)
+    {
+        if (cursor_element->int1 % 4 == 0)
+        {
+            element_t *next = ds_btree_upper_bound(&stress_tree, cursor_element);
+            element_t *removed = ds_btree_cursor_remove(&cursor);
+            assert(removed == cursor_element);
+            cursor_element = ds_btree_cursor_object(&cursor);
+            assert(cursor_element == next);
+            (void)next;
+            (void)removed;
+        }
+        else
+        {
+            cursor_kept++;
+            cursor_element = ds_btree_cursor_next(&cursor);
+        }
+    }
+    cursor_element = ds_btree_cursor_remove(&cursor);
+    assert(cursor_element == 0 && stress_tree.count == cursor_kept);
+    btree_check(&stress_tree);
+    for (cursor_element = ds_btree_cursor_first(&cursor, &stress_tree); cursor_element; cursor_element = ds_btree_cursor_next(&cursor))
+        assert(cursor_element->int1 % 4 != 0);
+    size_t cursor_errors = 0;
+    for (char *error = ds_btree_cursor_first(&cursor, &error_tree); error; error = ds_btree_cursor_next(&cursor))
+    {
+        assert(error == ds_btree_ext_select(&sorted_error_tree, cursor_errors));
+        cursor_errors++;
+    }
+    assert(cursor_errors == error_tree.count);
+
+    DO(printf("# Union, intersection and difference of btrees\n"));
+    element_t *other_elements = calloc(STRESS_MAX, sizeof(element_t));
+    char in_btree[STRESS_MAX], in_other[STRESS_MAX];
+    for (int round = 0; round < 60; round++)
+    {
+        ds_btree_t set_tree, other_tree;
+        ds_btree_init(&set_tree, offsetof(element_t, btree_item), btree_node_cmp);
+        ds_btree_init(&other_tree, offsetof(element_t, btree_item), btree_node_cmp);
+        int btree_density = random() % 101;
+        int other_density = round % 4 == 0 ? random() % 3 : random() % 101;
+        size_t both = 0, only_btree = 0;
+        for (int i = 0; i < STRESS_MAX; i++)
+        {
+            stress_elements[i].int1 = i;
+            other_elements[i].int1 = i;
+            in_btree[i] = random() % 100 < btree_density;
+            in_other[i] = random() % 100 < other_density;
+            if (in_btree[i])
+                ds_btree_insert(&set_tree, &stress_elements[i]);
+            if (in_other[i])
+                ds_btree_insert(&other_tree, &other_elements[i]);
+            both += in_btree[i] && in_other[i];
+            only_btree += in_btree[i] && !in_other[i];
+        }
+        if (round % 2)
+            ds_btree_rank_enable(&set_tree);
+        if (round % 5 == 0)
+            ds_btree_rank_enable(&other_tree);
+        btree_dropped = 0;
+        int set_result;
+        if (round % 3 == 0)
+        {
+            set_result = ds_btree_union(&set_tree, &other_tree, btree_drop);
+            assert(set_result == 0);
+            assert(other_tree.count == 0 && other_tree.root == 0);
+            assert(btree_dropped == both);
+            for (int i = 0; i < STRESS_MAX; i++)
+                assert(ds_btree_find(&set_tree, &stress_elements[i]) == (in_btree[i] ? &stress_elements[i] : in_other[i] ? &other_elements[i] : 0));
+        }
+        else if (round % 3 == 1)
+        {
+            set_result = ds_btree_intersection(&set_tree, &other_tree, btree_drop);
+            assert(set_result == 0);
+            assert(btree_dropped == only_btree && set_tree.count == both);
+            for (int i = 0; i < STRESS_MAX; i++)
+                assert(ds_btree_find(&set_tree, &stress_elements[i]) == (in_btree[i] && in_other[i] ? &stress_elements[i] : 0));
+        }
+        else
+        {
+            set_result = ds_btree_difference(&set_tree, &other_tree, btree_drop);
+            assert(set_result == 0);
+            assert(btree_dropped == both && set_tree.count == only_btree);
+            for (int i = 0; i < STRESS_MAX; i++)
+                assert(ds_btree_find(&set_tree, &stress_elements[i]) == (in_btree[i] && !in_other[i] ? &stress_elements[i] : 0));
+        }
+        if (round % 3 != 0)
+        {
+            for (int i = 0; i < STRESS_MAX; i++)
+                assert(ds_btree_find(&other_tree, &other_elements[i]) == (in_other[i] ? &other_elements[i] : 0));
+            btree_check(&other_tree);
+        }
+        btree_check(&set_tree);
+        (void)set_result;
+        (void)both;
+        (void)only_btree;
+    }
+    ds_btree_t u64_other_tree;
+    ds_btree_u64_init(&u64_other_tree, offsetof(element_t, btree_item), offsetof(element_t, id));
+    int u64_union = ds_btree_union(&stress_tree, &u64_other_tree, 0);
+    assert(u64_union == -1);
+    (void)u64_union;
+    free(other_elements);
+
+    DO(printf("# Split, extract and join btrees\n"));
+    ds_btree_init(&stress_tree, offsetof(element_t, btree_item), btree_node_cmp);
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        stress_elements[i].int1 = 2 * i;
+        ds_btree_insert(&stress_tree, &stress_elements[i]);
+    }
+    for (int round = 0; round < 200; round++)
+    {
+        ds_btree_t range_tree, right_tree;
+        element_t low = {.int1 = random() % (2 * STRESS_MAX + 2) - 1};
+        element_t high = {.int1 = low.int1 + random() % (round % 2 ? 16 : 2 * STRESS_MAX)};
+        ds_btree_extract_range(&stress_tree, &low, &high, &range_tree);
+        // The first cut ranks the btree to count the moved objects
+        assert(stress_tree._ranked && range_tree._ranked);
+        size_t range_count = 0;
+        for (int i = 0; i < STRESS_MAX; i++)
+        {
+            int in_range = stress_elements[i].int1 >= low.int1 && stress_elements[i].int1 < high.int1;
+            assert(ds_btree_find(in_range ? &range_tree : &stress_tree, &stress_elements[i]) == &stress_elements[i]);
+            range_count += in_range;
+        }
+        assert(range_tree.count == range_count && stress_tree.count == STRESS_MAX - range_count);
+        btree_check(&stress_tree);
+        btree_check(&range_tree);
+        ds_btree_split(&stress_tree, &low, &right_tree);
+        btree_check(&stress_tree);
+        btree_check(&right_tree);
+        ds_btree_cursor_t right_cursor;
+        element_t *right_first = ds_btree_cursor_first(&right_cursor, &right_tree);
+        assert(ds_btree_lower_bound(&right_tree, &low) == right_first);
+        assert(ds_btree_lower_bound(&stress_tree, &low) == 0);
+        int joined;
+        // Joining overlapping btrees fails
+        if (range_count && right_tree.count)
+        {
+            joined = ds_btree_join(&right_tree, &range_tree);
+            assert(joined == -1);
+        }
+        joined = ds_btree_join(&stress_tree, &range_tree);
+        assert(joined == 0 && range_tree.count == 0);
+        joined = ds_btree_join(&stress_tree, &right_tree);
+        assert(joined == 0 && right_tree.count == 0);
+        assert(stress_tree.count == STRESS_MAX);
+        btree_check(&stress_tree);
+        (void)right_first;
+        (void)joined;
+    }
+
+    DO(printf("# Bulk insert into btrees with threads\n"));
+    element_t *bulk_elements = calloc(BULK_MAX, sizeof(element_t));
+    void **bulk_objects = calloc(BULK_MAX, sizeof(void *));
+    element_t **bulk_first = calloc(BULK_MAX, sizeof(element_t *));
+    for (int threads = 1; threads <= 16; threads *= 2)
+    {
+        ds_btree_init(&stress_tree, offsetof(element_t, btree_item), btree_node_cmp);
+        if (threads == 4)
+            ds_btree_rank_enable(&stress_tree);
+        memset(bulk_first, 0, BULK_MAX * sizeof(element_t *));
+        for (int i = 0; i < BULK_MAX; i++)
+        {
+            bulk_elements[i].int1 = threads == 8 ? i : random() % BULK_MAX;
+            bulk_objects[i] = &bulk_elements[i];
+            if (i < BULK_MAX / 10)
+                ds_btree_insert(&stress_tree, &bulk_elements[i]);
+        }
+        for (int i = 0; i < BULK_MAX; i++)
+            if (bulk_first[bulk_elements[i].int1] == 0)
+                bulk_first[bulk_elements[i].int1] = ds_btree_find(&stress_tree, &bulk_elements[i]) ? ds_btree_find(&stress_tree, &bulk_elements[i]) : &bulk_elements[i];
+        int bulk_inserted = ds_btree_bulk_insert(&stress_tree, bulk_objects + BULK_MAX / 10, BULK_MAX - BULK_MAX / 10, threads);
+        assert(bulk_inserted == 0);
+        (void)bulk_inserted;
+        btree_check(&stress_tree);
+        size_t bulk_count = 0;
+        for (int i = 0; i < BULK_MAX; i++)
+        {
+            element_t key = {.int1 = i};
+            assert(ds_btree_find(&stress_tree, &key) == bulk_first[i]);
+            bulk_count += bulk_first[i] != 0;
+            (void)key;
+        }
+        assert(stress_tree.count == bulk_count);
+        (void)bulk_count;
+    }
+    size_t bulk_before = stress_tree.count;
+    int bulk_result = ds_btree_bulk_insert(&stress_tree, bulk_objects, 0, 4);
+    assert(bulk_result == 0 && stress_tree.count == bulk_before);
+    // Ext btrees have no items in the objects to build the subtrees with
+    void *bulk_error = errors[0];
+    bulk_result = ds_btree_bulk_insert(&error_tree, &bulk_error, 1, 1);
+    assert(bulk_result == -1 && ds_btree_ext_find(&error_tree, errors[0]) == errors[0]);
+    (void)bulk_before;
+    (void)bulk_result;
+    free(bulk_first);
+    free(bulk_objects);
+    free(bulk_elements);
+
+    DO(printf("# Lazy and growable heaps\n"));
+    ds_heap_t lazy_heap;
+    element_t *lazy_store = malloc(ITEM_MAX * sizeof(element_t));
+    DS_HEAP_INIT_LAZY(lazy_heap, lazy_store, ITEM_MAX, element_t);
+    element_t *lazy_element;
+    for (int i = 0; i < ITEM_MAX; i++)
+    {
+        lazy_element = ds_heap_alloc(&lazy_heap);
+        assert(lazy_element == &lazy_store[i]);
+    }
+    lazy_element = ds_heap_alloc(&lazy_heap);
+    assert(lazy_element == 0);
+    ds_heap_free(&lazy_heap, &lazy_store[7]);
+    lazy_element = ds_heap_alloc(&lazy_heap);
+    assert(lazy_element == &lazy_store[7]);
+    (void)lazy_element;
+    assert(lazy_heap.count == ITEM_MAX && lazy_heap.high_water == ITEM_MAX && lazy_heap.slab_count == 0);
+    free(lazy_store);
+    ds_heap_t growable_heap;
+    element_t *growable_elements[STRESS_MAX];
+    DS_HEAP_INIT_GROWABLE(growable_heap, 16, element_t);
+    for (int round = 0; round < 2; round++)
+    {
+        for (int i = 0; i < STRESS_MAX; i++)
+        {
+            growable_elements[i] = ds_heap_alloc(&growable_heap);
+            assert(growable_elements[i] != 0 && (uintptr_t)growable_elements[i] % _Alignof(element_t) == 0);
+            growable_elements[i]->int1 = i;
+        }
+        for (int i = 0; i < STRESS_MAX; i++)
+            assert(growable_elements[i]->int1 == i);
+        assert(growable_heap.slab_count == (STRESS_MAX + 15) / 16);
+        assert(growable_heap.count == STRESS_MAX && growable_heap.high_water == STRESS_MAX);
+        for (int i = 0; i < STRESS_MAX; i++)
+            ds_heap_free(&growable_heap, growable_elements[i]);
+        assert(growable_heap.count == 0);
+    }
+    ds_heap_destroy(&growable_heap);
+    assert(growable_heap.slab_count == 0 && growable_heap.high_water == 0);
+    growable_elements[0] = ds_heap_alloc(&growable_heap);
+    assert(growable_elements[0] != 0 && growable_heap.slab_count == 1);
+    ds_heap_destroy(&growable_heap);
+
+    DO(printf("# Heap cache shared by threads freeing each other's elements\n"));
+    ds_heap_t shared_heap;
+    ds_heap_cache_t heap_cache;
+    DS_HEAP_INIT_GROWABLE(shared_heap, 256, element_t);
+    int heap_cache_initialized = ds_heap_cache_init(&heap_cache, &shared_heap);
+    assert(heap_cache_initialized == 0);
+    (void)heap_cache_initialized;
+    pthread_barrier_t heap_cache_barrier;
+    pthread_barrier_init(&heap_cache_barrier, 0, READER_MAX);
+    pthread_t heap_cache_threads[READER_MAX];
+    heap_cache_thread_t heap_cache_args[READER_MAX];
+    element_t **heap_cache_elements = calloc(READER_MAX * STRESS_MAX, sizeof(element_t *));
+    for (int i = 0; i < READER_MAX; i++)
+    {
+        heap_cache_args[i].cache = &heap_cache;
+        heap_cache_args[i].barrier = &heap_cache_barrier;
+        heap_cache_args[i].elements = heap_cache_elements + i * STRESS_MAX;
+        heap_cache_args[i].next_thread_elements = heap_cache_elements + (i + 1) % READER_MAX * STRESS_MAX;
+        pthread_create(&heap_cache_threads[i], 0, heap_cache_thread, &heap_cache_args[i]);
+    }
+    for (int i = 0; i < READER_MAX; i++)
+        pthread_join(heap_cache_threads[i], 0);
+    element_t *cached_element = ds_heap_cache_alloc(&heap_cache);
+    assert(cached_element != 0 && cached_element->id != HEAP_CACHE_IN_USE);
+    ds_heap_cache_free(&heap_cache, cached_element);
+    ds_heap_cache_destroy(&heap_cache);
+    assert(shared_heap.count == 0);
+    assert(shared_heap.high_water < READER_MAX * (STRESS_MAX + 3 * DS_HEAP_CACHE_MAGAZINE_SIZE));
+    ds_heap_destroy(&shared_heap);
+    pthread_barrier_destroy(&heap_cache_barrier);
+    free(heap_cache_elements);
+
+    DO(printf("# Multi-producer single-consumer fifo\n"));
+    ds_mpsc_t mpsc;
+    ds_mpsc_init(&mpsc, offsetof(element_t, mpsc_item));
+    element_t *mpsc_element = ds_mpsc_deq(&mpsc);
+    assert(mpsc_element == 0);
+    ds_mpsc_enq(&mpsc, &stress_elements[0]);
+    ds_mpsc_enq(&mpsc, &stress_elements[1]);
+    mpsc_element = ds_mpsc_deq(&mpsc);
+    assert(mpsc_element == &stress_elements[0]);
+    ds_mpsc_enq(&mpsc, &stress_elements[2]);
+    mpsc_element = ds_mpsc_deq(&mpsc);
+    assert(mpsc_element == &stress_elements[1]);
+    mpsc_element = ds_mpsc_deq(&mpsc);
+    assert(mpsc_element == &stress_elements[2]);
+    mpsc_element = ds_mpsc_deq(&mpsc);
+    assert(mpsc_element == 0);
+    element_t *mpsc_elements = calloc(READER_MAX * STRESS_MAX, sizeof(element_t));
+    pthread_t mpsc_threads[READER_MAX];
+    mpsc_producer_t mpsc_producers[READER_MAX];
+    int mpsc_next[READER_MAX] = {0};
+    for (int i = 0; i < READER_MAX * STRESS_MAX; i++)
+        mpsc_elements[i].id = ((uint64_t)(i / STRESS_MAX) << 32) | (i % STRESS_MAX);
+    for (int i = 0; i < READER_MAX; i++)
+    {
+        mpsc_producers[i].mpsc = &mpsc;
+        mpsc_producers[i].elements = mpsc_elements + i * STRESS_MAX;
+        pthread_create(&mpsc_threads[i], 0, mpsc_producer, &mpsc_producers[i]);
+    }
+    for (int received = 0; received < READER_MAX * STRESS_MAX;)
+    {
+        void *batch[16];
+        size_t count = ds_mpsc_deq_batch(&mpsc, batch, 16);
+        for (size_t i = 0; i < count; i++)
+        {
+            element_t *element = batch[i];
+            int producer = element->id >> 32;
+            assert((int)(element->id & 0xffffffff) == mpsc_next[producer]);
+            mpsc_next[producer]++;
+        }
+        received += count;
+    }
+    for (int i = 0; i < READER_MAX; i++)
+    {
+        pthread_join(mpsc_threads[i], 0);
+        assert(mpsc_next[i] == STRESS_MAX);
+    }
+    mpsc_element = ds_mpsc_deq(&mpsc);
+    assert(mpsc_element == 0);
+    (void)mpsc_element;
+    free(mpsc_elements);
+
+    DO(printf("# Single-producer single-consumer ring\n"));
+    ds_ring_t ring;
+    void *ring_store[RING_SIZE];
+    int ring_result = ds_ring_init(&ring, ring_store, RING_SIZE - 1);
+    assert(ring_result == -1);
+    ring_result = ds_ring_init(&ring, ring_store, RING_SIZE);
+    assert(ring_result == 0);
+    element_t *ring_element = ds_ring_deq(&ring);
+    assert(ring_element == 0);
+    for (int i = 0; i < RING_SIZE; i++)
+    {
+        ring_result = ds_ring_enq(&ring, &stress_elements[i]);
+        assert(ring_result == 0);
+    }
+    ring_result = ds_ring_enq(&ring, &stress_elements[0]);
+    assert(ring_result == -1);
+    for (int i = 0; i < RING_SIZE; i++)
+    {
+        ring_element = ds_ring_deq(&ring);
+        assert(ring_element == &stress_elements[i]);
+    }
+    ring_element = ds_ring_deq(&ring);
+    assert(ring_element == 0);
+    pthread_t ring_thread;
+    pthread_create(&ring_thread, 0, ring_producer, &ring);
+    for (uintptr_t expected = 1; expected <= RING_MESSAGES;)
+    {
+        void *batch[13];
+        size_t count = ds_ring_deq_batch(&ring, batch, 1 + expected % 13);
+        for (size_t i = 0; i < count; i++)
+        {
+            assert((uintptr_t)batch[i] == expected);
+            expected++;
+        }
+    }
+    pthread_join(ring_thread, 0);
+    ring_element = ds_ring_deq(&ring);
+    assert(ring_element == 0);
+    (void)ring_result;
+    (void)ring_element;
+
+    DO(printf("# Multi-producer multi-consumer fifo\n"));
+    ds_mpmc_t mpmc;
+    ds_mpmc_slot_t mpmc_slots[MPMC_SIZE];
+    int mpmc_result = ds_mpmc_init(&mpmc, mpmc_slots, MPMC_SIZE + 1);
+    assert(mpmc_result == -1);
+    mpmc_result = ds_mpmc_init(&mpmc, mpmc_slots, MPMC_SIZE);
+    assert(mpmc_result == 0);
+    element_t *mpmc_element = ds_mpmc_try_deq(&mpmc);
+    assert(mpmc_element == 0);
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < MPMC_SIZE; i++)
+        {
+            mpmc_result = ds_mpmc_try_enq(&mpmc, &stress_elements[i]);
+            assert(mpmc_result == 0);
+        }
+        mpmc_result = ds_mpmc_try_enq(&mpmc, &stress_elements[0]);
+        assert(mpmc_result == -1);
+        void *mpmc_batch[MPMC_SIZE];
+        size_t mpmc_count = ds_mpmc_try_deq_batch(&mpmc, mpmc_batch, 5);
+        assert(mpmc_count == 5);
+        mpmc_count = ds_mpmc_try_enq_batch(&mpmc, (void **)mpmc_batch, 7);
+        assert(mpmc_count == 5);
+        for (int i = 5; i < MPMC_SIZE; i++)
+        {
+            mpmc_element = ds_mpmc_try_deq(&mpmc);
+            assert(mpmc_element == &stress_elements[i]);
+        }
+        mpmc_count = ds_mpmc_try_deq_batch(&mpmc, mpmc_batch, MPMC_SIZE);
+        assert(mpmc_count == 5);
+        for (int i = 0; i < 5; i++)
+            assert(mpmc_batch[i] == &stress_elements[i]);
+        mpmc_element = ds_mpmc_try_deq(&mpmc);
+        assert(mpmc_element == 0);
+        (void)mpmc_count;
+    }
+    element_t *mpmc_elements = calloc(READER_MAX * STRESS_MAX, sizeof(element_t));
+    pthread_t mpmc_threads[2 * READER_MAX];
+    mpmc_thread_t mpmc_args[2 * READER_MAX];
+    for (int i = 0; i < READER_MAX; i++)
+    {
+        mpmc_args[i] = (mpmc_thread_t){&mpmc, mpmc_elements + i * STRESS_MAX, STRESS_MAX};
+        mpmc_args[READER_MAX + i] = (mpmc_thread_t){&mpmc, 0, STRESS_MAX};
+        pthread_create(&mpmc_threads[i], 0, mpmc_producer, &mpmc_args[i]);
+        pthread_create(&mpmc_threads[READER_MAX + i], 0, mpmc_consumer, &mpmc_args[READER_MAX + i]);
+    }
+    for (int i = 0; i < 2 * READER_MAX; i++)
+        pthread_join(mpmc_threads[i], 0);
+    for (int i = 0; i < READER_MAX * STRESS_MAX; i++)
+        assert(mpmc_elements[i].int1 == 1);
+    mpmc_element = ds_mpmc_try_deq(&mpmc);
+    assert(mpmc_element == 0);
+    (void)mpmc_result;
+    (void)mpmc_element;
+    free(mpmc_elements);
+
+    DO(printf("# Lock-free lifo shared by threads\n"));
+    ds_lifo_atomic_t lifo_atomic;
+    ds_lifo_t lifo_chain;
+    ds_lifo_atomic_init(&lifo_atomic, offsetof(element_t, lifo_item));
+    ds_lifo_init(&lifo_chain, offsetof(element_t, lifo_item));
+    element_t *lifo_atomic_element = ds_lifo_atomic_pop(&lifo_atomic);
+    assert(lifo_atomic_element == 0);
+    size_t lifo_atomic_count = ds_lifo_atomic_pop_all(&lifo_atomic, &lifo_chain);
+    assert(lifo_atomic_count == 0);
+    for (int i = 0; i < 3; i++)
+        ds_lifo_push(&lifo_chain, &stress_elements[i]);
+    ds_lifo_atomic_push(&lifo_atomic, &stress_elements[3]);
+    ds_lifo_atomic_push_chain(&lifo_atomic, &lifo_chain);
+    assert(lifo_chain.count == 0 && lifo_chain.root == 0);
+    lifo_atomic_element = ds_lifo_atomic_pop(&lifo_atomic);
+    assert(lifo_atomic_element == &stress_elements[2]);
+    ds_lifo_push(&lifo_chain, &stress_elements[4]);
+    lifo_atomic_count = ds_lifo_atomic_pop_all(&lifo_atomic, &lifo_chain);
+    assert(lifo_atomic_count == 3);
+    lifo_atomic_element = ds_lifo_atomic_pop(&lifo_atomic);
+    assert(lifo_chain.count == 4 && lifo_atomic_element == 0);
+    int lifo_chain_order[] = {1, 0, 3, 4};
+    for (int i = 0; i < 4; i++)
+    {
+        lifo_atomic_element = ds_lifo_pop(&lifo_chain);
+        assert(lifo_atomic_element == &stress_elements[lifo_chain_order[i]]);
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        stress_elements[i].int1 = -1;
+        ds_lifo_atomic_push(&lifo_atomic, &stress_elements[i]);
+    }
+    pthread_t lifo_atomic_threads[READER_MAX];
+    lifo_atomic_thread_t lifo_atomic_args[READER_MAX];
+    for (int i = 0; i < READER_MAX; i++)
+    {
+        lifo_atomic_args[i] = (lifo_atomic_thread_t){&lifo_atomic, i};
+        pthread_create(&lifo_atomic_threads[i], 0, lifo_atomic_thread, &lifo_atomic_args[i]);
+    }
+    for (int i = 0; i < READER_MAX; i++)
+        pthread_join(lifo_atomic_threads[i], 0);
+    lifo_atomic_count = ds_lifo_atomic_pop_all(&lifo_atomic, &lifo_chain);
+    assert(lifo_atomic_count == 64);
+    for (int i = 0; i < 64; i++)
+        assert(stress_elements[i].int1 == -1);
+    (void)lifo_chain_order;
+    (void)lifo_atomic_element;
+    (void)lifo_atomic_count;
+
+    DO(printf("# Priority queue\n"));
+    ds_pqueue_t pqueue, pqueue_other;
+    ds_pqueue_init(&pqueue, offsetof(element_t, pqueue_item), btree_node_cmp);
+    ds_pqueue_init(&pqueue_other, offsetof(element_t, pqueue_item), btree_node_cmp);
+    element_t *pqueue_min = ds_pqueue_pop_min(&pqueue);
+    assert(ds_pqueue_peek_min(&pqueue) == 0 && pqueue_min == 0);
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        stress_elements[i].int1 = random() % STRESS_MAX;
+        stress_elements[i].id = 1;
+        ds_pqueue_insert(i % 2 ? &pqueue : &pqueue_other, &stress_elements[i]);
+    }
+    ds_pqueue_meld(&pqueue, &pqueue_other);
+    assert(pqueue.count == STRESS_MAX && pqueue_other.count == 0 && ds_pqueue_peek_min(&pqueue_other) == 0);
+    for (int i = 0; i < 20 * STRESS_MAX; i++)
+    {
+        element_t *element = &stress_elements[random() % STRESS_MAX];
+        switch (random() % 4)
+        {
+        case 0:
+            if (element->id)
+            {
+                element->int1 -= random() % STRESS_MAX;
+                ds_pqueue_decrease_key(&pqueue, element);
+            }
+            break;
+        case 1:
+            if (element->id)
+            {
+                ds_pqueue_remove(&pqueue, element);
+                element->id = 0;
+            }
+            break;
+        case 2:
+            element = ds_pqueue_pop_min(&pqueue);
+            if (element)
+                element->id = 0;
+            break;
+        default:
+            if (!element->id)
+            {
+                element->int1 = random() % STRESS_MAX;
+                element->id = 1;
+                ds_pqueue_insert(&pqueue, element);
+            }
+            break;
+        }
+        size_t count = 0;
+        element_t *min = 0;
+        for (int j = 0; j < STRESS_MAX; j++)
+        {
+            if (!stress_elements[j].id)
+                continue;
+            count++;
+            if (min == 0 || stress_elements[j].int1 < min->int1)
+                min = &stress_elements[j];
+        }
+        assert(pqueue.count == count);
+        assert(min == 0 ? ds_pqueue_peek_min(&pqueue) == 0 : ((element_t *)ds_pqueue_peek_min(&pqueue))->int1 == min->int1);
+        (void)count;
+    }
+    for (int previous = pqueue.count ? ((element_t *)ds_pqueue_peek_min(&pqueue))->int1 : 0; pqueue.count;)
+    {
+        element_t *element = ds_pqueue_pop_min(&pqueue);
+        assert(element->int1 >= previous);
+        previous = element->int1;
+        (void)previous;
+    }
+    pqueue_min = ds_pqueue_pop_min(&pqueue);
+    assert(pqueue_min == 0);
+    (void)pqueue_min;
+
+    DO(printf("# Timer wheel\n"));
+    ds_timer_t *timer = malloc(sizeof(ds_timer_t));
+    ds_dlist_t expired;
+    ds_timer_init(timer, offsetof(element_t, timer_item), 1000);
+    ds_dlist_init(&expired, offsetof(element_t, timer_item));
+    memset(stress_elements, 0, STRESS_MAX * sizeof(element_t));
+    int timer_cancelled = ds_timer_cancel(timer, &stress_elements[0]);
+    assert(timer_cancelled == -1);
+    size_t timer_expired = ds_timer_advance(timer, 5000, &expired);
+    assert(timer_expired == 0 && timer->now == 5001);
+    (void)timer_expired;
+    uint64_t timer_delays[] = {0, 1, 63, 64, 65, 4095, 4096, 300000, 1ULL << 40, 1ULL << 62};
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        // id is the expiry tick of scheduled elements, 0 otherwise
+        uint64_t delay = timer_delays[i % 10] + random() % 3;
+        stress_elements[i].id = timer->now + delay;
+        ds_timer_schedule(timer, &stress_elements[i], stress_elements[i].id);
+    }
+    ds_timer_schedule(timer, &stress_elements[1], 10);
+    stress_elements[1].id = timer->now;
+    assert(timer->count == STRESS_MAX);
+    size_t timer_done = 0;
+    for (uint64_t now = timer->now, previous = 0, step = 0; timer->count; step++)
+    {
+        // Small steps first, then doubling steps up to the farthest timers
+        now += step < 2000 ? (uint64_t)random() % 5000 : now;
+        for (int i = 0; i < 10; i++)
+        {
+            element_t *element = &stress_elements[random() % STRESS_MAX];
+            if (element->id && random() % 8 == 0)
+            {
+                assert(ds_timer_pending(timer, element));
+                timer_cancelled = ds_timer_cancel(timer, element);
+                assert(timer_cancelled == 0);
+                element->id = 0;
+                timer_done++;
+            }
+            else if (element->id && element->id < (1ULL << 40))
+            {
+                element->id = now + 1 + random() % 10000;
+                ds_timer_schedule(timer, element, element->id);
+            }
+        }
+        size_t count = ds_timer_advance(timer, now, &expired);
+        assert(count == expired.count);
+        (void)count;
+        while (expired.root)
+        {
+            element_t *element = ds_dlist_remove_item(&expired, expired.root);
+            assert(element->id && element->id <= now && element->id >= previous);
+            timer_done++;
+            assert(!ds_timer_pending(timer, element));
+            previous = element->id;
+            element->id = 0;
+        }
+        (void)previous;
+        for (int i = 0; i < STRESS_MAX; i++)
+            assert(stress_elements[i].id == 0 || stress_elements[i].id > now);
+    }
+    // Expired or cancelled
+    assert(timer_done == STRESS_MAX);
+    (void)timer_cancelled;
+    free(timer);
+
+    DO(printf("# Hash table\n"));
+    ds_htable_t htable;
+    element_t *htable_elements = calloc(BULK_MAX, sizeof(element_t));
+    int htable_initialized = ds_htable_init(&htable, offsetof(element_t, htable_item), element_hash, element_eq, 0);
+    assert(htable_initialized == 0);
+    (void)htable_initialized;
+    for (int i = 0; i < 8 * BULK_MAX; i++)
+    {
+        // id tells whether the element is in the hash table
+        element_t *element = &htable_elements[random() % BULK_MAX];
+        element->int1 = element - htable_elements;
+        element_t key = {.int1 = element->int1};
+        if (random() % 3)
+        {
+            element_t *equal;
+            if (element->id)
+            {
+                equal = ds_htable_insert(&htable, &key);
+                assert(equal == element);
+            }
+            equal = ds_htable_insert(&htable, element);
+            assert(equal == element);
+            (void)equal;
+            element->id = 1;
+        }
+        else
+        {
+            element_t *removed = ds_htable_remove(&htable, &key);
+            assert(removed == (element->id ? element : 0));
+            (void)removed;
+            element->id = 0;
+        }
+        assert(ds_htable_find(&htable, &key) == (element->id ? element : 0));
+        (void)key;
+    }
+    size_t htable_count = 0;
+    for (int i = 0; i < BULK_MAX; i++)
+    {
+        element_t key = {.int1 = i};
+        assert(ds_htable_find(&htable, &key) == (htable_elements[i].id ? &htable_elements[i] : 0));
+        (void)key;
+        htable_count += htable_elements[i].id;
+    }
+    assert(htable.count == htable_count && htable._mask + 1 >= htable_count);
+    ds_htable_destroy(&htable);
+    free(htable_elements);
+
+    ds_htable_ext_t error_htable;
+    ds_htable_ext_item_t error_htable_items[ERROR_MAX];
+    int error_htable_initialized = ds_htable_ext_init(&error_htable, str_hash, str_eq, ERROR_MAX);
+    assert(error_htable_initialized == 0);
+    (void)error_htable_initialized;
+    for (int i = 0; i < ERROR_MAX; i++)
+    {
+        size_t count = error_htable.count;
+        char *error = ds_htable_ext_insert(&error_htable, &error_htable_items[i], errors[i]);
+        assert(strcmp(error, errors[i]) == 0);
+        (void)error;
+        // Items not inserted are marked
+        if (error_htable.count == count)
+            error_htable_items[i].object = 0;
+    }
+    assert(ds_htable_ext_find(&error_htable, "No such error") == 0);
+    for (int i = 0; i < ERROR_MAX; i++)
+        if (error_htable_items[i].object)
+        {
+            assert(ds_htable_ext_find(&error_htable, errors[i]) == errors[i]);
+            char *removed = ds_htable_ext_remove(&error_htable, &error_htable_items[i]);
+            assert(removed == errors[i]);
+            assert(ds_htable_ext_find(&error_htable, errors[i]) == 0);
+            (void)removed;
+        }
+    assert(error_htable.count == 0);
+    ds_htable_ext_destroy(&error_htable);
+
+    DO(printf("# Hash map\n"));
+    ds_hmap_t hmap;
+    element_t *hmap_elements = calloc(BULK_MAX, sizeof(element_t));
+    int hmap_initialized = ds_hmap_init(&hmap, element_hash, element_eq, 0);
+    assert(hmap_initialized == 0);
+    (void)hmap_initialized;
+    for (int i = 0; i < 8 * BULK_MAX; i++)
+    {
+        // id tells whether the element is in the hash map, the keys are drawn
+        // from a range growing then shrinking to exercise growth and reuse
+        int range = i < 4 * BULK_MAX ? i / 4 + 1 : 2 * BULK_MAX - i / 4;
+        element_t *element = &hmap_elements[random() % range];
+        element->int1 = element - hmap_elements;
+        element_t key = {.int1 = element->int1};
+        if (random() % 2)
+        {
+            element_t *equal;
+            if (element->id)
+            {
+                equal = ds_hmap_insert(&hmap, &key);
+                assert(equal == element);
+            }
+            equal = ds_hmap_insert(&hmap, element);
+            assert(equal == element);
+            (void)equal;
+            element->id = 1;
+        }
+        else
+        {
+            element_t *removed = ds_hmap_remove(&hmap, &key);
+            assert(removed == (element->id ? element : 0));
+            (void)removed;
+            element->id = 0;
+        }
+        assert(ds_hmap_find(&hmap, &key) == (element->id ? element : 0));
+        (void)key;
+    }
+    size_t hmap_count = 0;
+    for (int i = 0; i < BULK_MAX; i++)
+    {
+        element_t key = {.int1 = i};
+        assert(ds_hmap_find(&hmap, &key) == (hmap_elements[i].id ? &hmap_elements[i] : 0));
+        (void)key;
+        hmap_count += hmap_elements[i].id;
+    }
+    assert(hmap.count == hmap_count);
+    ds_hmap_destroy(&hmap);
+    free(hmap_elements);
+
+    ds_hmap_t error_hmap;
+    int error_hmap_initialized = ds_hmap_init(&error_hmap, str_hash, str_eq, 0);
+    assert(error_hmap_initialized == 0);
+    (void)error_hmap_initialized;
+    for (int i = 0; i < ERROR_MAX; i++)
+    {
+        char *error = ds_hmap_insert(&error_hmap, errors[i]);
+        assert(strcmp(error, errors[i]) == 0);
+        (void)error;
+    }
+    assert(ds_hmap_find(&error_hmap, "No such error") == 0);
+    assert(strcmp(ds_hmap_find(&error_hmap, "Success"), "Success") == 0);
+    for (int i = 0; i < ERROR_MAX; i++)
+    {
+        ds_hmap_remove(&error_hmap, errors[i]);
+        assert(ds_hmap_find(&error_hmap, errors[i]) == 0);
+    }
+    assert(error_hmap.count == 0);
+    ds_hmap_destroy(&error_hmap);
+
+    DO(printf("# LRU and CLOCK caches\n"));
+    ds_cache_t cache;
+    for (int mode = DS_CACHE_LRU; mode <= DS_CACHE_CLOCK; mode++)
+    {
+        memset(stress_elements, 0, STRESS_MAX * sizeof(element_t));
+        for (int i = 0; i < STRESS_MAX; i++)
+            stress_elements[i].int1 = i;
+        cache_evicted = 0;
+        int cache_initialized = ds_cache_init(&cache, offsetof(element_t, cache_item), element_hash, element_eq, 4, 0, mode, cache_evict);
+        assert(cache_initialized == 0);
+        element_t *inserted, *found;
+        for (int i = 0; i < 4; i++)
+        {
+            inserted = ds_cache_insert(&cache, &stress_elements[i], 1);
+            assert(inserted == &stress_elements[i]);
+        }
+        element_t key = {.int1 = 0};
+        found = ds_cache_find(&cache, &key);
+        assert(found == &stress_elements[0]);
+        inserted = ds_cache_insert(&cache, &key, 1);
+        assert(inserted == &stress_elements[0]);
+        // Both policies keep the hit object and evict the next oldest one
+        ds_cache_insert(&cache, &stress_elements[4], 1);
+        assert(cache.count == 4 && cache_evicted == 1);
+        key.int1 = 1;
+        found = ds_cache_find(&cache, &key);
+        assert(found == 0);
+        key.int1 = 0;
+        found = ds_cache_find(&cache, &key);
+        assert(found == &stress_elements[0]);
+        ds_cache_insert(&cache, &stress_elements[5], 1);
+        key.int1 = 2;
+        found = ds_cache_find(&cache, &key);
+        assert(cache_evicted == 2 && found == 0);
+        element_t *removed = ds_cache_remove(&cache, &key);
+        assert(removed == 0);
+        key.int1 = 3;
+        removed = ds_cache_remove(&cache, &key);
+        assert(removed == &stress_elements[3] && cache.count == 3);
+        ds_cache_destroy(&cache);
+        assert(cache_evicted == 5);
+
+        // The inserted object is kept even if every resident object was hit
+        cache_evicted = 0;
+        cache_initialized = ds_cache_init(&cache, offsetof(element_t, cache_item), element_hash, element_eq, 2, 0, mode, cache_evict);
+        assert(cache_initialized == 0);
+        ds_cache_insert(&cache, &stress_elements[6], 1);
+        ds_cache_insert(&cache, &stress_elements[7], 1);
+        key.int1 = 6;
+        ds_cache_find(&cache, &key);
+        key.int1 = 7;
+        ds_cache_find(&cache, &key);
+        inserted = ds_cache_insert(&cache, &stress_elements[8], 1);
+        assert(inserted == &stress_elements[8] && cache.count == 2 && cache_evicted == 1);
+        key.int1 = 8;
+        found = ds_cache_find(&cache, &key);
+        assert(found == &stress_elements[8]);
+        key.int1 = 6;
+        found = ds_cache_find(&cache, &key);
+        assert(found == 0);
+        ds_cache_destroy(&cache);
+
+        // Random operations within a byte bound, id tells whether an element
+        // is in the cache
+        cache_evicted = 0;
+        cache_initialized = ds_cache_init(&cache, offsetof(element_t, cache_item), element_hash, element_eq, 0, 1000, mode, cache_evict);
+        assert(cache_initialized == 0);
+        for (int i = 0; i < 20 * STRESS_MAX; i++)
+        {
+            element_t *element = &stress_elements[random() % STRESS_MAX];
+            key.int1 = element->int1;
+            if (random() % 2)
+            {
+                if (ds_cache_insert(&cache, element, 1 + element->int1 % 20) == element)
+                    element->id = 1;
+            }
+            else
+            {
+                found = ds_cache_find(&cache, &key);
+                assert(found == (element->id ? element : 0));
+            }
+            assert(cache.bytes <= 1000 && cache.recency.count == cache.count);
+        }
+        size_t cache_count = 0;
+        for (int i = 0; i < STRESS_MAX; i++)
+            cache_count += stress_elements[i].id;
+        assert(cache_count == cache.count && cache.index.count == cache.count);
+        ds_cache_destroy(&cache);
+        (void)cache_initialized;
+        (void)inserted;
+        (void)found;
+        (void)removed;
+        (void)cache_count;
+    }
+
+    DO(printf("# Sharded cache shared by threads\n"));
+    for (int mode = DS_CACHE_LRU; mode <= DS_CACHE_CLOCK; mode++)
+    {
+        ds_cache_sharded_t sharded;
+        pthread_t cache_threads[READER_MAX];
+        cache_thread_t cache_args[READER_MAX];
+        cache_evicted = 0;
+        int sharded_initialized = ds_cache_sharded_init(&sharded, 8, offsetof(element_t, cache_item), element_hash, element_eq, STRESS_MAX / 4, 0, mode, cache_evict);
+        assert(sharded_initialized == 0);
+        (void)sharded_initialized;
+        for (int i = 0; i < READER_MAX; i++)
+        {
+            cache_args[i] = (cache_thread_t){&sharded, stress_elements + i * (STRESS_MAX / READER_MAX)};
+            pthread_create(&cache_threads[i], 0, cache_thread, &cache_args[i]);
+        }
+        for (int i = 0; i < READER_MAX; i++)
+            pthread_join(cache_threads[i], 0);
+        size_t cache_count = 0, cache_found = 0;
+        for (size_t i = 0; i < sharded.shard_count; i++)
+        {
+            assert(sharded.shards[i].cache.count <= sharded.shards[i].cache.max_count);
+            cache_count += sharded.shards[i].cache.count;
+        }
+        for (int i = 0; i < STRESS_MAX; i++)
+            cache_found += ds_cache_sharded_find(&sharded, &stress_elements[i]) != 0;
+        assert(cache_found == cache_count && cache_evicted > 0);
+        (void)cache_count;
+        ds_cache_sharded_destroy(&sharded);
+    }
+
+    DO(printf("# Concat, splice and batches of fifos, lifos and lists\n"));
+    void *batch[16];
+    size_t batch_count;
+    ds_fifo_t fifo_a, fifo_b;
+    ds_fifo_init(&fifo_a, offsetof(element_t, fifo_item));
+    ds_fifo_init(&fifo_b, offsetof(element_t, fifo_item));
+    for (int i = 0; i < 10; i++)
+    {
+        stress_elements[i].int1 = i;
+        ds_fifo_enq(i < 4 ? &fifo_a : &fifo_b, &stress_elements[i]);
+    }
+    ds_fifo_concat(&fifo_b, &fifo_a);
+    ds_fifo_concat(&fifo_a, &fifo_b);
+    assert(fifo_a.count == 10 && fifo_b.count == 0 && fifo_b.root == 0 && fifo_b.last == 0);
+    // Chain 10 and 11 by hand
+    stress_elements[10].int1 = 10;
+    stress_elements[11].int1 = 11;
+    stress_elements[10].fifo_item.next = &stress_elements[11].fifo_item;
+    ds_fifo_enq_chain(&fifo_b, &stress_elements[10], &stress_elements[11], 2);
+    ds_fifo_concat(&fifo_a, &fifo_b);
+    batch_count = ds_fifo_deq_batch(&fifo_a, batch, 5);
+    assert(batch_count == 5 && fifo_a.count == 7);
+    batch_count = ds_fifo_deq_batch(&fifo_a, batch + 5, 16);
+    assert(batch_count == 7 && fifo_a.count == 0 && fifo_a.last == 0);
+    int fifo_order[] = {4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 10, 11};
+    for (int i = 0; i < 12; i++)
+        assert(((element_t *)batch[i])->int1 == fifo_order[i]);
+    (void)fifo_order;
+
+    ds_lifo_t lifo_a, lifo_b;
+    ds_lifo_init(&lifo_a, offsetof(element_t, lifo_item));
+    ds_lifo_init(&lifo_b, offsetof(element_t, lifo_item));
+    for (int i = 0; i < 6; i++)
+        ds_lifo_push(i < 3 ? &lifo_a : &lifo_b, &stress_elements[i]);
+    ds_lifo_concat(&lifo_a, &lifo_b);
+    stress_elements[10].lifo_item.next = &stress_elements[11].lifo_item;
+    ds_lifo_push_chain(&lifo_a, &stress_elements[10], &stress_elements[11], 2);
+    assert(lifo_a.count == 8 && lifo_b.count == 0 && lifo_b.root == 0);
+    batch_count = ds_lifo_pop_batch(&lifo_a, batch, 16);
+    assert(batch_count == 8 && lifo_a.count == 0 && lifo_a.root == 0);
+    int lifo_order[] = {10, 11, 5, 4, 3, 2, 1, 0};
+    for (int i = 0; i < 8; i++)
+        assert(((element_t *)batch[i])->int1 == lifo_order[i]);
+    (void)lifo_order;
+
+    ds_dlist_t dlist_a, dlist_b;
+    ds_dlist_init(&dlist_a, offsetof(element_t, dlist_item));
+    ds_dlist_init(&dlist_b, offsetof(element_t, dlist_item));
+    for (int i = 0; i < 10; i++)
+        ds_dlist_enq(i < 5 ? &dlist_a : &dlist_b, &stress_elements[i]);
+    // Move 6..8 before 1, then 2..3 at the end of the other list, then 0 of
+    // the same list before 4
+    ds_dlist_splice(&dlist_a, &stress_elements[1], &dlist_b, &stress_elements[6], &stress_elements[8], 3);
+    ds_dlist_splice(&dlist_b, 0, &dlist_a, &stress_elements[2], &stress_elements[3], 2);
+    ds_dlist_splice(&dlist_a, &stress_elements[4], &dlist_a, &stress_elements[0], &stress_elements[0], 1);
+    assert(dlist_a.count == 6 && dlist_b.count == 4);
+    stress_elements[10].dlist_item.next = &stress_elements[11].dlist_item;
+    stress_elements[11].dlist_item.prev = &stress_elements[10].dlist_item;
+    ds_dlist_enq_chain(&dlist_b, &stress_elements[10], &stress_elements[11], 2);
+    ds_dlist_concat(&dlist_a, &dlist_b);
+    assert(dlist_a.count == 12 && dlist_b.count == 0 && dlist_b.root == 0 && dlist_b.last == 0);
+    int dlist_order[] = {6, 7, 8, 1, 0, 4, 5, 9, 2, 3, 10, 11};
+    int dlist_index = 12;
+    for (ds_dlist_item_t *item = dlist_a.last; item; item = item->prev)
+    {
+        dlist_index--;
+        assert(elementof(&dlist_a, item)->int1 == dlist_order[dlist_index]);
+    }
+    assert(dlist_index == 0);
+    batch_count = ds_dlist_deq_batch(&dlist_a, batch, 5);
+    assert(batch_count == 5 && dlist_a.root->prev == 0);
+    batch_count = ds_dlist_deq_batch(&dlist_a, batch + 5, 16);
+    assert(batch_count == 7 && dlist_a.count == 0 && dlist_a.last == 0);
+    for (int i = 0; i < 12; i++)
+        assert(((element_t *)batch[i])->int1 == dlist_order[i]);
+    (void)dlist_order;
+
+    ds_fifo_ext_item_t fifo_ext_items[4];
+    ds_fifo_ext_t fifo_ext_a, fifo_ext_b;
+    ds_fifo_ext_init(&fifo_ext_a);
+    ds_fifo_ext_init(&fifo_ext_b);
+    ds_fifo_ext_enq(&fifo_ext_a, &fifo_ext_items[0], errors[0]);
+    ds_fifo_ext_enq(&fifo_ext_b, &fifo_ext_items[1], errors[1]);
+    fifo_ext_items[2] = (ds_fifo_ext_item_t){&fifo_ext_items[3], errors[2]};
+    fifo_ext_items[3].object = errors[3];
+    ds_fifo_ext_enq_chain(&fifo_ext_b, &fifo_ext_items[2], &fifo_ext_items[3], 2);
+    ds_fifo_ext_concat(&fifo_ext_a, &fifo_ext_b);
+    batch_count = ds_fifo_ext_deq_batch(&fifo_ext_a, batch, 16);
+    assert(fifo_ext_b.count == 0 && batch_count == 4);
+    for (int i = 0; i < 4; i++)
+        assert(batch[i] == errors[i]);
+
+    ds_lifo_ext_item_t lifo_ext_items[4];
+    ds_lifo_ext_t lifo_ext_a, lifo_ext_b;
+    ds_lifo_ext_init(&lifo_ext_a);
+    ds_lifo_ext_init(&lifo_ext_b);
+    ds_lifo_ext_push(&lifo_ext_a, &lifo_ext_items[0], errors[3]);
+    ds_lifo_ext_push(&lifo_ext_b, &lifo_ext_items[1], errors[2]);
+    lifo_ext_items[2] = (ds_lifo_ext_item_t){&lifo_ext_items[3], errors[0]};
+    lifo_ext_items[3].object = errors[1];
+    ds_lifo_ext_concat(&lifo_ext_a, &lifo_ext_b);
+    ds_lifo_ext_push_chain(&lifo_ext_a, &lifo_ext_items[2], &lifo_ext_items[3], 2);
+    batch_count = ds_lifo_ext_pop_batch(&lifo_ext_a, batch, 16);
+    assert(lifo_ext_b.count == 0 && batch_count == 4);
+    for (int i = 0; i < 4; i++)
+        assert(batch[i] == errors[i]);
+
+    ds_dlist_ext_item_t dlist_ext_items[6];
+    ds_dlist_ext_t dlist_ext_a, dlist_ext_b;
+    ds_dlist_ext_init(&dlist_ext_a);
+    ds_dlist_ext_init(&dlist_ext_b);
+    for (int i = 0; i < 4; i++)
+        ds_dlist_ext_enq(i < 2 ? &dlist_ext_a : &dlist_ext_b, &dlist_ext_items[i], errors[i]);
+    ds_dlist_ext_splice(&dlist_ext_a, &dlist_ext_items[0], &dlist_ext_b, &dlist_ext_items[2], &dlist_ext_items[3], 2);
+    dlist_ext_items[4] = (ds_dlist_ext_item_t){&dlist_ext_items[5], 0, errors[4]};
+    dlist_ext_items[5] = (ds_dlist_ext_item_t){0, &dlist_ext_items[4], errors[5]};
+    ds_dlist_ext_enq_chain(&dlist_ext_b, &dlist_ext_items[4], &dlist_ext_items[5], 2);
+    ds_dlist_ext_concat(&dlist_ext_a, &dlist_ext_b);
+    assert(dlist_ext_b.count == 0 && dlist_ext_a.last->object == errors[5]);
+    batch_count = ds_dlist_ext_deq_batch(&dlist_ext_a, batch, 16);
+    assert(batch_count == 6);
+    int dlist_ext_order[] = {2, 3, 0, 1, 4, 5};
+    for (int i = 0; i < 6; i++)
+        assert(batch[i] == errors[dlist_ext_order[i]]);
+    (void)dlist_ext_order;
+    (void)batch_count;
+
+    DO(printf("# Sort fifos and lists\n"));
+    for (int radix = 0; radix <= 1; radix++)
+    {
+        ds_fifo_t sort_fifo;
+        ds_dlist_t sort_dlist;
+        ds_fifo_init(&sort_fifo, offsetof(element_t, fifo_item));
+        ds_dlist_init(&sort_dlist, offsetof(element_t, dlist_item));
+        ds_fifo_sort(&sort_fifo, btree_node_cmp);
+        ds_dlist_radix_sort(&sort_dlist, offsetof(element_t, id));
+        assert(sort_fifo.root == 0 && sort_fifo.last == 0 && sort_dlist.root == 0 && sort_dlist.last == 0);
+        // The sort key has many duplicates, the other field is the insertion
+        // order to check stability
+        for (int i = 0; i < STRESS_MAX; i++)
+        {
+            int key = random() % (STRESS_MAX / 10);
+            stress_elements[i].int1 = radix ? i : key;
+            stress_elements[i].id = radix ? ((uint64_t)key << 40) + 7 : (uint64_t)i;
+            ds_fifo_enq(&sort_fifo, &stress_elements[i]);
+            ds_dlist_enq(&sort_dlist, &stress_elements[i]);
+        }
+        if (radix)
+        {
+            ds_fifo_radix_sort(&sort_fifo, offsetof(element_t, id));
+            ds_dlist_radix_sort(&sort_dlist, offsetof(element_t, id));
+        }
+        else
+        {
+            ds_fifo_sort(&sort_fifo, btree_node_cmp);
+            ds_dlist_sort(&sort_dlist, btree_node_cmp);
+        }
+        assert(sort_fifo.count == STRESS_MAX && sort_fifo.last->next == 0);
+        element_t *previous = 0;
+        for (ds_fifo_item_t *item = sort_fifo.root; item; item = item->next)
+        {
+            element_t *element = elementof(&sort_fifo, item);
+            uint64_t key = radix ? element->id : (uint64_t)element->int1;
+            uint64_t order = radix ? (uint64_t)element->int1 : element->id;
+            if (previous)
+            {
+                uint64_t previous_key = radix ? previous->id : (uint64_t)previous->int1;
+                uint64_t previous_order = radix ? (uint64_t)previous->int1 : previous->id;
+                assert(previous_key < key || (previous_key == key && previous_order < order));
+                (void)previous_key;
+                (void)previous_order;
+            }
+            previous = element;
+            (void)key;
+            (void)order;
+        }
+        assert(&previous->fifo_item == sort_fifo.last);
+        // Both sorts are stable, so the list is in the same order, both ways
+        ds_fifo_item_t *fifo_item = sort_fifo.root;
+        ds_dlist_item_t *dlist_item;
+        for (dlist_item = sort_dlist.root; dlist_item; dlist_item = dlist_item->next)
+        {
+            assert(elementof(&sort_dlist, dlist_item) == elementof(&sort_fifo, fifo_item));
+            assert(dlist_item->next ? dlist_item->next->prev == dlist_item : sort_dlist.last == dlist_item);
+            fifo_item = fifo_item->next;
+        }
+        assert(sort_dlist.root->prev == 0);
+    }
+
+    DO(printf("# Unrolled fifo, lifo and dlist\n"));
+    ds_heap_t chunk_heap;
+    DS_HEAP_INIT_GROWABLE(chunk_heap, 8, ds_chunk_t);
+    ds_fifo_unrolled_t unrolled_fifo, unrolled_fifo_b;
+    ds_lifo_unrolled_t unrolled_lifo;
+    ds_chunk_iter_t iter;
+    ds_fifo_unrolled_init(&unrolled_fifo, &chunk_heap);
+    ds_fifo_unrolled_init(&unrolled_fifo_b, &chunk_heap);
+    ds_lifo_unrolled_init(&unrolled_lifo, &chunk_heap);
+    void *unrolled_object = ds_fifo_unrolled_deq(&unrolled_fifo);
+    void *unrolled_other = ds_lifo_unrolled_pop(&unrolled_lifo);
+    assert(unrolled_object == 0 && unrolled_other == 0);
+    unrolled_object = ds_fifo_unrolled_first(&unrolled_fifo, &iter);
+    unrolled_other = ds_lifo_unrolled_first(&unrolled_lifo, &iter);
+    assert(unrolled_object == 0 && unrolled_other == 0);
+    int unrolled_result;
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        unrolled_result = ds_fifo_unrolled_enq(i < STRESS_MAX / 3 ? &unrolled_fifo : &unrolled_fifo_b, &stress_elements[i]);
+        assert(unrolled_result == 0);
+        unrolled_result = ds_lifo_unrolled_push(&unrolled_lifo, &stress_elements[i]);
+        assert(unrolled_result == 0);
+    }
+    ds_fifo_unrolled_concat(&unrolled_fifo, &unrolled_fifo_b);
+    assert(unrolled_fifo.count == STRESS_MAX && unrolled_fifo_b.count == 0 && unrolled_lifo.count == STRESS_MAX);
+    int unrolled_count = 0;
+    for (void *object = ds_fifo_unrolled_first(&unrolled_fifo, &iter); object; object = ds_fifo_unrolled_next(&iter))
+    {
+        assert(object == &stress_elements[unrolled_count]);
+        unrolled_count++;
+    }
+    assert(unrolled_count == STRESS_MAX);
+    for (void *object = ds_lifo_unrolled_first(&unrolled_lifo, &iter); object; object = ds_lifo_unrolled_next(&iter))
+    {
+        unrolled_count--;
+        assert(object == &stress_elements[unrolled_count]);
+    }
+    assert(unrolled_count == 0);
+    for (int i = 0; i < STRESS_MAX / 2; i++)
+    {
+        unrolled_object = ds_fifo_unrolled_deq(&unrolled_fifo);
+        unrolled_other = ds_lifo_unrolled_pop(&unrolled_lifo);
+        assert(unrolled_object == &stress_elements[i]);
+        assert(unrolled_other == &stress_elements[STRESS_MAX - 1 - i]);
+    }
+    size_t unrolled_batch = ds_fifo_unrolled_deq_batch(&unrolled_fifo, batch, 16);
+    assert(unrolled_batch == 16 && batch[15] == &stress_elements[STRESS_MAX / 2 + 15]);
+    unrolled_batch = ds_lifo_unrolled_pop_batch(&unrolled_lifo, batch, 16);
+    assert(unrolled_batch == 16 && batch[15] == &stress_elements[STRESS_MAX / 2 - 16]);
+    for (int i = 0; i < STRESS_MAX; i++)
+    {
+        unrolled_result = ds_fifo_unrolled_enq(&unrolled_fifo, &stress_elements[i]);
+        assert(unrolled_result == 0);
+    }
+    void **unrolled_objects = calloc(2 * STRESS_MAX, sizeof(void *));
+    unrolled_batch = ds_fifo_unrolled_deq_batch(&unrolled_fifo, unrolled_objects, 2 * STRESS_MAX);
+    assert(unrolled_batch == STRESS_MAX / 2 - 16 + STRESS_MAX);
+    assert(unrolled_fifo.root == 0 && unrolled_fifo.last == 0 && unrolled_objects[STRESS_MAX / 2 - 16] == &stress_elements[0]);
+    ds_lifo_unrolled_clear(&unrolled_lifo);
+    // Empty chunks always go back to the heap
+    assert(unrolled_lifo.root == 0 && chunk_heap.count == 0);
+
+    // Random operations on an unrolled dlist, checked against an array
+    ds_dlist_unrolled_t unrolled_dlist;
+    ds_dlist_unrolled_init(&unrolled_dlist, &chunk_heap);
+    int model_begin = STRESS_MAX, model_end = STRESS_MAX;
+    for (int i = 0; i < 16 * STRESS_MAX; i++)
+    {
+        void *object = &stress_elements[i % STRESS_MAX];
+        int operation = random() % 4;
+        if (operation == 0 && model_begin > 0)
+        {
+            unrolled_result = ds_dlist_unrolled_push(&unrolled_dlist, object);
+            assert(unrolled_result == 0);
+            unrolled_objects[--model_begin] = object;
+        }
+        else if (operation == 1 && model_end < 2 * STRESS_MAX)
+        {
+            unrolled_result = ds_dlist_unrolled_enq(&unrolled_dlist, object);
+            assert(unrolled_result == 0);
+            unrolled_objects[model_end++] = object;
+        }
+        else if (operation == 2)
+        {
+            unrolled_object = ds_dlist_unrolled_deq(&unrolled_dlist);
+            if (model_begin < model_end)
+            {
+                assert(unrolled_object == unrolled_objects[model_begin]);
+                model_begin++;
+            }
+            else
+                assert(unrolled_object == 0);
+        }
+        else if (model_begin < model_end)
+        {
+            int position = model_begin + random() % (model_end - model_begin);
+            void *found = ds_dlist_unrolled_first(&unrolled_dlist, &iter);
+            for (int j = model_begin; j < position; j++)
+                found = ds_dlist_unrolled_next(&iter);
+            assert(found == unrolled_objects[position]);
+            (void)found;
+            memmove(&unrolled_objects[position], &unrolled_objects[position + 1], (model_end - position - 1) * sizeof(void *));
+            model_end--;
+            unrolled_object = ds_dlist_unrolled_remove(&unrolled_dlist, &iter);
+            assert(unrolled_object == (position < model_end ? unrolled_objects[position] : 0));
+        }
+        assert(unrolled_dlist.count == (size_t)(model_end - model_begin));
+    }
+    unrolled_count = model_begin;
+    for (void *object = ds_dlist_unrolled_first(&unrolled_dlist, &iter); object; object = ds_dlist_unrolled_next(&iter))
+    {
+        assert(object == unrolled_objects[unrolled_count]);
+        unrolled_count++;
+    }
+    assert(unrolled_count == model_end);
+    for (void *object = ds_dlist_unrolled_last(&unrolled_dlist, &iter); object; object = ds_dlist_unrolled_prev(&iter))
+    {
+        unrolled_count--;
+        assert(object == unrolled_objects[unrolled_count]);
+    }
+    assert(unrolled_count == model_begin);
+    ds_dlist_unrolled_clear(&unrolled_dlist);
+    assert(chunk_heap.count == 0);
+    free(unrolled_objects);
+    ds_heap_destroy(&chunk_heap);
+
+    // A heap without slabs runs out of chunks
+    ds_chunk_t two_chunks[2];
+    DS_HEAP_INIT_LAZY(chunk_heap, two_chunks, 2, ds_chunk_t);
+    ds_fifo_unrolled_init(&unrolled_fifo, &chunk_heap);
+    for (int i = 0; i < 2 * DS_CHUNK_NMEMB; i++)
+    {
+        unrolled_result = ds_fifo_unrolled_enq(&unrolled_fifo, &stress_elements[i]);
+        assert(unrolled_result == 0);
+    }
+    unrolled_result = ds_fifo_unrolled_enq(&unrolled_fifo, &stress_elements[0]);
+    assert(unrolled_result == -1 && unrolled_fifo.count == 2 * DS_CHUNK_NMEMB);
+    ds_fifo_unrolled_clear(&unrolled_fifo);
+    (void)unrolled_object;
+    (void)unrolled_other;
+    (void)unrolled_result;
+    (void)unrolled_batch;
+    (void)unrolled_count;
+    free(stress_elements);
+
+    DO(printf("\n# Lookup keys in btree and compare with a linear scan of the elements\n"));
+    for (int k = -1; k <= 101; k++)
+    {
+        element_t key = {.int1 = k};
+        int lower = 4242, upper = 4242, floor = -1;
+        for (int j = 0; j < ITEM_MAX; j++)
+        {
+            int v = elements_store[j].int1;
+            if (v >= k && v < lower)
+                lower = v;
+            if (v > k && v < upper)
+                upper = v;
+            if (v <= k && v > floor)
+                floor = v;
+        }
+        element_t *found = ds_btree_find(&btree, &key);
+        assert(found ? found->int1 == k : lower != k);
+        assert(((element_t *)ds_btree_lower_bound(&btree, &key))->int1 == lower);
+        assert(((element_t *)ds_btree_ceil(&btree, &key))->int1 == lower);
+        assert(((element_t *)ds_btree_upper_bound(&btree, &key))->int1 == upper);
+        element_t *floor_element = ds_btree_floor(&btree, &key);
+        assert(floor_element ? floor_element->int1 == floor : floor == -1);
+        (void)found;
+        (void)floor_element;
+    }
+    element_t key_4243 = {.int1 = 4243};
+    assert(ds_btree_upper_bound(&btree, &the_4242_element) == 0);
+    assert(ds_btree_floor(&btree, &key_4243) == &the_4242_element);
+    (void)key_4243;
+
+    DO(printf("# Lookup strings in ext btree\n"));
+    assert(ds_btree_ext_find(&error_tree, "Success") != 0);
+    assert(ds_btree_ext_find(&error_tree, "No such error") == 0);
+    assert(strcmp(ds_btree_ext_lower_bound(&error_tree, "No such error"), "No such file or directory") == 0);
+    assert(strcmp(ds_btree_ext_upper_bound(&error_tree, "Success"), "Text file busy") == 0);
+    assert(strcmp(ds_btree_ext_floor(&error_tree, "No such error"), "No such device or address") == 0);
+    assert(ds_btree_ext_ceil(&error_tree, "~") == 0);
 }